@@ -0,0 +1,236 @@
+/* Copyright 2015 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/nn_ops.cc.
+// FusedConv2DBias and FusedMatMulBias are generated by load-time graph
+// optimization, they run the product into output, then apply bias and
+// activation in place, so no intermediate tensor is allocated.
+
+#define EIGEN_USE_THREADS
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/common_shape_fns.h"
+#include "tensorflow/core/framework/numeric_op.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/kernels/bounds_check.h"
+#include "tensorflow/core/kernels/conv_ops.h"
+#include "tensorflow/core/kernels/matmul_op.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/util/padding.h"
+#include "tensorflow/core/util/tensor_format.h"
+
+namespace tensorflow {
+
+typedef Eigen::ThreadPoolDevice CPUDevice;
+
+// Extern template instantiated in conv_ops.cc.
+extern template class LaunchConv2DOp<CPUDevice, float>;
+
+namespace {
+
+enum FusedActivation { kActivationNone, kActivationRelu, kActivationRelu6 };
+
+Status GetFusedActivation(OpKernelConstruction* context,
+                          FusedActivation* activation) {
+  string str;
+  TF_RETURN_IF_ERROR(context->GetAttr("activation", &str));
+  if (str == "None") {
+    *activation = kActivationNone;
+  } else if (str == "Relu") {
+    *activation = kActivationRelu;
+  } else if (str == "Relu6") {
+    *activation = kActivationRelu6;
+  } else {
+    return errors::InvalidArgument("Unsupported activation: ", str);
+  }
+  return Status::OK();
+}
+
+// output is viewed as [rows, channels], bias is broadcast along rows.
+template <typename T>
+void BiasActivation(OpKernelContext* context, const Tensor& bias,
+                    FusedActivation activation, Tensor* output) {
+  const int64 channels = bias.NumElements();
+  const int64 rows = output->NumElements() / channels;
+  typename TTypes<T, 2>::Tensor out =
+      output->shaped<T, 2>({rows, channels});
+  Eigen::DSizes<Eigen::Index, 2> rest_by_one(1, channels);
+  Eigen::DSizes<Eigen::Index, 2> one_by_rows(rows, 1);
+  auto biased =
+      out + bias.vec<T>().reshape(rest_by_one).broadcast(one_by_rows);
+
+  const CPUDevice& d = context->eigen_device<CPUDevice>();
+  if (activation == kActivationRelu) {
+    out.device(d) = biased.cwiseMax(static_cast<T>(0));
+  } else if (activation == kActivationRelu6) {
+    out.device(d) =
+        biased.cwiseMax(static_cast<T>(0)).cwiseMin(static_cast<T>(6));
+  } else {
+    out.device(d) = biased;
+  }
+}
+
+}  // namespace
+
+template <typename T>
+class FusedConv2DBiasOp : public OpKernel {
+ public:
+  explicit FusedConv2DBiasOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("strides", &strides_));
+    OP_REQUIRES(context, strides_.size() == 4,
+                errors::InvalidArgument("Sliding window strides field must "
+                                        "specify 4 dimensions"));
+    OP_REQUIRES(
+        context, strides_[0] == 1 && strides_[3] == 1,
+        errors::InvalidArgument("Current implementation does not yet support "
+                                "strides in the batch and depth dimensions."));
+    OP_REQUIRES_OK(context, context->GetAttr("padding", &padding_));
+    OP_REQUIRES_OK(context, GetFusedActivation(context, &activation_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& input = context->input(0);
+    const Tensor& filter = context->input(1);
+    const Tensor& bias = context->input(2);
+
+    OP_REQUIRES(context, input.dims() == 4,
+                errors::InvalidArgument("input must be 4-dimensional",
+                                        input.shape().DebugString()));
+    OP_REQUIRES(context, filter.dims() == 4,
+                errors::InvalidArgument("filter must be 4-dimensional: ",
+                                        filter.shape().DebugString()));
+    OP_REQUIRES(context, input.dim_size(3) == filter.dim_size(2),
+                errors::InvalidArgument(
+                    "input and filter must have the same depth: ",
+                    input.dim_size(3), " vs ", filter.dim_size(2)));
+    OP_REQUIRES(context,
+                TensorShapeUtils::IsVector(bias.shape()) &&
+                    bias.dim_size(0) == filter.dim_size(3),
+                errors::InvalidArgument("bias must be 1-D with size of "
+                                        "out_channels: ",
+                                        bias.shape().DebugString()));
+
+    const int stride_rows = strides_[1];
+    const int stride_cols = strides_[2];
+    int64 out_rows = 0, out_cols = 0, pad_rows = 0, pad_cols = 0;
+    OP_REQUIRES_OK(context, GetWindowedOutputSize(
+                                input.dim_size(1), filter.dim_size(0),
+                                stride_rows, padding_, &out_rows, &pad_rows));
+    OP_REQUIRES_OK(context, GetWindowedOutputSize(
+                                input.dim_size(2), filter.dim_size(1),
+                                stride_cols, padding_, &out_cols, &pad_cols));
+    TensorShape out_shape({input.dim_size(0), out_rows, out_cols,
+                           filter.dim_size(3)});
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, out_shape, &output));
+    if (out_shape.num_elements() == 0) {
+      return;
+    }
+
+    launcher_.launch(context, false, false, input, filter, stride_rows,
+                     stride_cols, BrainPadding2EigenPadding(padding_), output,
+                     FORMAT_NHWC);
+    if (!context->status().ok()) {
+      return;
+    }
+    BiasActivation<T>(context, bias, activation_, output);
+  }
+
+ private:
+  std::vector<int32> strides_;
+  Padding padding_;
+  FusedActivation activation_;
+  LaunchConv2DOp<CPUDevice, T> launcher_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FusedConv2DBiasOp);
+};
+
+template <typename T>
+class FusedMatMulBiasOp : public OpKernel {
+ public:
+  explicit FusedMatMulBiasOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_a", &transpose_a_));
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_b", &transpose_b_));
+    OP_REQUIRES_OK(context, GetFusedActivation(context, &activation_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& a = context->input(0);
+    const Tensor& b = context->input(1);
+    const Tensor& bias = context->input(2);
+
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(a.shape()),
+                errors::InvalidArgument("In[0] is not a matrix"));
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(b.shape()),
+                errors::InvalidArgument("In[1] is not a matrix"));
+    Eigen::array<Eigen::IndexPair<Eigen::DenseIndex>, 1> dim_pair;
+    dim_pair[0].first = transpose_a_ ? 0 : 1;
+    dim_pair[0].second = transpose_b_ ? 1 : 0;
+    OP_REQUIRES(context,
+                a.dim_size(dim_pair[0].first) == b.dim_size(dim_pair[0].second),
+                errors::InvalidArgument("Matrix size-incompatible: In[0]: ",
+                                        a.shape().DebugString(), ", In[1]: ",
+                                        b.shape().DebugString()));
+    const int64 a_dim_remaining = 1 - dim_pair[0].first;
+    const int64 b_dim_remaining = 1 - dim_pair[0].second;
+    TensorShape out_shape(
+        {a.dim_size(a_dim_remaining), b.dim_size(b_dim_remaining)});
+    OP_REQUIRES(context,
+                TensorShapeUtils::IsVector(bias.shape()) &&
+                    bias.dim_size(0) == out_shape.dim_size(1),
+                errors::InvalidArgument("bias must be 1-D with size of "
+                                        "product columns: ",
+                                        bias.shape().DebugString()));
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, out_shape, &output));
+    if (out_shape.num_elements() == 0) {
+      return;
+    }
+    if (a.NumElements() == 0 || b.NumElements() == 0) {
+      output->flat<T>().setZero();
+    } else {
+      functor::MatMul<CPUDevice>(context->eigen_device<CPUDevice>(),
+                                 output->matrix<T>(), a.matrix<T>(),
+                                 b.matrix<T>(), dim_pair);
+    }
+    BiasActivation<T>(context, bias, activation_, output);
+  }
+
+ private:
+  bool transpose_a_;
+  bool transpose_b_;
+  FusedActivation activation_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FusedMatMulBiasOp);
+};
+
+REGISTER_KERNEL_BUILDER(
+    Name("FusedConv2DBias").Device(DEVICE_CPU).TypeConstraint<float>("T"),
+    FusedConv2DBiasOp<float>);
+REGISTER_KERNEL_BUILDER(
+    Name("FusedMatMulBias").Device(DEVICE_CPU).TypeConstraint<float>("T"),
+    FusedMatMulBiasOp<float>);
+
+}  // namespace tensorflow
+
+void tensorflow_link_kernels_fused_conv_bias_op() {}
\ No newline at end of file
@@ -809,6 +809,54 @@ strides: 1-D of length 4.  The stride of the sliding window for each dimension
 padding: The type of padding algorithm to use.
  )doc");
 
+REGISTER_OP("FusedConv2DBias")
+    .Input("input: T")
+    .Input("filter: T")
+    .Input("bias: T")
+    .Output("output: T")
+    .Attr("T: {float}")
+    .Attr("strides: list(int)")
+    .Attr(GetPaddingAttrString())
+    .Attr("activation: {'None', 'Relu', 'Relu6'} = 'None'")
+    .SetShapeFn(shape_inference::Conv2DShape)
+    .Doc(R"doc(
+Performs Conv2D, BiasAdd and an optional Relu/Relu6 as one kernel.
+
+Graph optimization rewrites Conv2D -> BiasAdd [-> Relu] chains into this op,
+so the bias and activation are applied in place on the convolution output
+instead of writing out two intermediate tensors. Only 'NHWC' is supported.
+
+input: 4-D with shape `[batch, in_height, in_width, in_channels]`.
+filter: 4-D with shape
+  `[filter_height, filter_width, in_channels, out_channels]`.
+bias: 1-D with size `out_channels`.
+strides: 1-D of length 4.  The stride of the sliding window for each dimension
+   of `input`.
+padding: The type of padding algorithm to use.
+activation: Activation applied after bias.
+ )doc");
+
+REGISTER_OP("FusedMatMulBias")
+    .Input("a: T")
+    .Input("b: T")
+    .Input("bias: T")
+    .Output("product: T")
+    .Attr("T: {float}")
+    .Attr("transpose_a: bool = false")
+    .Attr("transpose_b: bool = false")
+    .Attr("activation: {'None', 'Relu', 'Relu6'} = 'None'")
+    .SetShapeFn(shape_inference::MatMulShape)
+    .Doc(R"doc(
+Performs MatMul, BiasAdd and an optional Relu/Relu6 as one kernel.
+
+a: 2-D matrix.
+b: 2-D matrix.
+bias: 1-D with size of the last dimension of `product`.
+transpose_a: If true, "a" is transposed before multiplication.
+transpose_b: If true, "b" is transposed before multiplication.
+activation: Activation applied after bias.
+ )doc");
+
 // --------------------------------------------------------------------------
 
 REGISTER_OP("DepthwiseConv2dNative")
@@ -0,0 +1,203 @@
+#define GETTEXT_DOMAIN "aismart-lib"
+
+#include "benchmark_runner.hpp"
+#include "tensorflow_link.hpp"
+
+#include "benchmark.hpp"
+#include "filesystem.hpp"
+#include "util.hpp"
+#include "sdl_utils.hpp"
+#include "wml_exception.hpp"
+#include "tensorflow2.hpp"
+#include "mser2.hpp"
+#include "gui/dialogs/ocr.hpp"
+#include "easypr/core/plate_recognize.h"
+
+#include <SDL_image.h>
+#include <opencv2/imgproc.hpp>
+
+#include <iostream>
+
+#ifdef AISMART_BENCHMARK_ALLOCS
+// count every allocation of process, so tbenchmark can report allocations_per_run.
+void* operator new(size_t size)
+{
+	tbenchmark::count_allocation();
+	void* ptr = malloc(size? size: 1);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+#endif
+
+namespace {
+
+struct tbenchmark_args
+{
+	tbenchmark_args()
+		: rounds(1)
+	{}
+
+	std::string images_dir;
+	std::string models_dir;
+	std::string pb_path;
+	std::string json_path;
+	int rounds;
+};
+
+bool parse_args(int argc, char** argv, tbenchmark_args& args)
+{
+	for (int at = 1; at < argc; at ++) {
+		const std::string arg = argv[at];
+		const bool has_value = at + 1 < argc;
+		if (arg == "--benchmark" && has_value) {
+			args.images_dir = argv[++ at];
+		} else if (arg == "--models" && has_value) {
+			args.models_dir = argv[++ at];
+		} else if (arg == "--pb" && has_value) {
+			args.pb_path = argv[++ at];
+		} else if (arg == "--json" && has_value) {
+			args.json_path = argv[++ at];
+		} else if (arg == "--rounds" && has_value) {
+			args.rounds = atoi(argv[++ at]);
+		}
+	}
+	return !args.images_dir.empty() && args.rounds > 0;
+}
+
+surface load_neutral_surface(const std::string& path)
+{
+	surface src = IMG_Load(path.c_str());
+	if (!src.get()) {
+		return surface();
+	}
+	surface result = create_neutral_surface(src->w, src->h);
+	sdl_blit(src, nullptr, result, nullptr);
+	return result;
+}
+
+}
+
+bool is_benchmark_cmdline(int argc, char** argv)
+{
+	for (int at = 1; at < argc; at ++) {
+		if (!strcmp(argv[at], "--benchmark")) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int run_benchmark(int argc, char** argv)
+{
+	tbenchmark_args args;
+	if (!parse_args(argc, argv, args)) {
+		std::cerr << "usage: aismart --benchmark <images-dir> [--models <easypr-model-dir>] [--pb <char-model.pb>] [--json <out.json>] [--rounds <n>]" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> files;
+	get_files_in_dir(args.images_dir, &files, nullptr, ENTIRE_FILE_PATH);
+	std::sort(files.begin(), files.end());
+
+	tensorflow_link_modules();
+	if (!args.models_dir.empty()) {
+		set_easypr_model_paths(args.models_dir);
+	}
+	const bool run_pr = !args.models_dir.empty();
+	const bool run_char = !args.pb_path.empty();
+
+	tbenchmark benchmark;
+	std::unique_ptr<easypr::CPlateRecognize> pr;
+	if (run_pr) {
+		pr.reset(new easypr::CPlateRecognize);
+		pr->setLifemode(true);
+		pr->setDebug(false);
+		pr->setDetectType(easypr::PR_DETECT_CMSER);
+	}
+	tensorflow2::tsession char_session;
+	cv::Ptr<cv::MSER2> mser;
+	int mser_image_area = 0;
+	cv::MSERRegions blue, yellow;
+	cv::Mat bgr, gray;
+	int images = 0;
+
+	for (int round = 0; round < args.rounds; round ++) {
+		for (std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++ it) {
+			surface surf;
+			{
+				tbenchmark::tscope scope(benchmark, "load");
+				surf = load_neutral_surface(*it);
+			}
+			if (!surf.get()) {
+				continue;
+			}
+			images ++;
+
+			{
+				tsurface_2_mat_lock lock(surf);
+				cv::cvtColor(lock.mat, gray, cv::COLOR_BGRA2GRAY);
+				cv::cvtColor(lock.mat, bgr, cv::COLOR_BGRA2BGR);
+			}
+
+			{
+				// same parameters as mserCharMatch.
+				const int image_area = gray.rows * gray.cols;
+				if (mser.empty() || mser_image_area != image_area) {
+					mser = cv::MSER2::create(1, 30, int(0.05 * image_area));
+					mser_image_area = image_area;
+				}
+				tbenchmark::tscope scope(benchmark, "mser2");
+				mser->detectRegions(gray, blue, yellow);
+			}
+
+			if (run_pr) {
+				std::vector<easypr::CPlate> plates;
+				tbenchmark::tscope scope(benchmark, "plate_recognize");
+				pr->plateRecognize(bgr, plates);
+			}
+
+			std::vector<std::unique_ptr<tocr_line> > lines;
+			{
+				// detect_and_blend_surf blends into surface, use a copy.
+				surface ocr_surf = create_neutral_surface(surf->w, surf->h);
+				sdl_blit(surf, nullptr, ocr_surf, nullptr);
+				tbenchmark::tscope scope(benchmark, "ocr_detect");
+				gui2::tocr::detect_and_blend_surf(ocr_surf, false, lines);
+			}
+
+			if (run_char) {
+				// binarize chars like tocr_controller, then inference one by one.
+				for (std::vector<std::unique_ptr<tocr_line> >::const_iterator it2 = lines.begin(); it2 != lines.end(); ++ it2) {
+					const tocr_line& line = *it2->get();
+					for (std::set<trect>::const_iterator it3 = line.chars.begin(); it3 != line.chars.end(); ++ it3) {
+						cv::Mat char_mat;
+						cv::threshold(gray(cv::Rect(it3->x, it3->y, it3->w, it3->h)), char_mat, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
+						tbenchmark::tscope scope(benchmark, "inference_char");
+						tensorflow2::inference_char(char_session, args.pb_path, char_mat, nullptr);
+					}
+				}
+			}
+		}
+	}
+
+	std::map<std::string, std::string> meta;
+	meta["images_dir"] = args.images_dir;
+	meta["images"] = str_cast(images);
+	meta["rounds"] = str_cast(args.rounds);
+	const std::string json = benchmark.to_json(meta);
+
+	if (!args.json_path.empty()) {
+		tfile file(args.json_path, GENERIC_WRITE, CREATE_ALWAYS);
+		VALIDATE(file.valid(), null_str);
+		posix_fwrite(file.fp, json.c_str(), json.size());
+	}
+	std::cout << json << std::endl;
+	return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef BENCHMARK_RUNNER_HPP_INCLUDED
+#define BENCHMARK_RUNNER_HPP_INCLUDED
+
+#include <string>
+
+//
+// headless benchmark, doesn't create window.
+// aismart --benchmark <images-dir> [--models <easypr-model-dir>] [--pb <char-model.pb>] [--json <out.json>] [--rounds <n>]
+//
+bool is_benchmark_cmdline(int argc, char** argv);
+int run_benchmark(int argc, char** argv);
+
+// defined in main.cpp, shared by load_pb and benchmark.
+void set_easypr_model_paths(const std::string& model_dir);
+
+#endif
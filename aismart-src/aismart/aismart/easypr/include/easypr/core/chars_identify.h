@@ -18,6 +18,8 @@ public:
   void classify(cv::Mat featureRows, std::vector<int>& out_maxIndexs,
                 std::vector<float>& out_maxVals, std::vector<bool> isChineseVec);
   void classify(std::vector<CCharacter>& charVec);
+  // isAlphabetVec[i] is true: charVec[i] must be 'A'-'Z', for example the 2nd char of plate.
+  void classify(std::vector<CCharacter>& charVec, const std::vector<bool>& isAlphabetVec);
 
   void classifyChinese(std::vector<CCharacter>& charVec);
   void classifyChineseGray(std::vector<CCharacter>& charVec);
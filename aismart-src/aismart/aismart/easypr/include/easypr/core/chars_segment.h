@@ -77,6 +77,13 @@ class CCharsSegment {
   float m_WhitePercent;
 
   int m_debug;
+
+  // scratch buffers of charsSegmentUsingOSTU, reused between plates.
+  Mat m_inputGrey;
+  Mat m_imgThreshold;
+  Mat m_imgContours;
+  std::vector<std::vector<Point> > m_contours;
+  std::vector<Rect> m_vecRect;
 };
 
 }
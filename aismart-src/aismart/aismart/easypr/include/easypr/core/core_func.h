@@ -4,6 +4,7 @@
 #include "opencv2/opencv.hpp"
 #include "easypr/core/plate.hpp"
 #include "easypr/core/character.hpp"
+#include "mser2.hpp"
 
 using namespace cv;
 using namespace std;
@@ -13,6 +14,42 @@ Namespace where all the C++ EasyPR functionality resides
 */
 namespace easypr {
 
+//! scratch buffer helper. when data of buf still referenced by others(for example a CPlate got from
+//! last frame), detach it, so writting into buf never changes that data. else buf is reused as is.
+inline Mat& reuseMat(Mat& buf) {
+  if (buf.u && buf.u->refcount > 1) buf.release();
+  return buf;
+}
+
+//! buffers of mserCharMatch. one owner(thread) per instance, reused between frames.
+struct CMserScratch {
+  CMserScratch() : imageArea(0) {}
+
+  Ptr<MSER2> mser;
+  int imageArea;
+  std::vector<MSERRegions> regions;
+  std::vector<Mat> match;
+  std::vector<Mat> result;
+};
+
+//! result of one hsv analysis. src is converted to hsv and v is equalized once,
+//! then mask and coverage of every wanted color are got from the same planes.
+struct CColorMasks {
+  CColorMasks() { for (int i = 0; i <= UNKNOWN; i++) percents[i] = 0; }
+
+  Mat hsv;
+  std::vector<Mat> planes;  // h, s, equalized v
+  Mat minSV, validSV, thresh;  // scratch
+
+  //! indexed by Color. grey, 255 is match, 0 is not match
+  Mat masks[UNKNOWN + 1];
+  float percents[UNKNOWN + 1];
+};
+
+//! match all colors in one hsv conversion, it is used by color locate and plate color judge.
+void colorMatch(const Mat& src, CColorMasks& out, const bool adaptive_minsv,
+                const Color* colors, int count);
+
 //! find binary image match to color
 //! input rgb, want match color ( blue or yellow)
 //! out grey, 255 is match, 0 is not match
@@ -73,7 +110,8 @@ RotatedRect scaleBackRRect(const RotatedRect& rr, const float scale_ratio);
 
 //! use verify size to first generate char candidates
 void mserCharMatch(const Mat &src, std::vector<Mat> &match, std::vector<CPlate>& out_plateVec_blue, std::vector<CPlate>& out_plateVec_yellow,
-  bool usePlateMser, std::vector<RotatedRect>& out_plateRRect_blue, std::vector<RotatedRect>& out_plateRRect_yellow, int index = 0, bool showDebug = false);
+  bool usePlateMser, std::vector<RotatedRect>& out_plateRRect_blue, std::vector<RotatedRect>& out_plateRRect_yellow, int index = 0, bool showDebug = false,
+  CMserScratch* scratch = NULL);
 
 // computer the insert over union about two rrect
 bool computeIOU(const RotatedRect& rrect1, const RotatedRect& rrect2, const int width, const int height, const float thresh, float& result);
@@ -93,6 +131,11 @@ Mat adaptive_image_from_points(const std::vector<Point>& points,
   const Rect& rect, const Size& size, const Scalar& backgroundColor = Scalar(0, 0, 0),
   const Scalar& forgroundColor = Scalar(255, 255, 255), bool gray = true);
 
+// same as above, points is a region in MSERRegions.
+Mat adaptive_image_from_points(const Point* points, int count,
+  const Rect& rect, const Size& size, const Scalar& backgroundColor = Scalar(0, 0, 0),
+  const Scalar& forgroundColor = Scalar(255, 255, 255), bool gray = true);
+
 // Calculate a rect have same length and width and remains the center
 Rect adaptive_charrect_from_rect(const Rect& rect, int maxwidth, int maxheight, bool useExtendHeight = false);
 
@@ -104,6 +147,8 @@ bool calcSafeRect(const RotatedRect &roi_rect, const int width, const int height
 
 // uniform resize all the image to same size for the next process
 Mat uniformResize(const Mat &result, float& scale);
+// same as above, but resize into dst to reuse its buffer. dst is result when needn't scale.
+void uniformResize(const Mat &result, Mat& dst, float& scale);
 
 // uniform resize all the plates to same size for the next process
 Mat uniformResizePlates(const Mat &result, float& scale);
@@ -122,7 +167,7 @@ Rect rectFit(const Rect &src, const int mat_width, const int mat_height);
 void writeTempImage(const Mat& outImg, const string path, int index = 0);
 
 // remove small hor lines in the plate
-bool judegMDOratio2(const Mat &image, const Rect &rect, std::vector<Point> &contour, Mat &result, const float thresh = 1.f,
+bool judegMDOratio2(const Mat &image, const Rect &rect, Mat &result, const float thresh = 1.f,
                     bool useExtendHeight = false);
 
 // clear top and bottom borders
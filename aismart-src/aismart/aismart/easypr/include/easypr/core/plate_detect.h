@@ -111,6 +111,8 @@ class CPlateDetect {
 
   CPlateLocate* m_plateLocate;
 
+  CNMSScratch m_nmsScratch;
+
   int m_type;
 
   static std::string m_pathSvm;
@@ -6,13 +6,28 @@
 
 namespace easypr {
 
+//! buffers of plate nms. one owner(thread) per instance, reused between frames.
+//! grid is flat, every cell is a linked list of kept plates in entryKept/entryNext.
+struct CNMSScratch {
+  std::vector<Rect> rects;
+  std::vector<int> cellHead;  // first entry of cell, -1 if empty
+  std::vector<int> entryKept;
+  std::vector<int> entryNext;
+  std::vector<Rect> keptRects;
+  std::vector<int> visited;
+};
+
 class PlateJudge {
  public:
   static PlateJudge* instance();
   void LoadModel(std::string path);
 
-  int plateJudgeUsingNMS(const std::vector<CPlate>&, std::vector<CPlate>&, int maxPlates = 5);
+  int plateJudgeUsingNMS(const std::vector<CPlate>&, std::vector<CPlate>&, int maxPlates = 5,
+    CNMSScratch* scratch = NULL);
   int plateSetScore(CPlate& plate);
+  // same as plateSetScore, but extract features in parallel and predict all plates in one call.
+  // results[i] is 0 if plates[i] is plate, else -1.
+  void plateSetScores(std::vector<CPlate>& plates, std::vector<int>& results);
 
   int plateJudge(const Mat& plateMat);
   int plateJudge(const std::vector<Mat> &inVec,
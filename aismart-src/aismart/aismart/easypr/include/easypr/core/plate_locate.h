@@ -15,6 +15,7 @@
 #define EASYPR_CORE_PLATELOCATE_H_
 
 #include "easypr/core/plate.hpp"
+#include "easypr/core/core_func.h"
 
 /*! \namespace easypr
     Namespace where all the C++ EasyPR functionality resides
@@ -57,6 +58,9 @@ class CPlateLocate {
 
   int colorSearch(const Mat& src, const Color r, Mat& out,
                   std::vector<RotatedRect>& outRects);
+  //! match_grey is color mask got by colorMatch
+  int colorSearch(const Mat& match_grey, Mat& out,
+                  std::vector<RotatedRect>& outRects);
 
   int mserSearch(const Mat &src, vector<Mat>& out,
     vector<vector<CPlate>>& out_plateVec, bool usePlateMser, vector<vector<RotatedRect>>& out_plateRRect,
@@ -134,6 +138,15 @@ class CPlateLocate {
 
 
   bool m_debug;
+
+  // scratch buffers of plateMserLocate, they are reused between frames.
+  // so one CPlateLocate must not be used by two threads at the same time.
+  CMserScratch m_mserScratch;
+  Mat m_mserGray;
+  Mat m_mserResizeSrcB;
+
+  // hsv analysis of plateColorLocate, shared by blue and yellow search.
+  CColorMasks m_colorMasks;
 };
 
 } /*! \namespace easypr*/
@@ -20,6 +20,8 @@ Namespace where all the C++ EasyPR functionality resides
 */
 namespace easypr {
 
+  // one instance owns all intermediate buffers and reuses them between frames, so create it once
+  // and keep it. an instance must be used by one thread at a time, use N instances for N threads.
   class CPlateRecognize : public CPlateDetect, public CCharsRecognise {
   public:
     CPlateRecognize();
@@ -46,6 +48,9 @@ namespace easypr {
   private:
     // show the detect and recognition result image
     bool m_showResult;
+
+    // uniformResize result
+    Mat m_resized;
     DISABLE_ASSIGN_AND_COPY(CPlateRecognize);
   };
 
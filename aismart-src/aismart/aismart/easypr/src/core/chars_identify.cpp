@@ -61,6 +61,8 @@ void CharsIdentify::LoadChineseMapping(std::string path) {
 void CharsIdentify::classify(cv::Mat featureRows, std::vector<int>& out_maxIndexs,
                              std::vector<float>& out_maxVals, std::vector<bool> isChineseVec){
   int rowNum = featureRows.rows;
+  out_maxIndexs.resize(rowNum);
+  out_maxVals.resize(rowNum);
 
   cv::Mat output(rowNum, kCharsTotalNumber, CV_32FC1);
   ann_->predict(featureRows, output);
@@ -99,6 +101,10 @@ void CharsIdentify::classify(cv::Mat featureRows, std::vector<int>& out_maxIndex
 
 
 void CharsIdentify::classify(std::vector<CCharacter>& charVec){
+  classify(charVec, std::vector<bool>());
+}
+
+void CharsIdentify::classify(std::vector<CCharacter>& charVec, const std::vector<bool>& isAlphabetVec){
   size_t charVecSize = charVec.size();
 
   if (charVecSize == 0)
@@ -124,8 +130,10 @@ void CharsIdentify::classify(std::vector<CCharacter>& charVec){
 
     bool isChinses = character.getIsChinese();
     if (!isChinses) {
+      // begin with 11th char, which is 'A'
+      const bool isAlphabet = output_index < isAlphabetVec.size() && isAlphabetVec[output_index];
       result = 0;
-      for (int j = 0; j < kCharactersNumber; j++) {
+      for (int j = isAlphabet ? 10 : 0; j < kCharactersNumber; j++) {
         float val = output_row.at<float>(j);
         //std::cout << "j:" << j << "val:" << val << std::endl;
         if (val > maxVal) {
@@ -61,47 +61,53 @@ int CCharsRecognise::charsRecognise(CPlate& plate, std::string& plateLicense) {
 
   if (result == 0) {
     int num = matChars.size();
-    for (int j = 0; j < num; j++)
-    {
-      Mat charMat = matChars.at(j);
+    std::vector<CCharacter> charVec(num);
+    for (int j = 0; j < num; j++) {
       Mat grayChar = grayChars.at(j);
       if (color != Color::BLUE)
         grayChar = 255 - grayChar;
 
-      bool isChinses = false;
-      std::pair<std::string, std::string> character;
+      charVec[j].setCharacterMat(matChars.at(j));
+      charVec[j].setCharacterGrayMat(grayChar);
+      charVec[j].setIsChinese(false);
+    }
+
+    // 1st char is chinese, it uses gray classifer.
+    if (num > 0) {
+      CCharacter& chinese = charVec[0];
+      bool judge = true;
       float maxVal;
-      if (0 == j) {
-        isChinses = true;
-        bool judge = true;
-        character = CharsIdentify::instance()->identifyChineseGray(grayChar, maxVal, judge);
-        plateLicense.append(character.second);
+      std::pair<std::string, std::string> character = CharsIdentify::instance()->identifyChineseGray(chinese.getCharacterGrayMat(), maxVal, judge);
+      plateLicense.append(character.second);
+      chinese.setCharacterStr(character.first);
+
+      // set plate chinese mat and str
+      plate.setChineseMat(chinese.getCharacterGrayMat());
+      plate.setChineseKey(character.first);
+      if (0) writeTempImage(chinese.getCharacterGrayMat(), "char_data/" + character.first + "/chars_");
+    }
 
-        // set plate chinese mat and str
-        plate.setChineseMat(grayChar);
-        plate.setChineseKey(character.first);
-        if (0) writeTempImage(grayChar, "char_data/" + character.first + "/chars_");
-      }
-      else if (1 == j) {
-        isChinses = false;
-        bool isAbc = true;
-        character = CharsIdentify::instance()->identify(charMat, isChinses, isAbc);
-        plateLicense.append(character.second);
-      }
-      else {
-        isChinses = false;
-        SHOW_IMAGE(charMat, 0);
-        character = CharsIdentify::instance()->identify(charMat, isChinses);
-        plateLicense.append(character.second);
+    // others are alphanumerics, classify them in one batch. 2nd char must be alphabet.
+    if (num > 1) {
+      std::vector<CCharacter> alnumVec(charVec.begin() + 1, charVec.end());
+      std::vector<bool> isAlphabetVec(alnumVec.size(), false);
+      isAlphabetVec[0] = true;
+      CharsIdentify::instance()->classify(alnumVec, isAlphabetVec);
+
+      for (int j = 1; j < num; j++) {
+        const CCharacter& alnum = alnumVec[j - 1];
+        const std::string label = alnum.getCharacterStr();
+        SHOW_IMAGE(alnum.getCharacterMat(), 0);
+        plateLicense.append(label);
+        charVec[j].setCharacterStr(label);
       }
+    }
 
+    for (int j = 0; j < num; j++) {
       CCharacter charResult;
-      charResult.setCharacterMat(charMat);
-      charResult.setCharacterGrayMat(grayChar);
-      if (isChinses)
-        charResult.setCharacterStr(character.first);
-      else
-        charResult.setCharacterStr(character.second);
+      charResult.setCharacterMat(charVec[j].getCharacterMat());
+      charResult.setCharacterGrayMat(charVec[j].getCharacterGrayMat());
+      charResult.setCharacterStr(charVec[j].getCharacterStr());
 
       plate.addReutCharacter(charResult);
     }
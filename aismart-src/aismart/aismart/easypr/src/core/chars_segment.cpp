@@ -596,10 +596,7 @@ int CCharsSegment::charsSegmentUsingMSER(Mat input, vector<Mat>& resultVec, vect
   int csize = channelImages.size();
 
   //TODO three channels
-  std::vector<std::vector<Point>> all_contours;
-  std::vector<Rect> all_boxes;
-  all_contours.reserve(32);
-  all_boxes.reserve(32);
+  MSERRegions all_regions;
 
   const int imageArea = input.rows * input.cols;
   const int delta = 1;
@@ -663,11 +660,11 @@ int CCharsSegment::charsSegmentUsingMSER(Mat input, vector<Mat>& resultVec, vect
     Ptr<MSER2> mser;
     // use origin mser to detect as many as possible characters
     mser = MSER2::create(delta, minArea, int(maxAreaRatio * imageArea), false);
-    mser->detectRegions(cimage, all_contours, all_boxes, type);
+    mser->detectRegions(cimage, all_regions, type);
 
     std::vector<CCharacter> charVec;
     charVec.reserve(16);
-    size_t size = all_contours.size();
+    size_t size = all_regions.size();
 
     int char_index = 0;
     int char_size = 20;
@@ -676,13 +673,12 @@ int CCharsSegment::charsSegmentUsingMSER(Mat input, vector<Mat>& resultVec, vect
     cvtColor(showMSERImage, showMSERImage, CV_GRAY2BGR);
     // verify char size and output to rects;
     for (size_t index = 0; index < size; index++) {
-      Rect rect = all_boxes[index];
-      vector<Point> &contour = all_contours[index];
+      Rect rect = all_regions.bboxes[index];
       rectangle(showMSERImage, rect, Scalar(0,0,255));
 
       // find character
       if (verifyCharRectSizes(rect)) {
-        Mat mserMat = adaptive_image_from_points(contour, rect, Size(char_size, char_size));
+        Mat mserMat = adaptive_image_from_points(all_regions.region(index), all_regions.regionSize(index), rect, Size(char_size, char_size));
         Mat mserInput = preprocessCharMat(mserMat, char_size);
 
         Rect charRect = rect;
@@ -700,7 +696,7 @@ int CCharsSegment::charsSegmentUsingMSER(Mat input, vector<Mat>& resultVec, vect
         Mat ostuInput = preprocessChar(ostuMat);
         // use judegMDOratio2 function to
         // remove the small lines in character like "zh-cuan"
-        if (judegMDOratio2(cimage, rect, contour, mdoImage, 1.2f, true)) {
+        if (judegMDOratio2(cimage, rect, mdoImage, 1.2f, true)) {
           CCharacter charCandidate;
           //cout << contour.size() << endl;
           charCandidate.setCharacterPos(charRect);
@@ -857,27 +853,30 @@ int CCharsSegment::charsSegmentUsingOSTU(Mat input, vector<Mat>& resultVec, vect
   if (!input.data) return 0x01;
 
   Color plateType = color;
-  Mat input_grey;
-  cvtColor(input, input_grey, CV_BGR2GRAY);
+  // grayChars refer to input_grey, reuseMat detachs it if last result is still alive.
+  Mat& input_grey = m_inputGrey;
+  cvtColor(input, reuseMat(input_grey), CV_BGR2GRAY);
 
-  Mat img_threshold;
-  img_threshold = input_grey.clone();
+  Mat& img_threshold = m_imgThreshold;
+  input_grey.copyTo(reuseMat(img_threshold));
   spatial_ostu(img_threshold, 8, 2, plateType);
 
   // remove liuding and hor lines, also judge weather is plate use jump count
   if (!clearLiuDing(img_threshold)) return 0x02;
 
-  Mat img_contours;
-  img_threshold.copyTo(img_contours);
+  Mat& img_contours = m_imgContours;
+  img_threshold.copyTo(reuseMat(img_contours));
 
-  vector<vector<Point> > contours;
+  vector<vector<Point> >& contours = m_contours;
+  contours.clear();
   findContours(img_contours,
                contours,               // a vector of contours
                CV_RETR_EXTERNAL,       // retrieve the external contours
                CV_CHAIN_APPROX_NONE);  // all pixels of each contours
 
   vector<vector<Point> >::iterator itc = contours.begin();
-  vector<Rect> vecRect;
+  vector<Rect>& vecRect = m_vecRect;
+  vecRect.clear();
   while (itc != contours.end()) {
     Rect mr = boundingRect(Mat(*itc));
     Mat auxRoi(img_threshold, mr);
@@ -7,12 +7,12 @@
 #include <ctime>
 
 namespace easypr {
-  Mat colorMatch(const Mat &src, Mat &match, const Color r,
-    const bool adaptive_minsv) {
+  //! lookup table of H --> min value of s and v, a pixel matches r when
+  //! min(S, V) >= table[H] and max(S, V) < 255. 255 means H never matches.
+  static Mat colorThreshLut(const Color r, const bool adaptive_minsv) {
 
     // if use adaptive_minsv
     // min value of s and v is adaptive to h
-    const float max_sv = 255;
     const float minref_sv = 64;
 
     const float minabs_sv = 95; //95;
@@ -32,18 +32,6 @@ namespace easypr {
     const int min_white = 0;   // 15
     const int max_white = 30;  // 40
 
-    Mat src_hsv;
-
-    // convert to HSV space
-    cvtColor(src, src_hsv, CV_BGR2HSV);
-
-    std::vector<cv::Mat> hsvSplit;
-    split(src_hsv, hsvSplit);
-    equalizeHist(hsvSplit[2], hsvSplit[2]);
-    merge(hsvSplit, src_hsv);
-
-    // match to find the color
-
     int min_h = 0;
     int max_h = 0;
     switch (r) {
@@ -67,83 +55,75 @@ namespace easypr {
     float diff_h = float((max_h - min_h) / 2);
     float avg_h = min_h + diff_h;
 
-    int channels = src_hsv.channels();
-    int nRows = src_hsv.rows;
-
-    // consider multi channel image
-    int nCols = src_hsv.cols * channels;
-    if (src_hsv.isContinuous()) {
-      nCols *= nRows;
-      nRows = 1;
-    }
-
-    int i, j;
-    uchar* p;
-    float s_all = 0;
-    float v_all = 0;
-    float count = 0;
-    for (i = 0; i < nRows; ++i) {
-      p = src_hsv.ptr<uchar>(i);
-      for (j = 0; j < nCols; j += 3) {
-        int H = int(p[j]);      // 0-180
-        int S = int(p[j + 1]);  // 0-255
-        int V = int(p[j + 2]);  // 0-255
-
-        s_all += S;
-        v_all += V;
-        count++;
-
-        bool colorMatched = false;
-
-        if (H > min_h && H < max_h) {
-          float Hdiff = 0;
-          if (H > avg_h)
-            Hdiff = H - avg_h;
-          else
-            Hdiff = avg_h - H;
-
-          float Hdiff_p = float(Hdiff) / diff_h;
-
-          float min_sv = 0;
-          if (true == adaptive_minsv)
-            min_sv =
-            minref_sv -
-            minref_sv / 2 *
-            (1
-            - Hdiff_p);  // inref_sv - minref_sv / 2 * (1 - Hdiff_p)
-          else
-            min_sv = minabs_sv;  // add
-
-          if ((S > min_sv && S < max_sv) && (V > min_sv && V < max_sv))
-            colorMatched = true;
-        }
+    Mat lut(1, 256, CV_8UC1, Scalar(255));
+    uchar* p = lut.ptr<uchar>(0);
+    for (int H = min_h + 1; H < max_h; H++) {
+      float Hdiff = 0;
+      if (H > avg_h)
+        Hdiff = H - avg_h;
+      else
+        Hdiff = avg_h - H;
 
-        if (colorMatched == true) {
-          p[j] = 0;
-          p[j + 1] = 0;
-          p[j + 2] = 255;
-        }
-        else {
-          p[j] = 0;
-          p[j + 1] = 0;
-          p[j + 2] = 0;
+      float Hdiff_p = float(Hdiff) / diff_h;
+
+      float min_sv = 0;
+      if (true == adaptive_minsv)
+        min_sv = minref_sv - minref_sv / 2 * (1 - Hdiff_p);
+      else
+        min_sv = minabs_sv;
+
+      // S, V are integer, so S > min_sv equals to S >= floor(min_sv) + 1
+      p[H] = saturate_cast<uchar>(cvFloor(min_sv) + 1);
+    }
+    return lut;
+  }
+
+  static const Mat& colorThreshLutCached(const Color r, const bool adaptive_minsv) {
+    struct tluts {
+      tluts() {
+        for (int c = 0; c <= UNKNOWN; c++) {
+          luts[0][c] = colorThreshLut(Color(c), false);
+          luts[1][c] = colorThreshLut(Color(c), true);
         }
       }
-    }
+      Mat luts[2][UNKNOWN + 1];
+    };
+    static const tluts cached;
+    return cached.luts[adaptive_minsv ? 1 : 0][r];
+  }
 
-    // cout << "avg_s:" << s_all / count << endl;
-    // cout << "avg_v:" << v_all / count << endl;
+  void colorMatch(const Mat &src, CColorMasks &out, const bool adaptive_minsv,
+                  const Color *colors, int count) {
+    // convert to HSV space, equalize v once for all colors
+    cvtColor(src, reuseMat(out.hsv), CV_BGR2HSV);
+    split(out.hsv, out.planes);
+    equalizeHist(out.planes[2], out.planes[2]);
+
+    // per pixel part of every color: min(S, V) >= lut[H] and max(S, V) < 255
+    cv::min(out.planes[1], out.planes[2], out.minSV);
+    cv::max(out.planes[1], out.planes[2], out.validSV);
+    compare(out.validSV, Scalar(255), out.validSV, CMP_LT);
+
+    const float area = float(src.rows * src.cols);
+    for (int i = 0; i < count; i++) {
+      const Color r = colors[i];
+      Mat& mask = reuseMat(out.masks[r]);
+      LUT(out.planes[0], colorThreshLutCached(r, adaptive_minsv), out.thresh);
+      compare(out.minSV, out.thresh, mask, CMP_GE);
+      bitwise_and(mask, out.validSV, mask);
+      out.percents[r] = area > 0 ? float(countNonZero(mask)) / area : 0;
+    }
+  }
 
-    // get the final binary
+  Mat colorMatch(const Mat &src, Mat &match, const Color r,
+    const bool adaptive_minsv) {
 
-    Mat src_grey;
-    std::vector<cv::Mat> hsvSplit_done;
-    split(src_hsv, hsvSplit_done);
-    src_grey = hsvSplit_done[2];
+    CColorMasks masks;
+    colorMatch(src, masks, adaptive_minsv, &r, 1);
 
-    match = src_grey;
+    match = masks.masks[r];
 
-    return src_grey;
+    return match;
   }
 
   bool bFindLeftRightBound1(Mat &bound_threshold, int &posLeft, int &posRight) {
@@ -283,53 +263,37 @@ namespace easypr {
   }
 
 
+  static const float kPlateColorThresh = 0.45f;
+
   bool plateColorJudge(const Mat &src, const Color r, const bool adaptive_minsv,
                        float &percent) {
 
-    const float thresh = 0.45f;
-
-    Mat src_gray;
-    colorMatch(src, src_gray, r, adaptive_minsv);
+    CColorMasks masks;
+    colorMatch(src, masks, adaptive_minsv, &r, 1);
 
-    percent =
-        float(countNonZero(src_gray)) / float(src_gray.rows * src_gray.cols);
+    percent = masks.percents[r];
     // cout << "percent:" << percent << endl;
 
-    if (percent > thresh)
+    if (percent > kPlateColorThresh)
       return true;
     else
       return false;
   }
 
   Color getPlateType(const Mat &src, const bool adaptive_minsv) {
-    float max_percent = 0;
-    Color max_color = UNKNOWN;
-
-    float blue_percent = 0;
-    float yellow_percent = 0;
-    float white_percent = 0;
-
-    if (plateColorJudge(src, BLUE, adaptive_minsv, blue_percent) == true) {
-      // cout << "BLUE" << endl;
-      return BLUE;
-    } else if (plateColorJudge(src, YELLOW, adaptive_minsv, yellow_percent) ==
-               true) {
-      // cout << "YELLOW" << endl;
-      return YELLOW;
-    } else if (plateColorJudge(src, WHITE, adaptive_minsv, white_percent) ==
-               true) {
-      // cout << "WHITE" << endl;
-      return WHITE;
-    } else {
-      //std::cout << "OTHER" << std::endl;
+    // one hsv conversion for all of blue, yellow and white.
+    const Color colors[] = {BLUE, YELLOW, WHITE};
+    CColorMasks masks;
+    colorMatch(src, masks, adaptive_minsv, colors, 3);
 
-      /*max_percent = blue_percent > yellow_percent ? blue_percent : yellow_percent;
-      max_color = blue_percent > yellow_percent ? BLUE : YELLOW;
-      max_color = max_percent > white_percent ? max_color : WHITE;*/
-
-      // always return blue
-      return BLUE;
+    for (int i = 0; i < 3; i++) {
+      if (masks.percents[colors[i]] > kPlateColorThresh) {
+        return colors[i];
+      }
     }
+
+    // always return blue
+    return BLUE;
   }
 
   void clearLiuDingOnly(Mat &img) {
@@ -1256,7 +1220,7 @@ void clearBorder(const Mat &img, Rect& cropRect) {
   }
 
 
-  bool judegMDOratio2(const Mat &image, const Rect &rect, std::vector<Point> &contour, Mat &result, const float thresh,
+  bool judegMDOratio2(const Mat &image, const Rect &rect, Mat &result, const float thresh,
     bool useExtendHeight) {
 
     Mat mser = image(rect);
@@ -1603,17 +1567,14 @@ void clearBorder(const Mat &img, Rect& cropRect) {
                      std::vector<CPlate> &out_plateVec_yellow,
                      bool usePlateMser, std::vector<RotatedRect> &out_plateRRect_blue,
                      std::vector<RotatedRect> &out_plateRRect_yellow, int img_index,
-                     bool showDebug) {
+                     bool showDebug, CMserScratch *scratch) {
     Mat image = src;
 
-    std::vector<std::vector<std::vector<Point>>> all_contours;
-    std::vector<std::vector<Rect>> all_boxes;
-    all_contours.resize(2);
-    all_contours.at(0).reserve(1024);
-    all_contours.at(1).reserve(1024);
-    all_boxes.resize(2);
-    all_boxes.at(0).reserve(1024);
-    all_boxes.at(1).reserve(1024);
+    CMserScratch local_scratch;
+    if (!scratch) scratch = &local_scratch;
+    std::vector<MSERRegions> &all_regions = scratch->regions;
+    all_regions.resize(2);
+    scratch->result.resize(2);
 
     match.resize(2);
 
@@ -1627,9 +1588,12 @@ void clearBorder(const Mat &img, Rect& cropRect) {
     const int minArea = 30;
     const double maxAreaRatio = 0.05;
 
-    Ptr<MSER2> mser;
-    mser = MSER2::create(delta, minArea, int(maxAreaRatio * imageArea));
-    mser->detectRegions(image, all_contours.at(0), all_boxes.at(0), all_contours.at(1), all_boxes.at(1));
+    // MSER2 keeps its pass buffers, reuse it while image size is same.
+    if (scratch->mser.empty() || scratch->imageArea != imageArea) {
+      scratch->mser = MSER2::create(delta, minArea, int(maxAreaRatio * imageArea));
+      scratch->imageArea = imageArea;
+    }
+    scratch->mser->detectRegions(image, all_regions.at(0), all_regions.at(1));
 
     // mser detect
     // color_index = 0 : mser-, detect white characters, which is in blue plate.
@@ -1642,12 +1606,14 @@ void clearBorder(const Mat &img, Rect& cropRect) {
       std::vector<CCharacter> charVec;
       charVec.reserve(128);
 
-      match.at(color_index) = Mat::zeros(image.rows, image.cols, image.type());
+      reuseMat(match.at(color_index)).create(image.rows, image.cols, image.type());
+      match.at(color_index).setTo(Scalar::all(0));
 
-      Mat result = image.clone();
-      cvtColor(result, result, COLOR_GRAY2BGR);
+      Mat &result = scratch->result[color_index];
+      cvtColor(image, reuseMat(result), COLOR_GRAY2BGR);
 
-      size_t size = all_contours.at(color_index).size();
+      const MSERRegions& regions = all_regions.at(color_index);
+      size_t size = regions.size();
 
       int char_index = 0;
       int char_size = 20;
@@ -1657,13 +1623,12 @@ void clearBorder(const Mat &img, Rect& cropRect) {
 
       // verify char size and output to rects;
       for (size_t index = 0; index < size; index++) {
-        Rect rect = all_boxes.at(color_index)[index];
-        std::vector<Point> &contour = all_contours.at(color_index)[index];
+        Rect rect = regions.bboxes[index];
 
         // sometimes a plate could be a mser rect, so we could
         // also use mser algorithm to find plate
         if (usePlateMser) {
-          RotatedRect rrect = minAreaRect(Mat(contour));
+          RotatedRect rrect = minAreaRect(regions.regionMat(index));
           if (verifyRotatedPlateSizes(rrect)) {
             //rotatedRectangle(result, rrect, Scalar(255, 0, 0), 2);
             if (the_color == BLUE) out_plateRRect_blue.push_back(rrect);
@@ -1673,7 +1638,7 @@ void clearBorder(const Mat &img, Rect& cropRect) {
 
         // find character
         if (verifyCharSizes(rect)) {
-          Mat mserMat = adaptive_image_from_points(contour, rect, Size(char_size, char_size));
+          Mat mserMat = adaptive_image_from_points(regions.region(index), regions.regionSize(index), rect, Size(char_size, char_size));
           Mat charInput = preprocessChar(mserMat, char_size);
           Rect charRect = rect;
 
@@ -1685,7 +1650,7 @@ void clearBorder(const Mat &img, Rect& cropRect) {
 
           // use judegMDOratio2 function to
           // remove the small lines in character like "zh-cuan"
-          if (judegMDOratio2(image, rect, contour, result)) {
+          if (judegMDOratio2(image, rect, result)) {
             CCharacter charCandidate;
             charCandidate.setCharacterPos(charRect);
             charCandidate.setCharacterMat(charInput);
@@ -2201,6 +2166,14 @@ void clearBorder(const Mat &img, Rect& cropRect) {
                                  const Rect &rect, const Size &size,
                                  const Scalar &backgroundColor /* = ml_color_white */,
                                  const Scalar &forgroundColor /* = ml_color_black */, bool gray /* = true */) {
+    return adaptive_image_from_points(points.empty() ? NULL : &points[0], (int) points.size(), rect, size,
+                                      backgroundColor, forgroundColor, gray);
+  }
+
+  Mat adaptive_image_from_points(const Point *points, int count,
+                                 const Rect &rect, const Size &size,
+                                 const Scalar &backgroundColor /* = ml_color_white */,
+                                 const Scalar &forgroundColor /* = ml_color_black */, bool gray /* = true */) {
     int expendHeight = 0;
     int expendWidth = 0;
 
@@ -2212,8 +2185,8 @@ void clearBorder(const Mat &img, Rect& cropRect) {
 
     Mat image(rect.height + expendHeight * 2, rect.width + expendWidth * 2, gray ? CV_8UC1 : CV_8UC3, backgroundColor);
 
-    for (int i = 0; i < (int) points.size(); ++i) {
-      Point point = points[i];
+    for (int i = 0; i < count; ++i) {
+      const Point &point = points[i];
       Point currentPt(point.x - rect.tl().x + expendWidth, point.y - rect.tl().y + expendHeight);
       if (mat_valid_position(image, currentPt.y, currentPt.x)) {
         setPoint(image, currentPt.y, currentPt.x, forgroundColor);
@@ -2283,35 +2256,34 @@ void clearBorder(const Mat &img, Rect& cropRect) {
 
 
   Mat uniformResize(const Mat &result, float &scale) {
+    Mat result_resize;
+    uniformResize(result, result_resize, scale);
+    return result_resize;
+  }
+
+  void uniformResize(const Mat &result, Mat &dst, float &scale) {
     const int RESULTWIDTH = kShowWindowWidth;   // 640 930
     const int RESULTHEIGHT = kShowWindowHeight;  // 540 710
 
-    Mat img_window;
-    img_window.create(RESULTHEIGHT, RESULTWIDTH, CV_8UC3);
-
     int nRows = result.rows;
     int nCols = result.cols;
 
-    Mat result_resize;
-    if (nCols <= img_window.cols && nRows <= img_window.rows) {
-      result_resize = result;
-    } else if (nCols > img_window.cols && nRows <= img_window.rows) {
-      scale = float(img_window.cols) / float(nCols);
-      resize(result, result_resize, Size(), scale, scale, CV_INTER_AREA);
+    if (nCols <= RESULTWIDTH && nRows <= RESULTHEIGHT) {
+      dst = result;
+      return;
+    }
+    if (nCols > RESULTWIDTH && nRows <= RESULTHEIGHT) {
+      scale = float(RESULTWIDTH) / float(nCols);
 
-    } else if (nCols <= img_window.cols && nRows > img_window.rows) {
-      scale = float(img_window.rows) / float(nRows);
-      resize(result, result_resize, Size(), scale, scale, CV_INTER_AREA);
+    } else if (nCols <= RESULTWIDTH && nRows > RESULTHEIGHT) {
+      scale = float(RESULTHEIGHT) / float(nRows);
 
-    } else if (nCols > img_window.cols && nRows > img_window.rows) {
-      float scale1 = float(img_window.cols) / float(nCols);
-      float scale2 = float(img_window.rows) / float(nRows);
-      scale = scale1 < scale2 ? scale1 : scale2;
-      resize(result, result_resize, Size(), scale, scale, CV_INTER_AREA);
     } else {
-      result_resize = result;
+      float scale1 = float(RESULTWIDTH) / float(nCols);
+      float scale2 = float(RESULTHEIGHT) / float(nRows);
+      scale = scale1 < scale2 ? scale1 : scale2;
     }
-    return result_resize;
+    resize(result, reuseMat(dst), Size(), scale, scale, CV_INTER_AREA);
   }
 
   Mat uniformResizePlates (const Mat &result, float &scale) {
@@ -58,7 +58,7 @@ namespace easypr {
       all_result_Plates.push_back(plate);
     }
     // use nms to judge plate
-    PlateJudge::instance()->plateJudgeUsingNMS(all_result_Plates, resultVec, m_maxPlates);
+    PlateJudge::instance()->plateJudgeUsingNMS(all_result_Plates, resultVec, m_maxPlates, &m_nmsScratch);
 
     if (0)
       showDectectResults(src, resultVec, m_maxPlates);
@@ -2,6 +2,7 @@
 #include "easypr/config.h"
 #include "easypr/core/core_func.h"
 #include "easypr/core/params.h"
+#include <climits>
 
 namespace easypr {
 
@@ -48,6 +49,30 @@ namespace easypr {
     else return -1;      
   }
 
+  void PlateJudge::plateSetScores(std::vector<CPlate>& plates, std::vector<int>& results) {
+    const int num = plates.size();
+    results.assign(num, -1);
+    if (!num) return;
+
+    std::vector<Mat> features(num);
+#pragma omp parallel for
+    for (int j = 0; j < num; j++) {
+      extractFeature(plates[j].getPlateMat(), features[j]);
+    }
+
+    // every feature is one row, stack them and predict once.
+    Mat samples;
+    vconcat(features, samples);
+    Mat scores;
+    svm_->predict(samples, scores, cv::ml::StatModel::Flags::RAW_OUTPUT);
+
+    for (int j = 0; j < num; j++) {
+      float score = scores.at<float>(j);
+      plates[j].setPlateScore(score);
+      results[j] = score < 0.5 ? 0 : -1;
+    }
+  }
+
   int PlateJudge::plateJudge(const Mat& plateMat) {
     CPlate plate;
     plate.setPlateMat(plateMat);
@@ -94,60 +119,109 @@ namespace easypr {
   }
 
   // non-maximum suppression
-  void NMS(std::vector<CPlate> &inVec, std::vector<CPlate> &resultVec, double overlap) {
+  // overlap(iou) > 0 requires two rects intersect, so a candidate is only compared with kept plates
+  // that share a grid cell with it, instead of all of them.
+  void NMS(std::vector<CPlate> &inVec, std::vector<CPlate> &resultVec, double overlap, CNMSScratch& scratch) {
     std::sort(inVec.begin(), inVec.end());
-    std::vector<CPlate>::iterator it = inVec.begin();
-    for (; it != inVec.end(); ++it) {
-      CPlate plateSrc = *it;
-      //std::cout << "plateScore:" << plateSrc.getPlateScore() << std::endl;
-      Rect rectSrc = plateSrc.getPlatePos().boundingRect();
-      std::vector<CPlate>::iterator itc = it + 1;
-      for (; itc != inVec.end();) {
-        CPlate plateComp = *itc;
-        Rect rectComp = plateComp.getPlatePos().boundingRect();
-        float iou = computeIOU(rectSrc, rectComp);
-        if (iou > overlap) {
-          itc = inVec.erase(itc);
+    resultVec.clear();
+    const int num = inVec.size();
+    if (!num) return;
+
+    // grid covers bounding box of all candidates.
+    const int cell_size = 64;
+    std::vector<Rect>& rects = scratch.rects;
+    rects.resize(num);
+    int minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+    for (int i = 0; i < num; i++) {
+      const Rect& rect = rects[i] = inVec[i].getPlatePos().boundingRect();
+      minx = std::min(minx, rect.x);
+      miny = std::min(miny, rect.y);
+      maxx = std::max(maxx, rect.x + std::max(rect.width, 1) - 1);
+      maxy = std::max(maxy, rect.y + std::max(rect.height, 1) - 1);
+    }
+    const int cols = (maxx - minx) / cell_size + 1;
+    const int rows = (maxy - miny) / cell_size + 1;
+    scratch.cellHead.assign(cols * rows, -1);
+    scratch.entryKept.clear();
+    scratch.entryNext.clear();
+    scratch.keptRects.clear();
+    scratch.visited.clear();
+
+    for (int i = 0; i < num; i++) {
+      const Rect& rectSrc = rects[i];
+      const int x0 = (rectSrc.x - minx) / cell_size, x1 = (rectSrc.x + std::max(rectSrc.width, 1) - 1 - minx) / cell_size;
+      const int y0 = (rectSrc.y - miny) / cell_size, y1 = (rectSrc.y + std::max(rectSrc.height, 1) - 1 - miny) / cell_size;
+
+      // visited[kept] == i + 1 if kept is compared with this candidate.
+      bool suppressed = false;
+      for (int y = y0; y <= y1 && !suppressed; y++) {
+        for (int x = x0; x <= x1 && !suppressed; x++) {
+          for (int entry = scratch.cellHead[y * cols + x]; entry != -1; entry = scratch.entryNext[entry]) {
+            const int kept = scratch.entryKept[entry];
+            if (scratch.visited[kept] == i + 1) continue;
+            scratch.visited[kept] = i + 1;
+            if (computeIOU(scratch.keptRects[kept], rectSrc) > overlap) {
+              suppressed = true;
+              break;
+            }
+          }
         }
-        else {
-          ++itc;
+      }
+      if (suppressed) continue;
+
+      const int at = scratch.keptRects.size();
+      scratch.keptRects.push_back(rectSrc);
+      scratch.visited.push_back(0);
+      resultVec.push_back(inVec[i]);
+      for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+          int& head = scratch.cellHead[y * cols + x];
+          scratch.entryKept.push_back(at);
+          scratch.entryNext.push_back(head);
+          head = scratch.entryKept.size() - 1;
         }
       }
     }
-    resultVec = inVec;
   }
 
   // judge plate using nms
-  int PlateJudge::plateJudgeUsingNMS(const std::vector<CPlate> &inVec, std::vector<CPlate> &resultVec, int maxPlates) {
+  int PlateJudge::plateJudgeUsingNMS(const std::vector<CPlate> &inVec, std::vector<CPlate> &resultVec, int maxPlates,
+    CNMSScratch* scratch) {
     std::vector<CPlate> plateVec;
-    int num = inVec.size();
     bool useCascadeJudge = true;
 
+    std::vector<CPlate> candidates(inVec);
+    std::vector<int> results;
+    plateSetScores(candidates, results);
+
+    // mser plates judge again with the center part.
+    std::vector<CPlate> cascades;
+    int num = candidates.size();
     for (int j = 0; j < num; j++) {
-      CPlate plate = inVec[j];
-      Mat inMat = plate.getPlateMat();
-      int result = plateSetScore(plate);
-      if (0 == result) {
-        if (plate.getPlateLocateType() == CMSER) {
-          int w = inMat.cols;
-          int h = inMat.rows;
-          Mat tmpmat = inMat(Rect_<double>(w * 0.05, h * 0.1, w * 0.9, h * 0.8));
-          Mat tmpDes = inMat.clone();
-          resize(tmpmat, tmpDes, Size(inMat.size()));
-          plate.setPlateMat(tmpDes);
-          if (useCascadeJudge) {
-            int resultCascade = plateSetScore(plate);
-            if (plate.getPlateLocateType() != CMSER)
-              plate.setPlateMat(inMat);
-            if (resultCascade == 0) {
-              plateVec.push_back(plate);
-            }
-          }
-          else 
-            plateVec.push_back(plate);
-        }
-        else 
-          plateVec.push_back(plate);                  
+      if (0 != results[j]) continue;
+      CPlate& plate = candidates[j];
+      if (plate.getPlateLocateType() == CMSER) {
+        Mat inMat = plate.getPlateMat();
+        int w = inMat.cols;
+        int h = inMat.rows;
+        Mat tmpmat = inMat(Rect_<double>(w * 0.05, h * 0.1, w * 0.9, h * 0.8));
+        Mat tmpDes;
+        resize(tmpmat, tmpDes, Size(inMat.size()));
+        plate.setPlateMat(tmpDes);
+        if (useCascadeJudge)
+          cascades.push_back(plate);
+        else
+          plateVec.push_back(plate);
+      }
+      else
+        plateVec.push_back(plate);
+    }
+
+    plateSetScores(cascades, results);
+    num = cascades.size();
+    for (int j = 0; j < num; j++) {
+      if (results[j] == 0) {
+        plateVec.push_back(cascades[j]);
       }
     }
 
@@ -155,10 +229,10 @@ namespace easypr {
     double overlap = 0.5;
     // double overlap = CParams::instance()->getParam1f();
     // use NMS to get the result plates
-    NMS(plateVec, reDupPlateVec, overlap);
-    // sort the plates due to their scores
-    std::sort(reDupPlateVec.begin(), reDupPlateVec.end());
-    // output the plate judge plates
+    CNMSScratch local_scratch;
+    if (!scratch) scratch = &local_scratch;
+    NMS(plateVec, reDupPlateVec, overlap, *scratch);
+    // NMS outputs plates in score order, output the plate judge plates
     std::vector<CPlate>::iterator it = reDupPlateVec.begin();
     int count = 0;
     for (; it != reDupPlateVec.end(); ++it) {
@@ -80,7 +80,7 @@ bool CPlateLocate::verifySizes(RotatedRect mr) {
 int CPlateLocate::mserSearch(const Mat &src,  vector<Mat> &out,
   vector<vector<CPlate>>& out_plateVec, bool usePlateMser, vector<vector<RotatedRect>>& out_plateRRect,
   int img_index, bool showDebug) {
-  vector<Mat> match_grey;
+  vector<Mat>& match_grey = m_mserScratch.match;
 
   vector<CPlate> plateVec_blue;
   plateVec_blue.reserve(16);
@@ -93,7 +93,7 @@ int CPlateLocate::mserSearch(const Mat &src,  vector<Mat> &out,
   vector<RotatedRect> plateRRect_yellow;
   plateRRect_yellow.reserve(16);
 
-  mserCharMatch(src, match_grey, plateVec_blue, plateVec_yellow, usePlateMser, plateRRect_blue, plateRRect_yellow, img_index, showDebug);
+  mserCharMatch(src, match_grey, plateVec_blue, plateVec_yellow, usePlateMser, plateRRect_blue, plateRRect_yellow, img_index, showDebug, &m_mserScratch);
 
   out_plateVec.push_back(plateVec_blue);
   out_plateVec.push_back(plateVec_yellow);
@@ -110,12 +110,17 @@ int CPlateLocate::mserSearch(const Mat &src,  vector<Mat> &out,
 int CPlateLocate::colorSearch(const Mat &src, const Color r, Mat &out,
                               vector<RotatedRect> &outRects) {
   Mat match_grey;
+  colorMatch(src, match_grey, r, false);
+
+  return colorSearch(match_grey, out, outRects);
+}
 
+int CPlateLocate::colorSearch(const Mat &match_grey, Mat &out,
+                              vector<RotatedRect> &outRects) {
   // width is important to the final results;
   const int color_morph_width = 10;
   const int color_morph_height = 2;
 
-  colorMatch(src, match_grey, r, false);
   SHOW_IMAGE(match_grey, 0);
 
   Mat src_threshold;
@@ -677,18 +682,22 @@ int CPlateLocate::plateColorLocate(Mat src, vector<CPlate> &candPlates,
 
   Mat src_clone = src.clone();
 
+  // one hsv conversion for both colors, then search them in parallel.
+  const Color colors[] = {BLUE, YELLOW};
+  colorMatch(src, m_colorMasks, false, colors, 2);
+
   Mat src_b_blue;
   Mat src_b_yellow;
 #pragma omp parallel sections
   {
 #pragma omp section
     {
-      colorSearch(src, BLUE, src_b_blue, rects_color_blue);
+      colorSearch(m_colorMasks.masks[BLUE], src_b_blue, rects_color_blue);
       deskew(src, src_b_blue, rects_color_blue, plates_blue, true, BLUE);
     }
 #pragma omp section
     {
-      colorSearch(src_clone, YELLOW, src_b_yellow, rects_color_yellow);
+      colorSearch(m_colorMasks.masks[YELLOW], src_b_yellow, rects_color_yellow);
       deskew(src_clone, src_b_yellow, rects_color_yellow, plates_yellow, true, YELLOW);
     }
   }
@@ -714,9 +723,8 @@ int CPlateLocate::plateMserLocate(Mat src, vector<CPlate> &candPlates, int img_i
 
   // only conside blue plate
   if (1) {
-    Mat grayImage;
-    cvtColor(src, grayImage, COLOR_BGR2GRAY);
-    channelImages.push_back(grayImage);
+    cvtColor(src, reuseMat(m_mserGray), COLOR_BGR2GRAY);
+    channelImages.push_back(m_mserGray);
   }
 
   for (size_t i = 0; i < channelImages.size(); ++i) {
@@ -753,8 +761,8 @@ int CPlateLocate::plateMserLocate(Mat src, vector<CPlate> &candPlates, int img_i
         mserPlate.push_back(plate);
       }
 
-      Mat resize_src_b;
-      resize(src_b, resize_src_b, Size(channelImage.cols, channelImage.rows));
+      Mat& resize_src_b = m_mserResizeSrcB;
+      resize(src_b, reuseMat(resize_src_b), Size(channelImage.cols, channelImage.rows));
 
       deskew(src, resize_src_b, rects_mser, deskewPlate, false, color);
 
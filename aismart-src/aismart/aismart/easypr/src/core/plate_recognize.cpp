@@ -15,7 +15,8 @@ CPlateRecognize::CPlateRecognize() {
 int CPlateRecognize::plateRecognize(const Mat& src, std::vector<CPlate> &plateVecOut, int img_index) {
   // resize to uniform sizes
   float scale = 1.f;
-  Mat img = uniformResize(src, scale);
+  uniformResize(src, m_resized, scale);
+  const Mat& img = m_resized;
 
   // 1. plate detect
   std::vector<CPlate> plateVec;
@@ -17,6 +17,7 @@
 #include "formula_string_utils.hpp"
 #include "rose_config.hpp"
 #include "filesystem.hpp"
+#include "tensor_kernels.hpp"
 
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/objdetect.hpp>
@@ -41,16 +42,15 @@ thome::thome(const config& app_cfg, display& disp, std::vector<std::string>& fie
 	, ocr_results_(ocr_results)
 	, start_layer_(start_layer)
 	, last_coordinate_(construct_null_coordinate())
-	, recognition_thread_running_(false)
 	, rng_(12345)
 	, current_example_(twidget::npos)
-	, current_surf_(std::make_pair(false, surface()))
-	, setting_(false)
+	, pipeline_(2)
 {
 }
 
 thome::~thome()
 {
+	pipeline_.stop();
 	avcapture_.reset(nullptr);
 }
 
@@ -83,6 +83,7 @@ void thome::pre_base(twindow& window)
 	tgrid* base_layer = body_->layer(BASE_LAYER);
 
 	paper_ = find_widget<ttrack>(base_layer, "paper", false, true);
+	pipeline_.add_stage("recognize", boost::bind(&thome::did_recognize_frame, this, _1));
 	paper_->set_did_draw(boost::bind(&thome::did_draw_paper, this, _1, _2, _3));
 	paper_->set_did_left_button_down(boost::bind(&thome::did_left_button_down_paper, this, _1, _2));
 	paper_->set_did_mouse_leave(boost::bind(&thome::did_mouse_leave_paper, this, _1, _2, _3));
@@ -132,67 +133,6 @@ void thome::app_first_drawn(twindow& window)
 	report->select_item(0);
 }
 
-void thome::DoWork()
-{
-	recognition_thread_running_ = true;
-	while (avcapture_.get()) {
-		if (setting_) {
-			// main thread is setting.
-			// seting action may be risk recognition_mutex_.
-			SDL_Delay(10);
-			continue;
-		}
-		threading::lock lock(recognition_mutex_);
-		if (!avcapture_.get()) {
-			continue;
-		}
-		if (!current_surf_.first) {
-			SDL_Delay(10);
-			continue;
-		}
-		if (current_example_ == classifier) {
-			VALIDATE(current_session_.second.get(), null_str);
-
-			std::string result = example_inception5h_internal2(current_surf_.second);
-			current_surf_.first = false;
-			{
-				threading::lock lock(variable_mutex_);
-				result_ = result;
-			}
-
-		} else if (current_example_ == detector) {
-			VALIDATE(current_session_.second.get(), null_str);
-
-			std::string result = example_detector_internal(current_surf_.second);
-			current_surf_.first = false;
-			{
-				threading::lock lock(variable_mutex_);
-				result_ = result;
-			}
-
-		} else if (current_example_ == pr) {
-			std::string result = example_pr_internal(current_surf_.second);
-			current_surf_.first = false;
-			{
-				threading::lock lock(variable_mutex_);
-				result_ = result;
-			}
-
-		} else {
-			SDL_Delay(10);
-		}
-	}
-	recognition_thread_running_ = false;
-}
-
-void thome::OnWorkStart()
-{
-}
-
-void thome::OnWorkDone()
-{
-}
-
 void thome::example_mouse()
 {
 	persist_surf_ = create_neutral_surface(paper_->get_width(), paper_->get_height());
@@ -257,7 +197,7 @@ std::string thome::example_inception5h_internal()
 		result << "load model fail: " << s;
 		return result.str();
 	}
-	std::unique_ptr<tensorflow::Session>& session = current_session_.second;
+	std::shared_ptr<tensorflow::Session>& session = current_session_.second;
 
 	// Read the label list
 	std::vector<std::string> label_strings;
@@ -287,11 +227,6 @@ std::string thome::example_inception5h_internal()
 	// Read the Grace Hopper image.
 	surface surf = image::get_image("misc/grace_hopper.png");
 
-	{
-		tsurface_2_mat_lock lock(surf);
-		cv::cvtColor(lock.mat, lock.mat, cv::COLOR_BGRA2RGBA);
-	}
-
 	int image_width = surf->w;
 	int image_height = surf->h;
 	int image_channels = 4;
@@ -311,19 +246,8 @@ std::string thome::example_inception5h_internal()
 	tensorflow::uint8* in = (uint8_t*)(dst_lock.pixels());
 	// tensorflow::uint8* in_end = (in + (image_height * image_width * image_channels));
 	float* out = image_tensor_mapped.data();
-	for (int y = 0; y < wanted_height; ++y) {
-		const int in_y = (y * image_height) / wanted_height;
-		tensorflow::uint8* in_row = in + (in_y * image_width * image_channels);
-		float* out_row = out + (y * wanted_width * wanted_channels);
-		for (int x = 0; x < wanted_width; ++x) {
-			const int in_x = (x * image_width) / wanted_width;
-			tensorflow::uint8* in_pixel = in_row + (in_x * image_channels);
-			float* out_pixel = out_row + (x * wanted_channels);
-			for (int c = 0; c < wanted_channels; ++c) {
-				out_pixel[c] = (in_pixel[c] - input_mean) / input_std;
-			}
-		}
-	}
+	// surface is BGRA in memory, kernel picks RGB from it.
+	tensorflow2::rgba_to_tensor(in, image_width, image_height, surf->pitch, true, out, wanted_width, wanted_height, input_mean, input_std);
 
 	result << " - loaded!";
 	result << " - " << label_strings.size() << ", " << label_strings[0] << " - " << image_width << "x" << image_height;
@@ -394,7 +318,7 @@ std::string thome::example_inception5h_internal2(surface& surf)
 	std::stringstream result;
 
 	const std::string data_path = game_config::path + "/" + game_config::generate_app_dir(game_config::app) + "/tensorflow";
-	std::unique_ptr<tensorflow::Session>& session = current_session_.second;
+	std::shared_ptr<tensorflow::Session>& session = current_session_.second;
 
 	// Read the label list
 	if (label_strings_.empty()) {
@@ -420,16 +344,10 @@ std::string thome::example_inception5h_internal2(surface& surf)
 		}
 	}
 
-	// Read the Grace Hopper image.
-	{
-		tsurface_2_mat_lock lock(surf);
-		cv::cvtColor(lock.mat, lock.mat, cv::COLOR_BGRA2RGBA);
-	}
-
 	const int image_channels = 4;
 	int image_width = surf->w;
 	int image_height = surf->h;
-	const int sourceRowBytes = image_width * image_channels;
+	const int sourceRowBytes = surf->pitch;
 
 	surface_lock dst_lock(surf);
 	uint8_t* sourceStartAddr = (uint8_t*)dst_lock.pixels();
@@ -455,19 +373,8 @@ std::string thome::example_inception5h_internal2(surface& surf)
 	tensorflow::uint8* in = sourceStartAddr;
 	// tensorflow::uint8* in_end = (in + (image_height * image_width * image_channels));
 	float* out = image_tensor_mapped.data();
-	for (int y = 0; y < wanted_height; ++y) {
-		const int in_y = (y * image_height) / wanted_height;
-		tensorflow::uint8* in_row = in + (in_y * image_width * image_channels);
-		float* out_row = out + (y * wanted_width * wanted_channels);
-		for (int x = 0; x < wanted_width; ++x) {
-			const int in_x = (x * image_width) / wanted_width;
-			tensorflow::uint8* in_pixel = in_row + (in_x * image_channels);
-			float* out_pixel = out_row + (x * wanted_channels);
-			for (int c = 0; c < wanted_channels; ++c) {
-				out_pixel[c] = (in_pixel[c] - input_mean) / input_std;
-			}
-		}
-	}
+	// surface is BGRA in memory, kernel picks RGB from it.
+	tensorflow2::rgba_to_tensor(in, image_width, image_height, sourceRowBytes, true, out, wanted_width, wanted_height, input_mean, input_std);
 
 	result << " - " << label_strings_.size() << ", " << label_strings_[0] << " - " << image_width << "x" << image_height;
 
@@ -600,7 +507,7 @@ std::string thome::example_detector_internal(surface& surf)
 		result << "load model fail: " << s;
 		return result.str();
 	}
-	std::unique_ptr<tensorflow::Session>& session = current_session_.second;
+	std::shared_ptr<tensorflow::Session>& session = current_session_.second;
 
 	int32_t num_detections = 5;
 	int32_t num_boxes = 784;
@@ -640,12 +547,6 @@ std::string thome::example_detector_internal(surface& surf)
 	}
 	CHECK_EQ(locations_.size(), num_boxes * 8);
 
-	// Read the Grace Hopper image.
-	{
-		tsurface_2_mat_lock lock(surf);
-		cv::cvtColor(lock.mat, lock.mat, cv::COLOR_BGRA2RGBA);
-	}
-
 	int image_width = surf->w;
 	int image_height = surf->h;
 	int image_channels = 4;
@@ -665,19 +566,8 @@ std::string thome::example_detector_internal(surface& surf)
 	tensorflow::uint8* in = (uint8_t*)(dst_lock.pixels());
 	// tensorflow::uint8* in_end = (in + (image_height * image_width * image_channels));
 	float* out = image_tensor_mapped.data();
-	for (int y = 0; y < wanted_height; ++y) {
-		const int in_y = (y * image_height) / wanted_height;
-		tensorflow::uint8* in_row = in + (in_y * image_width * image_channels);
-		float* out_row = out + (y * wanted_width * wanted_channels);
-		for (int x = 0; x < wanted_width; ++x) {
-			const int in_x = (x * image_width) / wanted_width;
-			tensorflow::uint8* in_pixel = in_row + (in_x * image_channels);
-			float* out_pixel = out_row + (x * wanted_channels);
-			for (int c = 0; c < wanted_channels; ++c) {
-				out_pixel[c] = (in_pixel[c] - input_mean) / input_std;
-			}
-		}
-	}
+	// surface is BGRA in memory, kernel picks RGB from it.
+	tensorflow2::rgba_to_tensor(in, image_width, image_height, surf->pitch, true, out, wanted_width, wanted_height, input_mean, input_std);
 
 	result << " - " << locations_.size() << ", " << image_width << "x" << image_height;
 
@@ -743,43 +633,76 @@ void thome::example_detector()
 	did_draw_paper(*paper_, paper_->get_draw_rect(), false);
 }
 
-std::string thome::example_pr_internal(surface& surf)
+std::string thome::example_pr_internal(surface& surf, const cv::Mat& bgr, const cv::Mat& gray)
 {
 /*
 	surface surf = image::get_image("misc/test.png");
 	surf = scale_surface(surf, surf1->w, surf1->h);
 */
-	tsurface_2_mat_lock lock(surf);
-	cv::Mat src = lock.mat.clone();
-	cv::cvtColor(src, src, cv::COLOR_BGRA2BGR);
+	if (bgr.empty()) {
+		tsurface_2_mat_lock lock(surf);
+		cv::cvtColor(lock.mat, pr_src_, cv::COLOR_BGRA2BGR);
+	}
+	const cv::Mat& src = bgr.empty()? pr_src_: bgr;
 
 	uint32_t start = SDL_GetTicks();
 
-	easypr::CPlateRecognize pr;
-	pr.setLifemode(true);
-	pr.setDebug(false);
-	// pr.setMaxPlates(1);
-	// pr.setDetectType(easypr::PR_DETECT_COLOR | easypr::PR_DETECT_SOBEL);
-	pr.setDetectType(easypr::PR_DETECT_CMSER);
+	// only recognize thread of pipeline_ uses it, keep it to reuse its buffers between frames.
+	if (!pr_.get()) {
+		pr_.reset(new easypr::CPlateRecognize);
+		pr_->setLifemode(true);
+		pr_->setDebug(false);
+		// pr_->setMaxPlates(1);
+		// pr_->setDetectType(easypr::PR_DETECT_COLOR | easypr::PR_DETECT_SOBEL);
+		pr_->setDetectType(easypr::PR_DETECT_CMSER);
+	}
+	easypr::CPlateRecognize& pr = *pr_.get();
 
 	//vector<string> plateVec;
 	std::vector<easypr::CPlate> plateVec;
 
-	std::stringstream result_ss;
-	int result = pr.plateRecognize(src, plateVec);
+	// when plates were found and scene only moves a little, recognize in region around them.
+	const bool full = gray.empty() || pr_tracker_.track(gray);
+	cv::Rect roi(0, 0, src.cols, src.rows);
+	if (!full) {
+		const int margin = 48;
+		roi = pr_tracker_.search_rect(margin);
+	}
 
-	threading::lock variable_lock(variable_mutex_);
-	rects_.clear();
+	std::stringstream result_ss;
+	int result = pr.plateRecognize(full? src: src(roi).clone(), plateVec);
 
+	std::vector<cv::Rect> detected;
 	if (result == 0) {
-		size_t num = plateVec.size();
 		for (std::vector<easypr::CPlate>::const_iterator it = plateVec.begin(); it != plateVec.end(); ++ it) {
 			const easypr::CPlate& plate = *it;
-			result_ss << " - " << conv_ansi_utf8_2(plate.getPlateStr(), true) << "\n";
-			SDL_Rect rect = {(int)(plate.getPlateLeftPoint().x / plate.getPlateScale()), (int)(plate.getPlateLeftPoint().y / plate.getPlateScale()), 
-				(int)(plate.getPlateRightPoint().x / plate.getPlateScale()), (int)(plate.getPlateRightPoint().y / plate.getPlateScale())};
-			rects_.push_back(std::make_pair(plate.getPlateScore(), rect));
+			const cv::Point left(roi.x + (int)(plate.getPlateLeftPoint().x / plate.getPlateScale()), roi.y + (int)(plate.getPlateLeftPoint().y / plate.getPlateScale()));
+			const cv::Point right(roi.x + (int)(plate.getPlateRightPoint().x / plate.getPlateScale()), roi.y + (int)(plate.getPlateRightPoint().y / plate.getPlateScale()));
+			detected.push_back(cv::Rect(left, right));
+		}
+	}
+	pr_tracker_.update(detected, full);
+
+	threading::lock variable_lock(variable_mutex_);
+	rects_.clear();
+
+	for (int at = 0; at < (int)detected.size(); at ++) {
+		const easypr::CPlate& plate = plateVec[at];
+		result_ss << " - " << conv_ansi_utf8_2(plate.getPlateStr(), true) << "\n";
+
+		// draw smoothed rect of track, so it doesn't jitter between frames.
+		cv::Rect smoothed = detected[at];
+		int max_area = 0;
+		const std::vector<troi_tracker::ttrack>& tracks = pr_tracker_.tracks();
+		for (std::vector<troi_tracker::ttrack>::const_iterator it = tracks.begin(); it != tracks.end(); ++ it) {
+			const int area = (it->rect & detected[at]).area();
+			if (area > max_area) {
+				smoothed = it->rect;
+				max_area = area;
+			}
 		}
+		SDL_Rect rect = {smoothed.x, smoothed.y, smoothed.x + smoothed.width, smoothed.y + smoothed.height};
+		rects_.push_back(std::make_pair(plate.getPlateScore(), rect));
 	}
 
 	uint32_t end = SDL_GetTicks();
@@ -796,13 +719,11 @@ void thome::example_pr()
 
 void thome::stop_avcapture()
 {
-	tsetting_lock setting_lock(*this);
-	threading::lock lock(recognition_mutex_);
+	pipeline_.stop();
 
 	avcapture_.reset();
 	paper_->set_timer_interval(0);
 
-	current_surf_ = std::make_pair(false, surface());
 	result_.clear();
 	rects_.clear();
 }
@@ -811,8 +732,7 @@ void thome::avcapture_switch_scenario(const std::string& name)
 {
 	posix_print("%i, avcapture_switch_scenario(1)------name: %s\n", SDL_GetTicks(), name.empty()? "<nil>": name.c_str());
 
-	tsetting_lock setting_lock(*this);
-	threading::lock lock(recognition_mutex_);
+	pipeline_.stop();
 
 	if (!avcapture_.get()) {
 		posix_print("%i, avcapture_switch_scenario(2), new\n", SDL_GetTicks());
@@ -822,18 +742,24 @@ void thome::avcapture_switch_scenario(const std::string& name)
 		posix_print("%i, avcapture_switch_scenario(2), reuse\n", SDL_GetTicks());
 	}
 
-	current_surf_ = std::make_pair(false, surface());
 	result_.clear();
 	rects_.clear();
 
 	if (!name.empty()) {
-		tensorflow::Status s = tensorflow2::load_model(name, current_session_);
+		// frames use held session, check whether .pb was rewritten only when switch.
+		tensorflow::Status s = tensorflow2::reload_model(name, current_session_);
 		VALIDATE(s.ok(), null_str);
 	}
+	// plate recognizer wants BGR, pipeline converts it from camera's I420 planes.
+	pipeline_.set_bgr(current_example_ == pr);
+	pr_tracker_.reset();
+	pipeline_.start();
 }
 
 void thome::did_example_item_changed(ttoggle_button& widget)
 {
+	// recognize stage reads current_example_, stop it before switching.
+	pipeline_.stop();
 	current_example_ = widget.cookie();
 	if (current_example_ == mouse) {
 		find_widget<tslider>(window_, "slider1", false).set_visible(twidget::INVISIBLE);
@@ -859,10 +785,6 @@ void thome::did_example_item_changed(ttoggle_button& widget)
 		const std::string pb_path = data_path + "/inception5h/tensorflow_inception_graph.pb";
 		avcapture_switch_scenario(pb_path);
 
-		if (!recognition_thread_running_) {
-			thread_->Start();
-		}
-
 		example_classifier();
 
 	} else if (current_example_ == detector) {
@@ -873,10 +795,6 @@ void thome::did_example_item_changed(ttoggle_button& widget)
 		const std::string pb_path = data_path + "/mobile_multibox_v1a/multibox_model.pb";
 		avcapture_switch_scenario(pb_path);
 
-		if (!recognition_thread_running_) {
-			thread_->Start();
-		}
-
 		example_detector();
 
 	} else if (current_example_ == pr) {
@@ -885,10 +803,6 @@ void thome::did_example_item_changed(ttoggle_button& widget)
 
 		avcapture_switch_scenario(null_str);
 
-		if (!recognition_thread_running_) {
-			thread_->Start();
-		}
-
 		example_pr();
 
 	}
@@ -897,19 +811,37 @@ void thome::did_example_item_changed(ttoggle_button& widget)
 SDL_Rect thome::app_did_draw_frame(bool remote, cv::Mat& frame, const SDL_Rect& draw_rect)
 {
 	if (current_example_ == classifier || current_example_ == detector || current_example_ == pr) {
-		if (!current_surf_.first) {
-			if (!current_surf_.second.get()) {
-				current_surf_.second = create_neutral_surface(frame.cols, frame.rows);
-			}
-			memcpy(current_surf_.second->pixels, frame.data, frame.cols * frame.rows * 4); 
-			current_surf_.first = true;
-		}
-
+		// caller locks avcapture's mutex, planes are valid during push.
+		ti420_planes planes;
+		const bool has_planes = avcapture_->i420_planes(remote, planes) && planes.width == frame.cols && planes.height == frame.rows;
+		pipeline_.push(frame, has_planes? &planes: NULL);
 	}
 
 	return draw_rect;
 }
 
+void thome::did_recognize_frame(tframe& frame)
+{
+	std::string result;
+	if (current_example_ == classifier) {
+		VALIDATE(current_session_.second.get(), null_str);
+		result = example_inception5h_internal2(frame.surf);
+
+	} else if (current_example_ == detector) {
+		VALIDATE(current_session_.second.get(), null_str);
+		result = example_detector_internal(frame.surf);
+
+	} else if (current_example_ == pr) {
+		result = example_pr_internal(frame.surf, frame.bgr, frame.gray);
+
+	} else {
+		return;
+	}
+
+	threading::lock lock(variable_mutex_);
+	result_ = result;
+}
+
 void thome::did_left_button_down_paper(ttrack& widget, const tpoint& coordinate)
 {
 	last_coordinate_ = coordinate;
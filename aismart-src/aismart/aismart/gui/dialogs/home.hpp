@@ -3,6 +3,8 @@
 
 #include "gui/dialogs/dialog.hpp"
 #include "rtc_client.hpp"
+#include "frame_pipeline.hpp"
+#include "roi_tracker.hpp"
 
 #include <opencv2/core.hpp>
 #include <tensorflow/core/public/session.h>
@@ -10,6 +12,9 @@
 #include "tensorflow2.hpp"
 
 class display;
+namespace easypr {
+class CPlateRecognize;
+}
 
 namespace gui2 {
 
@@ -18,7 +23,7 @@ class ttoggle_button;
 class ttrack;
 class tslider;
 
-class thome: public tdialog, public tworker
+class thome: public tdialog
 {
 public:
 	enum tresult {OCR = 1, CHAT};
@@ -41,10 +46,6 @@ private:
 	/** Inherited from tdialog, implemented by REGISTER_DIALOG. */
 	virtual const std::string& window_id() const;
 
-	void DoWork() override;
-	void OnWorkStart() override;
-	void OnWorkDone() override;
-
 	void did_body_changed(treport& report, ttoggle_button& widget);
 
 	// base
@@ -69,9 +70,10 @@ private:
 	std::string example_inception5h_internal();
 	std::string example_inception5h_internal2(surface& surf);
 	std::string example_detector_internal(surface& surf);
-	std::string example_pr_internal(surface& surf);
+	std::string example_pr_internal(surface& surf, const cv::Mat& bgr = cv::Mat(), const cv::Mat& gray = cv::Mat());
 
 	SDL_Rect app_did_draw_frame(bool remote, cv::Mat& frame, const SDL_Rect& draw_rect);
+	void did_recognize_frame(tframe& frame);
 
 	void stop_avcapture();
 	void avcapture_switch_scenario(const std::string& name);
@@ -95,37 +97,18 @@ private:
 	ttrack* paper_;
 	std::vector<image::tblit> blits_;
 
-	std::pair<std::string, std::unique_ptr<tensorflow::Session> > current_session_;
-	std::pair<bool, surface> current_surf_; // first: valid. now can recognition.
-
-	threading::mutex recognition_mutex_;
+	tensorflow2::tsession current_session_;
+	std::unique_ptr<easypr::CPlateRecognize> pr_;
+	cv::Mat pr_src_;
+	troi_tracker pr_tracker_; // used by recognize stage only.
+	tframe_pipeline pipeline_;
 	threading::mutex variable_mutex_;
-	bool recognition_thread_running_;
 
 	std::string result_;
 	std::vector<std::pair<float, SDL_Rect> > rects_;
 	std::vector<std::string> label_strings_;
 	std::vector<float> locations_;
 
-	class tsetting_lock
-	{
-	public:
-		tsetting_lock(thome& home)
-			: home_(home)
-		{
-			VALIDATE(!home_.setting_, null_str);
-			home_.setting_ = true;
-		}
-		~tsetting_lock()
-		{
-			home_.setting_ = false;
-		}
-
-	private:
-		thome& home_;
-	};
-	bool setting_;
-
 	std::unique_ptr<tavcapture> avcapture_;
 	surface persist_surf_;
 	surface temperate_surf_;
@@ -15,6 +15,8 @@
 #include "help.hpp"
 #include "version.hpp"
 #include "tensorflow_link.hpp"
+#include "benchmark_runner.hpp"
+#include "tensorflow2.hpp"
 
 
 namespace easypr {
@@ -40,6 +42,7 @@ public:
 private:
 	void app_tensorflow_link() override;
 	void app_load_settings_config(const config& cfg) override;
+	void app_lowmemory() override;
 	void load_pb() override;
 };
 
@@ -59,6 +62,15 @@ void game_instance::app_load_settings_config(const config& cfg)
 	game_config::wesnoth_version = version_info(game_config::version);
 }
 
+void game_instance::app_lowmemory()
+{
+	// sessions hold weights of model, they are the largest memory. reload them when required.
+	const tensorflow2::tsession_stats stats = tensorflow2::session_stats();
+	posix_print("app_lowmemory, clear sessions, hits: %i, misses: %i, evictions: %i, load: %u ms\n",
+		stats.hits, stats.misses, stats.evictions, stats.load_ms);
+	tensorflow2::clear_sessions();
+}
+
 void copy_model_directory(const std::string& src_dir)
 {
 	Uint32 start = SDL_GetTicks();
@@ -94,16 +106,30 @@ void game_instance::load_pb()
 	const std::string dst = game_config::preferences_dir;
 	copy_model_directory(src);
 
-	easypr::kDefaultSvmPath = game_config::preferences_dir + "/model/svm_hist.xml";
-	easypr::kLBPSvmPath = game_config::preferences_dir + "/model/svm_lbp.xml";
-	easypr::kHistSvmPath = game_config::preferences_dir + "/model/svm_hist.xml";
+	set_easypr_model_paths(game_config::preferences_dir + "/model");
+
+	// inception5h, multibox and ocr's char model.
+	tensorflow2::set_session_capacity(3);
+	// camera models are large and run every frame, share one inter-op pool and cache optimized graph.
+	const std::string data_path = game_config::path + "/" + game_config::generate_app_dir(game_config::app) + "/tensorflow";
+	tensorflow2::tsession_options camera_options(0, 0, "camera");
+	camera_options.cache_optimized = true;
+	tensorflow2::set_session_options(data_path + "/inception5h/tensorflow_inception_graph.pb", camera_options);
+	tensorflow2::set_session_options(data_path + "/mobile_multibox_v1a/multibox_model.pb", camera_options);
+}
+
+void set_easypr_model_paths(const std::string& model_dir)
+{
+	easypr::kDefaultSvmPath = model_dir + "/svm_hist.xml";
+	easypr::kLBPSvmPath = model_dir + "/svm_lbp.xml";
+	easypr::kHistSvmPath = model_dir + "/svm_hist.xml";
 
-	easypr::kDefaultAnnPath = game_config::preferences_dir + "/model/ann.xml";
-	easypr::kChineseAnnPath = game_config::preferences_dir + "/model/ann_chinese.xml";
-	easypr::kGrayAnnPath = game_config::preferences_dir + "/model/annCh.xml";
+	easypr::kDefaultAnnPath = model_dir + "/ann.xml";
+	easypr::kChineseAnnPath = model_dir + "/ann_chinese.xml";
+	easypr::kGrayAnnPath = model_dir + "/annCh.xml";
 
 	//This is important to for key transform to chinese
-	easypr::kChineseMappingPath = game_config::preferences_dir + "/model/province_mapping";
+	easypr::kChineseMappingPath = model_dir + "/province_mapping";
 
 #ifdef _WIN32
 	conv_ansi_utf8(easypr::kDefaultSvmPath, false);
@@ -132,7 +158,7 @@ std::map<std::string, tocr_result> game_instance::handle_ocr(const std::vector<s
  */
 static int do_gameloop(int argc, char** argv)
 {
-	rtc::PhysicalSocketServer ss;
+	rtc::SDLSocketServer ss;
 	instance_manager<game_instance> manager(ss, argc, argv, "aismart", "#rose", false);
 	game_instance& game = manager.get();
 
@@ -179,9 +205,30 @@ static int do_gameloop(int argc, char** argv)
 	return 0;
 }
 
+// aismart --convert-model <xxx.pb>, write memmapped package xxx.mmpb beside xxx.pb, then exit.
+// run it when packaging models, load_model prefers xxx.mmpb if it is newer than xxx.pb.
+static int convert_model(const std::string& pb_path)
+{
+	const std::string mmpb_path = tensorflow2::memmapped_model_name(pb_path);
+	tensorflow::Status s = tensorflow2::convert_to_memmapped(pb_path, mmpb_path);
+	if (!s.ok()) {
+		posix_print("convert %s fail: %s\n", pb_path.c_str(), s.ToString().c_str());
+		return 1;
+	}
+	posix_print("convert %s to %s\n", pb_path.c_str(), mmpb_path.c_str());
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
+	if (is_benchmark_cmdline(argc, argv)) {
+		return run_benchmark(argc, argv);
+	}
+
 	try {
+		if (argc == 3 && !strcmp(argv[1], "--convert-model")) {
+			return convert_model(argv[2]);
+		}
 		do_gameloop(argc, argv);
 	} catch (twml_exception& e) {
 		// this exception is generated when create instance.
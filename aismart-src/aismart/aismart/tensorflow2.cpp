@@ -8,13 +8,19 @@
 #include "serialization/string_utils.hpp"
 #include "wml_exception.hpp"
 #include "sdl_utils.hpp"
+#include "thread.hpp"
+#include "tensor_kernels.hpp"
 
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/io/coded_stream.h>
 
 #include <tensorflow/core/framework/op_kernel.h>
+#include <tensorflow/core/framework/graph.pb.h>
+#include <tensorflow/core/platform/env.h>
+#include <tensorflow/core/util/memmapped_file_system.h>
 
 #include <sstream>
+#include <set>
 
 namespace tensorflow2 {
 
@@ -39,30 +45,168 @@ private:
 	bool ok_;
 };
 
-tensorflow::Status load_model(const std::string& fname, std::unique_ptr<tensorflow::Session>& session) 
+static void session_options_2_tf(const tsession_options& options, tensorflow::SessionOptions& tf_options)
+{
+	tensorflow::ConfigProto& config = tf_options.config;
+	if (options.intra_op_threads > 0) {
+		config.set_intra_op_parallelism_threads(options.intra_op_threads);
+	}
+	if (options.inter_op_threads > 0) {
+		config.set_inter_op_parallelism_threads(options.inter_op_threads);
+	}
+	if (!options.pool_name.empty()) {
+		// sessions with the same pool_name share one global inter-op thread pool,
+		// so a heavy model cannot starve the threads of another pool.
+		tensorflow::ThreadPoolOptionProto* pool = config.add_session_inter_op_thread_pool();
+		pool->set_num_threads(options.inter_op_threads);
+		pool->set_global_name(options.pool_name);
+	}
+}
+
+// session of memmapped package. ImmutableConst kernels read weights through env,
+// so env must be alive as long as session.
+class tmemmapped_session: public tensorflow::Session
+{
+public:
+	tmemmapped_session(std::unique_ptr<tensorflow::MemmappedEnv>& env, tensorflow::Session* session)
+		: env_(std::move(env))
+		, session_(session)
+	{}
+	~tmemmapped_session()
+	{
+		// destruct session before env.
+		session_.reset();
+	}
+
+	tensorflow::Status Create(const tensorflow::GraphDef& graph) override { return session_->Create(graph); }
+	tensorflow::Status Extend(const tensorflow::GraphDef& graph) override { return session_->Extend(graph); }
+	tensorflow::Status Run(const std::vector<std::pair<tensorflow::string, tensorflow::Tensor> >& inputs,
+		const std::vector<tensorflow::string>& output_tensor_names,
+		const std::vector<tensorflow::string>& target_node_names,
+		std::vector<tensorflow::Tensor>* outputs) override
+	{
+		return session_->Run(inputs, output_tensor_names, target_node_names, outputs);
+	}
+	tensorflow::Status Run(const tensorflow::RunOptions& run_options,
+		const std::vector<std::pair<tensorflow::string, tensorflow::Tensor> >& inputs,
+		const std::vector<tensorflow::string>& output_tensor_names,
+		const std::vector<tensorflow::string>& target_node_names,
+		std::vector<tensorflow::Tensor>* outputs, tensorflow::RunMetadata* run_metadata) override
+	{
+		return session_->Run(run_options, inputs, output_tensor_names, target_node_names, outputs, run_metadata);
+	}
+	tensorflow::Status ListDevices(std::vector<tensorflow::DeviceAttributes>* response) override { return session_->ListDevices(response); }
+	tensorflow::Status Close() override { return session_->Close(); }
+
+private:
+	std::unique_ptr<tensorflow::MemmappedEnv> env_;
+	std::unique_ptr<tensorflow::Session> session_;
+};
+
+static tensorflow::Status load_memmapped_model(const std::string& fname, std::unique_ptr<tensorflow::Session>& session, tensorflow::SessionOptions& tf_options, bool optimize)
+{
+	std::unique_ptr<tensorflow::MemmappedEnv> env(new tensorflow::MemmappedEnv(tensorflow::Env::Default()));
+	tensorflow::Status s = env->InitializeFromFile(fname);
+	if (!s.ok()) {
+		LOG(ERROR) << "Failed to map model from " << fname << ": " << s;
+		return s;
+	}
+
+	// graph is small, weights remain in mapped pages.
+	tensorflow::GraphDef tensorflow_graph;
+	s = tensorflow::ReadBinaryProto(env.get(), tensorflow::MemmappedFileSystem::kMemmappedPackageDefaultGraphDef, &tensorflow_graph);
+	if (!s.ok()) {
+		LOG(ERROR) << "Failed to load model proto from " << fname << ": " << s;
+		return s;
+	}
+	if (optimize) {
+		// weights are ImmutableConst, only fusion takes effect.
+		optimize_graph(tensorflow_graph);
+	}
+
+	tf_options.env = env.get();
+	tensorflow::Session* session_pointer = nullptr;
+	s = tensorflow::NewSession(tf_options, &session_pointer);
+	if (!s.ok()) {
+		LOG(ERROR) << "Could not create TensorFlow Session: " << s;
+		return s;
+	}
+	session.reset(new tmemmapped_session(env, session_pointer));
+
+	s = session->Create(tensorflow_graph);
+	if (!s.ok()) {
+		LOG(ERROR) << "Could not create TensorFlow Graph: " << s;
+		return s;
+	}
+	return tensorflow::Status::OK();
+}
+
+// read .pb, and optimize it if required. use/update cache of optimized graph if required.
+static bool read_model_graph(const std::string& fname, const tsession_options& options, tensorflow::GraphDef& graph_def)
+{
+	const std::string cache_name = options.optimize && options.cache_optimized? optimized_model_name(fname): null_str;
+	if (!cache_name.empty() && SDL_IsFile(cache_name.c_str()) && file_create_time(cache_name) >= file_create_time(fname)) {
+		if (read_file_to_proto(cache_name, graph_def)) {
+			return true;
+		}
+		graph_def.Clear();
+	}
+
+	if (!SDL_IsFile(fname.c_str()) || !read_file_to_proto(fname, graph_def)) {
+		return false;
+	}
+	if (!options.optimize) {
+		return true;
+	}
+
+	const uint32_t start = SDL_GetTicks();
+	const int rewrites = optimize_graph(graph_def);
+	LOG(INFO) << "Optimized graph of " << fname << ": " << rewrites << " rewrites, " << (SDL_GetTicks() - start) << " ms";
+
+	if (!cache_name.empty()) {
+		// failure of cache doesn't affect this load.
+		create_directory_if_missing(directory_name(cache_name));
+		tensorflow::Status s = tensorflow::WriteBinaryProto(tensorflow::Env::Default(), cache_name, graph_def);
+		if (!s.ok()) {
+			LOG(ERROR) << "Failed to save optimized graph to " << cache_name << ": " << s;
+		}
+	}
+	return true;
+}
+
+tensorflow::Status load_model(const std::string& fname, std::unique_ptr<tensorflow::Session>& session, const tsession_options& options) 
 {
 	tnull_session_lock lock(session);
 
-	tensorflow::SessionOptions options;
+	tensorflow::SessionOptions tf_options;
+	session_options_2_tf(options, tf_options);
+
+	size_t pos = fname.rfind(".pb");
+	VALIDATE(pos != std::string::npos && pos + 3 == fname.size(), null_str);
+
+	// if there is up-to-date memmapped package, prefer it.
+	const std::string mmpb_name = memmapped_model_name(fname);
+	if (SDL_IsFile(mmpb_name.c_str()) && file_create_time(mmpb_name) >= file_create_time(fname)) {
+		tensorflow::Status s = load_memmapped_model(mmpb_name, session, tf_options, options.optimize);
+		if (s.ok()) {
+			lock.set_ok(true);
+			return s;
+		}
+		// bad package, fall back to .pb.
+		session.reset();
+		tf_options.env = tensorflow::Env::Default();
+	}
 
 	tensorflow::Session* session_pointer = nullptr;
-	tensorflow::Status session_status = tensorflow::NewSession(options, &session_pointer);
+	tensorflow::Status session_status = tensorflow::NewSession(tf_options, &session_pointer);
 	if (!session_status.ok()) {
 		LOG(ERROR) << "Could not create TensorFlow Session: " << session_status;
 		return session_status;
 	}
 	session.reset(session_pointer);
 
-	size_t pos = fname.rfind(".pb");
-	VALIDATE(pos != std::string::npos && pos + 3 == fname.size(), null_str);
-
 	tensorflow::GraphDef tensorflow_graph;
-
-	bool read_proto_succeeded = SDL_IsFile(fname.c_str());
-	if (read_proto_succeeded) {
-		read_proto_succeeded = tensorflow2::read_file_to_proto(fname, tensorflow_graph);
-	}
-	if (!read_proto_succeeded) {
+	if (!read_model_graph(fname, options, tensorflow_graph)) {
 		LOG(ERROR) << "Failed to load model proto from" << fname;
 		return tensorflow::errors::NotFound(fname);
 	}
@@ -77,119 +221,346 @@ tensorflow::Status load_model(const std::string& fname, std::unique_ptr<tensorfl
 	return tensorflow::Status::OK();
 }
 
-tensorflow::Status load_model(const std::string& fname, std::pair<std::string, std::unique_ptr<tensorflow::Session> >& session2) 
+//
+// process-wide session registry
+//
+class tsession_registry
 {
-	std::unique_ptr<tensorflow::Session>& session = session2.second;
-	const std::string key = file_name(fname);
-	if (key != session2.first) {
-		tensorflow::Status s = tensorflow2::load_model(fname, session);
-		if (!s.ok()) {
-			session2.first.clear();
-			return s;
+public:
+	struct tentry
+	{
+		tentry()
+			: mtime(0)
+			, last_used(0)
+		{}
+
+		time_t mtime;
+		uint32_t last_used;
+		std::shared_ptr<tensorflow::Session> session;
+	};
+
+	tsession_registry()
+		: capacity_(4)
+	{}
+
+	tensorflow::Status get(const std::string& fname, std::shared_ptr<tensorflow::Session>& session);
+	bool reload(const std::string& fname);
+	void set_options(const std::string& fname, const tsession_options& options);
+	void set_capacity(int capacity);
+	void clear();
+
+	tsession_stats stats();
+
+private:
+	void evict_if_full();
+
+private:
+	threading::mutex mutex_;
+	// signaled when one in-flight load finished.
+	threading::condition loaded_;
+	int capacity_;
+	std::map<std::string, tentry> entries_;
+	std::map<std::string, tsession_options> options_;
+	// .pb that is loading now. load runs without mutex_, so loads of different .pb don't serialize.
+	std::set<std::string> loading_;
+	// in-flight loads whose options changed or were cleared, their sessions must not be cached.
+	std::set<std::string> discarded_;
+	tsession_stats stats_;
+};
+
+// hit doesn't stat .pb, only load and reload do.
+tensorflow::Status tsession_registry::get(const std::string& fname, std::shared_ptr<tensorflow::Session>& session)
+{
+	tsession_options options;
+	{
+		threading::lock lock(mutex_);
+		while (loading_.count(fname)) {
+			// other thread is loading the same .pb, wait it and use its session.
+			loaded_.wait(mutex_);
+		}
+
+		std::map<std::string, tentry>::iterator it = entries_.find(fname);
+		if (it != entries_.end()) {
+			it->second.last_used = SDL_GetTicks();
+			session = it->second.session;
+			stats_.hits ++;
+			return tensorflow::Status::OK();
+		}
+
+		stats_.misses ++;
+		std::map<std::string, tsession_options>::const_iterator find = options_.find(fname);
+		if (find != options_.end()) {
+			options = find->second;
 		}
-		session2.first = key;
-	} else {
-		VALIDATE(session2.second.get(), null_str);
+		loading_.insert(fname);
+	}
+
+	// file_create_time returns modified time, not create time. reload depends on it to find rewritten .pb.
+	const time_t mtime = file_create_time(fname);
+	const uint32_t start = SDL_GetTicks();
+	std::unique_ptr<tensorflow::Session> session2;
+	tensorflow::Status s = load_model(fname, session2, options);
+	const uint32_t used = SDL_GetTicks() - start;
+
+	threading::lock lock(mutex_);
+	loading_.erase(fname);
+	loaded_.notify_all();
+	if (!s.ok()) {
+		discarded_.erase(fname);
+		return s;
+	}
+	if (discarded_.erase(fname)) {
+		// caller still can use it, but next get will load with new options.
+		session.reset(session2.release());
+		return tensorflow::Status::OK();
 	}
+	stats_.load_ms += used;
+	if (used > stats_.max_load_ms) {
+		stats_.max_load_ms = used;
+	}
+
+	evict_if_full();
+
+	tentry& entry = entries_[fname];
+	entry.mtime = mtime;
+	entry.last_used = SDL_GetTicks();
+	entry.session.reset(session2.release());
+	session = entry.session;
+
 	return tensorflow::Status::OK();
 }
 
-// if fail return 0.
-wchar_t inference_char(std::pair<std::string, std::unique_ptr<tensorflow::Session> >& current_session, const std::string& pb_path, cv::Mat& src2, uint32_t* used_ticks)
+// if .pb was rewritten on disk since it was loaded, drop its entry, next get will load it.
+// return true if dropped. holder of old session still can use it.
+bool tsession_registry::reload(const std::string& fname)
+{
+	const time_t mtime = file_create_time(fname);
+
+	threading::lock lock(mutex_);
+	std::map<std::string, tentry>::iterator it = entries_.find(fname);
+	if (it == entries_.end() || it->second.mtime == mtime) {
+		return false;
+	}
+	entries_.erase(it);
+	stats_.evictions ++;
+	return true;
+}
+
+void tsession_registry::evict_if_full()
+{
+	while ((int)entries_.size() >= capacity_) {
+		// evict least recently used entry.
+		std::map<std::string, tentry>::iterator oldest = entries_.begin();
+		for (std::map<std::string, tentry>::iterator it = entries_.begin(); it != entries_.end(); ++ it) {
+			if (it->second.last_used < oldest->second.last_used) {
+				oldest = it;
+			}
+		}
+		entries_.erase(oldest);
+		stats_.evictions ++;
+	}
+}
+
+void tsession_registry::set_options(const std::string& fname, const tsession_options& options)
+{
+	threading::lock lock(mutex_);
+
+	options_[fname] = options;
+	// new options require re-create session.
+	std::map<std::string, tentry>::iterator it = entries_.find(fname);
+	if (it != entries_.end()) {
+		entries_.erase(it);
+		stats_.evictions ++;
+	}
+	if (loading_.count(fname)) {
+		discarded_.insert(fname);
+	}
+}
+
+void tsession_registry::set_capacity(int capacity)
+{
+	VALIDATE(capacity > 0, null_str);
+
+	threading::lock lock(mutex_);
+	capacity_ = capacity;
+	while ((int)entries_.size() > capacity_) {
+		evict_if_full();
+	}
+}
+
+void tsession_registry::clear()
+{
+	threading::lock lock(mutex_);
+	entries_.clear();
+	discarded_.insert(loading_.begin(), loading_.end());
+}
+
+tsession_stats tsession_registry::stats()
+{
+	threading::lock lock(mutex_);
+	return stats_;
+}
+
+static tsession_registry& session_registry()
+{
+	static tsession_registry registry;
+	return registry;
+}
+
+void set_session_options(const std::string& fname, const tsession_options& options)
+{
+	session_registry().set_options(fname, options);
+}
+
+void set_session_capacity(int capacity)
+{
+	session_registry().set_capacity(capacity);
+}
+
+void clear_sessions()
+{
+	session_registry().clear();
+}
+
+tsession_stats session_stats()
 {
+	return session_registry().stats();
+}
+
+tensorflow::Status load_model(const std::string& fname, tsession& session2) 
+{
+	std::shared_ptr<tensorflow::Session>& session = session2.second;
+	if (session.get() && session2.first == fname) {
+		// caller holds session across frames, don't stat .pb nor lock registry.
+		return tensorflow::Status::OK();
+	}
+	tensorflow::Status s = session_registry().get(fname, session);
+	if (!s.ok()) {
+		session2.first.clear();
+		session.reset();
+		return s;
+	}
+	session2.first = fname;
+	return tensorflow::Status::OK();
+}
+
+tensorflow::Status reload_model(const std::string& fname, tsession& session2)
+{
+	session_registry().reload(fname);
+	session2.first.clear();
+	session2.second.reset();
+	return load_model(fname, session2);
+}
+
+static void fill_char_tensor(const cv::Mat& src2, float* out, const int wanted_width, const int wanted_height)
+{
+	cv::Mat src = get_adaption_ratio_mat(src2, wanted_width, wanted_height);
+	VALIDATE(src.cols == wanted_width && src.rows == wanted_height, null_str);
+
+	// it is white backgraound/black foreground. foreground is 1, background is 0.
+	if (src.isContinuous()) {
+		binarize_to_float(src.ptr<uint8_t>(0), out, src.cols * src.rows, 255);
+		return;
+	}
+	for (int row = 0; row < src.rows; row ++) {
+		binarize_to_float(src.ptr<uint8_t>(row), out + row * src.cols, src.cols, 255);
+	}
+}
+
+// pack all chars into one NHWC tensor, and run session once.
+// if fail return empty vector. else result's size is equal to srcs.size().
+// used_ticks(if not nullptr) will receive every char's average run time.
+std::vector<wchar_t> inference_chars(tsession& current_session, const std::string& pb_path, const std::vector<cv::Mat>& srcs, std::vector<uint32_t>* used_ticks)
+{
+	std::vector<wchar_t> result;
+	if (used_ticks) {
+		used_ticks->clear();
+	}
+	if (srcs.empty()) {
+		return result;
+	}
+
 	tensorflow::Status s = tensorflow2::load_model(pb_path, current_session);
 	if (!s.ok()) {
 		std::stringstream err;
 		err << "load model fail: " << s;
-		return 0;
+		return result;
 	}
-	std::unique_ptr<tensorflow::Session>& session = current_session.second;
-
-	// Read the label list
-	std::vector<std::string> label_strings;
-	
-	cv::Mat src = get_adaption_ratio_mat(src2, 28, 28);
+	std::shared_ptr<tensorflow::Session>& session = current_session.second;
 
-	int image_width = src.cols;
-	int image_height = src.rows;
-	int image_channels = 1;
+	const int batch = srcs.size();
 	const int wanted_width = 28;
 	const int wanted_height = 28;
 	const int wanted_channels = 1;
-	const float input_mean = 117.0f;
-	const float input_std = 1.0f;
-	VALIDATE(image_channels == wanted_channels, null_str);
 	tensorflow::Tensor image_tensor(
 		tensorflow::DT_FLOAT,
 		tensorflow::TensorShape({
-		1, wanted_height, wanted_width, wanted_channels}));
+		batch, wanted_height, wanted_width, wanted_channels}));
 	auto image_tensor_mapped = image_tensor.tensor<float, 4>();
 
 	float* out = image_tensor_mapped.data();
-	for (int row = 0; row < src.rows; row ++) {
-		const uint8_t* in_row = src.ptr<uint8_t>(row);
-		for (int x = 0; x < src.cols; x ++) {
-			float* out_pixel = out + row * src.cols;
-			if (in_row[x] == 255) {
-				out_pixel[x] = 0;
-			} else {
-				out_pixel[x] = 1;
-			}
-		}
+	const int char_floats = wanted_height * wanted_width * wanted_channels;
+	for (int at = 0; at < batch; at ++) {
+		VALIDATE(srcs[at].channels() == wanted_channels, null_str);
+		fill_char_tensor(srcs[at], out + at * char_floats, wanted_width, wanted_height);
 	}
 
 	uint32_t start = SDL_GetTicks();
 
-	wchar_t wch = 0;
-	const int loops = 3;
-	std::map<wchar_t, int> wchs;
-	for (int loop = 0; loop < loops; loop ++) {
-		std::vector<tensorflow::Tensor> outputs;
-		tensorflow::Status run_status = session->Run({{"x-input", image_tensor}}, {"layer6-fc2/logit"}, {}, &outputs);
-		if (!run_status.ok()) {
-			std::stringstream err;
-			err << "Running model failed: " << run_status;
-			tensorflow::LogAllRegisteredKernels();
-			return 0;
-		}
+	std::vector<tensorflow::Tensor> outputs;
+	tensorflow::Status run_status = session->Run({{"x-input", image_tensor}}, {"layer6-fc2/logit"}, {}, &outputs);
+	if (!run_status.ok()) {
+		std::stringstream err;
+		err << "Running model failed: " << run_status;
+		tensorflow::LogAllRegisteredKernels();
+		return result;
+	}
 
-		tensorflow::Tensor* output = &outputs[0];
-		const Eigen::TensorMap<Eigen::Tensor<float, 1, Eigen::RowMajor>, Eigen::Aligned>& prediction = output->flat<float>();
-	
-		std::map<wchar_t, int>::iterator find;
-		const long count = prediction.size();
-		std::vector<float> floats;
+	// logit is [batch, classes]
+	const tensorflow::Tensor& output = outputs[0];
+	VALIDATE(output.dims() == 2 && output.dim_size(0) == batch, null_str);
+	const auto prediction = output.matrix<float>();
+	const int classes = output.dim_size(1);
+
+	result.reserve(batch);
+	for (int at = 0; at < batch; at ++) {
+		wchar_t wch = 0;
 		float max_value = INT_MIN;
-		for (int i = 0; i < count; ++i) {
-			const float value = prediction(i);
+		for (int i = 0; i < classes; ++i) {
+			const float value = prediction(at, i);
 			if (value > max_value) {
 				wch = '0' + i;
 				max_value = value;
 			}
-			floats.push_back(value);
-		}
-		find = wchs.find(wch);
-		if (find != wchs.end()) {
-			find->second ++;
-		} else {
-			wchs.insert(std::make_pair(wch, 1));
 		}
+		result.push_back(wch);
 	}
 
-	int max_loop = 0;
-	for (std::map<wchar_t, int>::const_iterator it = wchs.begin(); it != wchs.end(); ++ it) {
-		if (it->second > max_loop) {
-			wch = it->first;
-			max_loop = it->second;
+	uint32_t end = SDL_GetTicks();
+	if (used_ticks) {
+		// one Run for all chars, distribute it evenly. remainder goes to first chars.
+		const uint32_t used = end - start;
+		used_ticks->resize(batch, used / batch);
+		for (int at = 0; at < (int)(used % batch); at ++) {
+			(*used_ticks)[at] ++;
 		}
 	}
 
-	uint32_t end = SDL_GetTicks();
+	return result;
+}
+
+// if fail return 0.
+wchar_t inference_char(tsession& current_session, const std::string& pb_path, cv::Mat& src2, uint32_t* used_ticks)
+{
+	std::vector<uint32_t> ticks;
+	std::vector<wchar_t> wchs = inference_chars(current_session, pb_path, std::vector<cv::Mat>(1, src2), used_ticks? &ticks: nullptr);
+	if (wchs.empty()) {
+		return 0;
+	}
 	if (used_ticks) {
-		*used_ticks = end - start;
+		*used_ticks = ticks[0];
 	}
-
-	return wch;
+	return wchs[0];
 }
 
-}
\ No newline at end of file
+}
@@ -43,6 +43,8 @@ void tensorflow_link_ops_function_ops();
 void tensorflow_link_ops_functional_ops();
 void tensorflow_link_common_runtime_direct_session();
 void tensorflow_link_common_runtime_threadpool_device_factory();
+void tensorflow_link_kernels_immutable_constant_op();
+void tensorflow_link_kernels_fused_conv_bias_op();
 
 // Call tensorflow_link_modules in game_instance::app_tensorflow_link.
 inline void tensorflow_link_modules()
@@ -89,6 +91,8 @@ inline void tensorflow_link_modules()
 	tensorflow_link_ops_functional_ops();
 	tensorflow_link_common_runtime_direct_session();
 	tensorflow_link_common_runtime_threadpool_device_factory();
+	tensorflow_link_kernels_immutable_constant_op();
+	tensorflow_link_kernels_fused_conv_bias_op();
 }
 
 #endif
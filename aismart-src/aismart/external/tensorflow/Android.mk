@@ -204,6 +204,8 @@ LOCAL_SRC_FILES +=  \
 	$(SUB_PATH)/kernels/strided_slice_op_inst_5.cc \
 	$(SUB_PATH)/kernels/strided_slice_op_inst_6.cc \
 	$(SUB_PATH)/kernels/strided_slice_op_inst_7.cc \
+	$(SUB_PATH)/kernels/immutable_constant_op.cc \
+	$(SUB_PATH)/kernels/fused_conv_bias_op.cc \
 	$(SUB_PATH)/ops/array_ops.cc \
 	$(SUB_PATH)/ops/data_flow_ops.cc \
 	$(SUB_PATH)/ops/function_ops.cc \
@@ -103,3 +103,5 @@ constexpr char const* ImmutableConstantOp::kMemoryRegionNameAttr;
 REGISTER_KERNEL_BUILDER(Name("ImmutableConst").Device(DEVICE_CPU),
                         ImmutableConstantOp);
 }  // namespace tensorflow
+
+void tensorflow_link_kernels_immutable_constant_op() {}
\ No newline at end of file
@@ -29,7 +29,9 @@
 #include "gui/dialogs/chat.hpp"
 #include "gui/widgets/window.hpp"
 #include "ble.hpp"
+#include "events.hpp"
 #include "theme.hpp"
+#include "image.hpp"
 
 #ifdef WEBRTC_ANDROID
 #include "webrtc/modules/utility/include/jvm_android.h"
@@ -473,7 +475,10 @@ void base_instance::handle_app_event(Uint32 type)
 		}
 
 	} else if (type == SDL_APP_LOWMEMORY) {
-		posix_print("handle_app_event, SDL_APP_LOWMEMORY\n");
+		const image::tcache_stats surfaces = image::surface_cache_stats();
+		const image::tcache_stats textures = image::texture_cache_stats();
+		posix_print("handle_app_event, SDL_APP_LOWMEMORY, surface cache: %i items, %u bytes, texture cache: %i items, %u bytes\n",
+			surfaces.items, (unsigned)surfaces.bytes, textures.items, (unsigned)textures.bytes);
 		app_lowmemory();
 	}
 }
@@ -766,6 +771,8 @@ void base_instance::initialize()
 	if (!res) {
 		throw twml_exception("could not initialize fonts");
 	}
+	// repeated characters are composed from cached glyphs instead of rendered per string.
+	font::set_glyph_atlas(true);
 
 	res = init_language();
 	if (!res) {
@@ -853,6 +860,12 @@ tlobby* base_instance::create_lobby()
 	return new tlobby(new tlobby::tchat_sock(), new tlobby::thttp_sock(), new tlobby::ttransit_sock());
 }
 
+void rtc::SDLSocketServer::WakeUp()
+{
+	PhysicalSocketServer::WakeUp();
+	events::wakeup();
+}
+
 void base_instance::pump()
 {
 	sdl_thread_.pump();
@@ -39,6 +39,14 @@ class tchat_;
 }
 
 namespace rtc {
+// socket server of SDLThread. main thread waits in SDL's event queue, not in it,
+// so wake up SDL's wait when message is posted or sent to SDLThread.
+class SDLSocketServer : public PhysicalSocketServer
+{
+public:
+	void WakeUp() override;
+};
+
 // SDLThread. Automatically pumps wakeup and IO messages.
 
 class SDLThread : public Thread
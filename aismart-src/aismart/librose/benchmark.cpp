@@ -0,0 +1,111 @@
+#define GETTEXT_DOMAIN "rose-lib"
+
+#include "benchmark.hpp"
+#include "wml_exception.hpp"
+
+#include <SDL_timer.h>
+#include "webrtc/base/json.h"
+
+#include <algorithm>
+
+std::atomic<int64_t> tbenchmark::allocations_(0);
+std::atomic<bool> tbenchmark::allocations_counted_(false);
+
+tbenchmark::tscope::tscope(tbenchmark& benchmark, const std::string& stage)
+	: benchmark_(benchmark)
+	, stage_(stage)
+	, start_(SDL_GetPerformanceCounter())
+	, start_allocations_(tbenchmark::allocations())
+{
+}
+
+tbenchmark::tscope::~tscope()
+{
+	const uint64_t end = SDL_GetPerformanceCounter();
+	const int64_t end_allocations = tbenchmark::allocations();
+	const double ms = (end - start_) * 1000.0 / SDL_GetPerformanceFrequency();
+	benchmark_.add(stage_, tsample(ms, start_allocations_ >= 0? end_allocations - start_allocations_: -1));
+}
+
+void tbenchmark::add(const std::string& stage, const tsample& sample)
+{
+	std::map<std::string, std::vector<tsample> >::iterator it = samples_.find(stage);
+	if (it == samples_.end()) {
+		stages_.push_back(stage);
+		it = samples_.insert(std::make_pair(stage, std::vector<tsample>())).first;
+	}
+	it->second.push_back(sample);
+}
+
+// nearest-rank percentile of sorted values.
+static double percentile(const std::vector<double>& sorted, int percent)
+{
+	const int rank = (int)((percent * sorted.size() + 99) / 100);
+	return sorted[rank > 0? rank - 1: 0];
+}
+
+tbenchmark::treport tbenchmark::report(const std::string& stage) const
+{
+	treport result;
+	std::map<std::string, std::vector<tsample> >::const_iterator it = samples_.find(stage);
+	if (it == samples_.end() || it->second.empty()) {
+		return result;
+	}
+
+	std::vector<double> ms;
+	double total_ms = 0;
+	int64_t total_allocations = 0;
+	bool allocations_counted = true;
+	for (std::vector<tsample>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++ it2) {
+		ms.push_back(it2->ms);
+		total_ms += it2->ms;
+		if (it2->allocations >= 0) {
+			total_allocations += it2->allocations;
+		} else {
+			allocations_counted = false;
+		}
+	}
+	std::sort(ms.begin(), ms.end());
+
+	result.count = ms.size();
+	result.p50_ms = percentile(ms, 50);
+	result.p99_ms = percentile(ms, 99);
+	result.mean_ms = total_ms / result.count;
+	result.max_ms = ms.back();
+	result.fps = total_ms > 0? result.count * 1000.0 / total_ms: 0;
+	if (allocations_counted) {
+		result.allocations_per_run = (double)total_allocations / result.count;
+	}
+	return result;
+}
+
+std::string tbenchmark::to_json(const std::map<std::string, std::string>& meta) const
+{
+	Json::Value root;
+	Json::Value& jmeta = root["meta"];
+	for (std::map<std::string, std::string>::const_iterator it = meta.begin(); it != meta.end(); ++ it) {
+		jmeta[it->first] = it->second;
+	}
+
+	Json::Value& jstages = root["stages"];
+	for (std::vector<std::string>::const_iterator it = stages_.begin(); it != stages_.end(); ++ it) {
+		const treport r = report(*it);
+		Json::Value jstage;
+		jstage["name"] = *it;
+		jstage["count"] = r.count;
+		jstage["p50_ms"] = r.p50_ms;
+		jstage["p99_ms"] = r.p99_ms;
+		jstage["mean_ms"] = r.mean_ms;
+		jstage["max_ms"] = r.max_ms;
+		jstage["fps"] = r.fps;
+		if (r.allocations_per_run >= 0) {
+			jstage["allocations_per_run"] = r.allocations_per_run;
+		} else {
+			jstage["allocations_per_run"] = Json::Value();
+		}
+		jstages.append(jstage);
+	}
+
+	Json::StyledWriter writer;
+	return writer.write(root);
+}
@@ -0,0 +1,81 @@
+#ifndef LIBROSE_BENCHMARK_HPP_INCLUDED
+#define LIBROSE_BENCHMARK_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <stdint.h>
+
+//
+// collect per-stage latency and allocations, report p50/p99/throughput as json.
+// allocations are counted only when application replaces operator new and calls count_allocation.
+//
+class tbenchmark
+{
+public:
+	struct tsample
+	{
+		tsample(double ms, int64_t allocations)
+			: ms(ms)
+			, allocations(allocations)
+		{}
+
+		double ms;
+		int64_t allocations; // -1: not counted
+	};
+
+	struct treport
+	{
+		treport()
+			: count(0)
+			, p50_ms(0)
+			, p99_ms(0)
+			, mean_ms(0)
+			, max_ms(0)
+			, fps(0)
+			, allocations_per_run(-1)
+		{}
+
+		int count;
+		double p50_ms;
+		double p99_ms;
+		double mean_ms;
+		double max_ms;
+		double fps; // runs per second when stage runs back to back.
+		double allocations_per_run; // -1: not counted
+	};
+
+	class tscope
+	{
+	public:
+		tscope(tbenchmark& benchmark, const std::string& stage);
+		~tscope();
+
+	private:
+		tbenchmark& benchmark_;
+		const std::string stage_;
+		uint64_t start_;
+		int64_t start_allocations_;
+	};
+
+	// called by replaced operator new.
+	static void count_allocation() { allocations_ ++; allocations_counted_ = true; }
+	static int64_t allocations() { return allocations_counted_? allocations_.load(): -1; }
+
+	void add(const std::string& stage, const tsample& sample);
+	treport report(const std::string& stage) const;
+	const std::vector<std::string>& stages() const { return stages_; }
+
+	// meta is written into "meta" object as is.
+	std::string to_json(const std::map<std::string, std::string>& meta) const;
+
+private:
+	static std::atomic<int64_t> allocations_;
+	static std::atomic<bool> allocations_counted_;
+
+	std::vector<std::string> stages_; // in first add order.
+	std::map<std::string, std::vector<tsample> > samples_;
+};
+
+#endif
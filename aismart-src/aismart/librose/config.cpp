@@ -26,10 +26,14 @@
 #include "util.hpp"
 #include "utils/const_clone.tpp"
 #include "wml_exception.hpp"
+#include "thread.hpp"
 
 #include <cstdlib>
 #include <cstring>
 #include <deque>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
 #include <boost/foreach.hpp>
 #include <boost/variant.hpp>
@@ -60,7 +64,7 @@ struct tconfig_implementation
 		assert(parent[parent.size() - 1] == ']');
 
 		if(config->has_child(key)) {
-			return *(config->children.find(key)->second.front());
+			return *(config->find_group(config::find_atom(key))->list.front());
 		}
 
 		/**
@@ -123,6 +127,23 @@ config::attribute_value &config::attribute_value::operator=(const config::attrib
 	return *this;
 }
 
+config::attribute_value::attribute_value(config::attribute_value &&that) BOOST_NOEXCEPT
+	: value_(std::move(that.value_))
+#ifdef VERBOSE_CONFIG
+	, verbose_(std::move(that.verbose_))
+#endif
+{
+}
+
+config::attribute_value &config::attribute_value::operator=(config::attribute_value &&that) BOOST_NOEXCEPT
+{
+	value_ = std::move(that.value_);
+#ifdef VERBOSE_CONFIG
+	verbose_ = std::move(that.verbose_);
+#endif
+	return *this;
+}
+
 config::attribute_value &config::attribute_value::operator=(bool v)
 {
 #ifdef VERBOSE_CONFIG
@@ -443,6 +464,226 @@ void config::check_valid(const config &cfg) const
 	VALIDATE(*this && cfg, "Mandatory WML child missing yet untested for. Please report.");
 }
 
+namespace {
+
+/**
+ * Global table of interned keys. Names are kept in fixed size chunks,
+ * so a name never moves and atom_name needs no lock.
+ *
+ * Key --> atom is an open addressing hash index. Readers don't lock: a slot is
+ * published by a release store after its name, and when index grows, the bigger
+ * copy is published while the old one is kept alive for readers still in it.
+ * Only intern of a new key locks.
+ */
+class atom_table
+{
+public:
+	enum { chunk_bits = 10, chunk_size = 1 << chunk_bits, max_chunks = 4096 };
+
+	atom_table()
+		: mutex_()
+		, index_(nullptr)
+		, retired_()
+		, size_(0)
+	{
+		memset(chunks_, 0, sizeof(chunks_));
+		index_.store(new tindex(1024), std::memory_order_release);
+	}
+
+	uint32_t intern(const std::string& key)
+	{
+		const uint32_t hash = hash_key(key);
+		int atom = find(*index_.load(std::memory_order_acquire), key, hash);
+		if (atom != -1) {
+			return atom;
+		}
+
+		threading::lock lock(mutex_);
+		// other thread maybe interned it after above find.
+		tindex* index = index_.load(std::memory_order_relaxed);
+		atom = find(*index, key, hash);
+		if (atom != -1) {
+			return atom;
+		}
+
+		const uint32_t result = size_;
+		VALIDATE((result >> chunk_bits) < max_chunks, "Too many WML keys.");
+		std::string*& chunk = chunks_[result >> chunk_bits];
+		if (!chunk) {
+			chunk = new std::string[chunk_size];
+		}
+		chunk[result & (chunk_size - 1)] = key;
+		size_ ++;
+
+		const uint64_t slot = ((uint64_t)hash << 32) | (result + 1);
+		if (size_ * 2 > index->mask + 1) {
+			// keep load factor below 1/2, so probe is short and always ends at an empty slot.
+			tindex* bigger = new tindex((index->mask + 1) * 2);
+			for (uint32_t at = 0; at <= index->mask; at ++) {
+				const uint64_t existed = index->slots[at].load(std::memory_order_relaxed);
+				if (existed) {
+					insert(*bigger, existed);
+				}
+			}
+			insert(*bigger, slot);
+			index_.store(bigger, std::memory_order_release);
+			retired_.push_back(std::unique_ptr<tindex>(index));
+		} else {
+			insert(*index, slot);
+		}
+		return result;
+	}
+
+	int find(const std::string& key) const
+	{
+		return find(*index_.load(std::memory_order_acquire), key, hash_key(key));
+	}
+
+	const std::string& name(uint32_t atom) const
+	{
+		return chunks_[atom >> chunk_bits][atom & (chunk_size - 1)];
+	}
+
+private:
+	// slot is (hash << 32) | (atom + 1), 0 is empty.
+	struct tindex
+	{
+		explicit tindex(uint32_t size)
+			: mask(size - 1)
+			, slots(new std::atomic<uint64_t>[size])
+		{
+			for (uint32_t at = 0; at < size; at ++) {
+				slots[at].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		const uint32_t mask;
+		std::unique_ptr<std::atomic<uint64_t>[]> slots;
+	};
+
+	static uint32_t hash_key(const std::string& key)
+	{
+		// FNV-1a
+		uint32_t hash = 2166136261u;
+		for (std::string::const_iterator it = key.begin(); it != key.end(); ++ it) {
+			hash = (hash ^ (uint8_t)*it) * 16777619u;
+		}
+		return hash;
+	}
+
+	int find(const tindex& index, const std::string& key, uint32_t hash) const
+	{
+		for (uint32_t at = hash & index.mask; ; at = (at + 1) & index.mask) {
+			const uint64_t slot = index.slots[at].load(std::memory_order_acquire);
+			if (!slot) {
+				return -1;
+			}
+			const uint32_t atom = (uint32_t)slot - 1;
+			if ((uint32_t)(slot >> 32) == hash && name(atom) == key) {
+				return atom;
+			}
+		}
+	}
+
+	// only called with mutex_ held.
+	static void insert(tindex& index, uint64_t slot)
+	{
+		for (uint32_t at = (uint32_t)(slot >> 32) & index.mask; ; at = (at + 1) & index.mask) {
+			if (!index.slots[at].load(std::memory_order_relaxed)) {
+				index.slots[at].store(slot, std::memory_order_release);
+				return;
+			}
+		}
+	}
+
+private:
+	threading::mutex mutex_;
+	std::atomic<tindex*> index_;
+	// smaller indexes replaced by index_, readers maybe still in them.
+	std::vector<std::unique_ptr<tindex> > retired_;
+	std::string* chunks_[max_chunks];
+	uint32_t size_;
+};
+
+// function static, config maybe used during static initialization.
+atom_table& atoms()
+{
+	static atom_table table;
+	return table;
+}
+
+}
+
+uint32_t config::atom(const std::string& key)
+{
+	return atoms().intern(key);
+}
+
+int config::find_atom(const std::string& key)
+{
+	return atoms().find(key);
+}
+
+const std::string& config::atom_name(uint32_t atom)
+{
+	return atoms().name(atom);
+}
+
+static bool attribute_less(const config::attribute& a, const std::string& key)
+{
+	return a.first < key;
+}
+
+int config::attribute_index(const std::string& key) const
+{
+	// attributes are sorted by key.
+	const attribute_map::const_iterator it = std::lower_bound(values.begin(), values.end(), key, attribute_less);
+	return it != values.end() && it->first == key? it - values.begin(): -1;
+}
+
+config::attribute_value& config::attribute_by_key(const std::string& key)
+{
+	// Keep attributes sorted by key, iteration and writers depend on it.
+	attribute_map::iterator it = std::lower_bound(values.begin(), values.end(), key, attribute_less);
+	if (it == values.end() || it->first != key) {
+		it = values.insert(it, attribute(key, attribute_value()));
+	}
+	return it->second;
+}
+
+const config::child_group* config::find_group(int atom) const
+{
+	if (atom < 0) {
+		return NULL;
+	}
+	for (child_map::const_iterator i = children.begin(); i != children.end(); ++i) {
+		if (i->atom == (uint32_t)atom) {
+			return &*i;
+		}
+	}
+	return NULL;
+}
+
+config::child_group& config::group(uint32_t atom, const std::string& key)
+{
+	if (child_group* g = find_group(atom)) {
+		return *g;
+	}
+	// Keep groups sorted by key, as std::map did.
+	child_map::iterator i = children.begin();
+	for (; i != children.end(); ++i) {
+		if (key < atom_name(i->atom)) break;
+	}
+	return *children.insert(i, child_group(atom));
+}
+
+config& config::push_child(uint32_t atom, const std::string& key, config* cfg)
+{
+	group(atom, key).list.push_back(cfg);
+	ordered_children.push_back(child_pos(atom, cfg));
+	return *cfg;
+}
+
 config::config() : values(), children(), ordered_children()
 {
 }
@@ -470,7 +711,7 @@ config& config::operator=(const config& cfg)
 
 	clear();
 	append_children(cfg);
-	values.insert(cfg.values.begin(), cfg.values.end());
+	values = cfg.values;
 	return *this;
 }
 
@@ -493,15 +734,15 @@ config &config::operator=(config &&cfg)
 bool config::has_attribute(const std::string &key) const
 {
 	check_valid();
-	return values.find(key) != values.end();
+	return !values.empty() && attribute_index(key) != -1;
 }
 
 bool config::has_old_attribute(const std::string &key, const std::string &old_key, const std::string& msg) const
 {
 	check_valid();
-	if (values.find(key) != values.end()) {
+	if (has_attribute(key)) {
 		return true;
-	} else if (values.find(old_key) != values.end()) {
+	} else if (has_attribute(old_key)) {
 		if (!msg.empty())
 			lg::wml_error << msg;
 		return true;
@@ -513,23 +754,27 @@ bool config::has_old_attribute(const std::string &key, const std::string &old_ke
 void config::remove_attribute(const std::string &key)
 {
 	check_valid();
-	values.erase(key);
+	if (values.empty()) return;
+	const int index = attribute_index(key);
+	if (index != -1) {
+		values.erase(values.begin() + index);
+	}
 }
 
 void config::append_children(const config &cfg)
 {
 	check_valid(cfg);
 
-	BOOST_FOREACH(const any_child &value, cfg.all_children_range()) {
-		add_child(value.key, value.cfg);
+	BOOST_FOREACH(const child_pos &pos, cfg.ordered_children) {
+		push_child(pos.atom, atom_name(pos.atom), new config(*pos.cfg));
 	}
 }
 
 void config::append(const config &cfg)
 {
 	append_children(cfg);
-	BOOST_FOREACH(const attribute &v, cfg.values) {
-		values[v.first] = v.second;
+	for (size_t i = 0; i < cfg.values.size(); ++i) {
+		attribute_by_key(cfg.values[i].first) = cfg.values[i].second;
 	}
 }
 
@@ -576,10 +821,11 @@ config::child_itors config::child_range(const std::string& key)
 {
 	check_valid();
 
-	child_map::iterator i = children.find(key);
 	static child_list dummy;
 	child_list *p = &dummy;
-	if (i != children.end()) p = &i->second;
+	if (!children.empty()) {
+		if (child_group* g = find_group(find_atom(key))) p = &g->list;
+	}
 	return child_itors(child_iterator(p->begin()), child_iterator(p->end()));
 }
 
@@ -587,10 +833,11 @@ config::const_child_itors config::child_range(const std::string& key) const
 {
 	check_valid();
 
-	child_map::const_iterator i = children.find(key);
 	static child_list dummy;
 	const child_list *p = &dummy;
-	if (i != children.end()) p = &i->second;
+	if (!children.empty()) {
+		if (const child_group* g = find_group(find_atom(key))) p = &g->list;
+	}
 	return const_child_itors(const_child_iterator(p->begin()), const_child_iterator(p->end()));
 }
 
@@ -598,39 +845,37 @@ unsigned config::child_count(const std::string &key) const
 {
 	check_valid();
 
-	child_map::const_iterator i = children.find(key);
-	if(i != children.end()) {
-		return i->second.size();
-	}
-	return 0;
+	if (children.empty()) return 0;
+	const child_group* g = find_group(find_atom(key));
+	return g ? g->list.size() : 0;
 }
 
 bool config::has_child(const std::string &key) const
 {
 	check_valid();
 
-	return children.find(key) != children.end();
+	return !children.empty() && find_group(find_atom(key)) != NULL;
 }
 
 config &config::child(const std::string& key, int n)
 {
 	check_valid();
 
-	const child_map::const_iterator i = children.find(key);
-	if (i == children.end()) {
-		DBG_CF << "The config object has no child named »"
-				<< key << "«.\n";
+	const child_group* g = children.empty() ? NULL : find_group(find_atom(key));
+	if (!g) {
+		DBG_CF << "The config object has no child named "
+				<< key << ".\n";
 
 		return invalid;
 	}
 
-	if (n < 0) n = i->second.size() + n;
-	if(size_t(n) < i->second.size()) {
-		return *i->second[n];
+	if (n < 0) n = g->list.size() + n;
+	if(size_t(n) < g->list.size()) {
+		return *g->list[n];
 	} else {
-		DBG_CF << "The config object has only »" << i->second.size()
-			<< "« children named »" << key
-			<< "«; request for the index »" << n << "« cannot be honored.\n";
+		DBG_CF << "The config object has only " << g->list.size()
+			<< " children named " << key
+			<< "; request for the index " << n << " cannot be honored.\n";
 
 		return invalid;
 	}
@@ -653,18 +898,18 @@ const config & config::child_or_empty(const std::string& key) const
 	static const config empty_cfg;
 	check_valid();
 
-	child_map::const_iterator i = children.find(key);
-	if (i != children.end() && !i->second.empty())
-		return *i->second.front();
+	const child_group* g = children.empty() ? NULL : find_group(find_atom(key));
+	if (g && !g->list.empty())
+		return *g->list.front();
 
 	return empty_cfg;
 }
 
 config &config::child_or_add(const std::string &key)
 {
-	child_map::const_iterator i = children.find(key);
-	if (i != children.end() && !i->second.empty())
-		return *i->second.front();
+	const child_group* g = children.empty() ? NULL : find_group(find_atom(key));
+	if (g && !g->list.empty())
+		return *g->list.front();
 
 	return add_child(key);
 }
@@ -673,20 +918,14 @@ config& config::add_child(const std::string& key)
 {
 	check_valid();
 
-	child_list& v = children[key];
-	v.push_back(new config());
-	ordered_children.push_back(child_pos(children.find(key),v.size()-1));
-	return *v.back();
+	return push_child(atom(key), key, new config());
 }
 
 config& config::add_child(const std::string& key, const config& val)
 {
 	check_valid(val);
 
-	child_list& v = children[key];
-	v.push_back(new config(val));
-	ordered_children.push_back(child_pos(children.find(key),v.size()-1));
-	return *v.back();
+	return push_child(atom(key), key, new config(val));
 }
 
 #ifdef HAVE_CXX11
@@ -694,10 +933,7 @@ config &config::add_child(const std::string &key, config &&val)
 {
 	check_valid(val);
 
-	child_list &v = children[key];
-	v.push_back(new config(std::move(val)));
-	ordered_children.push_back(child_pos(children.find(key), v.size() - 1));
-	return *v.back();
+	return push_child(atom(key), key, new config(std::move(val)));
 }
 #endif
 
@@ -705,45 +941,36 @@ config &config::add_child_at(const std::string &key, const config &val, unsigned
 {
 	check_valid(val);
 
-	child_list& v = children[key];
+	const uint32_t a = atom(key);
+	child_list& v = group(a, key).list;
 	if(index > v.size()) {
 		throw error("illegal index to add child at");
 	}
 
-	v.insert(v.begin()+index,new config(val));
-
-	bool inserted = false;
-
-	const child_pos value(children.find(key),index);
+	// Ordered position is the one of child currently at index.
+	const config* next = index < v.size() ? v[index] : NULL;
+	config* cfg = new config(val);
+	v.insert(v.begin() + index, cfg);
 
 	std::vector<child_pos>::iterator ord = ordered_children.begin();
 	for(; ord != ordered_children.end(); ++ord) {
-		if (ord->pos != value.pos) continue;
-		if (!inserted && ord->index == index) {
-			ord = ordered_children.insert(ord,value);
-			inserted = true;
-		} else if (ord->index >= index) {
-			ord->index++;
-		}
-	}
-
-	if(!inserted) {
-		ordered_children.push_back(value);
+		if (ord->cfg == next) break;
 	}
+	ordered_children.insert(ord, child_pos(a, cfg));
 
-	return *v[index];
+	return *cfg;
 }
 
 namespace {
 
 struct remove_ordered
 {
-	remove_ordered(const config::child_map::iterator &iter) : iter_(iter) {}
+	remove_ordered(uint32_t atom) : atom_(atom) {}
 
 	bool operator()(const config::child_pos &pos) const
-	{ return pos.pos == iter_; }
+	{ return pos.atom == atom_; }
 private:
-	config::child_map::iterator iter_;
+	uint32_t atom_;
 };
 
 }
@@ -752,39 +979,40 @@ void config::clear_children(const std::string& key)
 {
 	check_valid();
 
-	child_map::iterator i = children.find(key);
-	if (i == children.end()) return;
+	child_group* g = children.empty() ? NULL : find_group(find_atom(key));
+	if (!g) return;
 
 	ordered_children.erase(std::remove_if(ordered_children.begin(),
-		ordered_children.end(), remove_ordered(i)), ordered_children.end());
+		ordered_children.end(), remove_ordered(g->atom)), ordered_children.end());
 
-	BOOST_FOREACH(config *c, i->second) {
+	BOOST_FOREACH(config *c, g->list) {
 		delete c;
 	}
 
-	children.erase(i);
+	children.erase(children.begin() + (g - &children.front()));
 }
 
 void config::splice_children(config &src, const std::string &key)
 {
 	check_valid(src);
 
-	child_map::iterator i_src = src.children.find(key);
-	if (i_src == src.children.end()) return;
+	child_group* g_src = src.children.empty() ? NULL : src.find_group(find_atom(key));
+	if (!g_src) return;
 
+	const uint32_t a = g_src->atom;
 	src.ordered_children.erase(std::remove_if(src.ordered_children.begin(),
-		src.ordered_children.end(), remove_ordered(i_src)),
+		src.ordered_children.end(), remove_ordered(a)),
 		src.ordered_children.end());
 
-	child_list &dst = children[key];
-	child_map::iterator i_dst = children.find(key);
-	unsigned before = dst.size();
-	dst.insert(dst.end(), i_src->second.begin(), i_src->second.end());
-	src.children.erase(i_src);
-	// key might be a reference to i_src->first, so it is no longer usable.
+	child_list moved;
+	moved.swap(g_src->list);
+	src.children.erase(src.children.begin() + (g_src - &src.children.front()));
+	// key might be a reference to a name of src, use interned name.
 
-	for (unsigned j = before; j < dst.size(); ++j) {
-		ordered_children.push_back(child_pos(i_dst, j));
+	child_list &dst = group(a, atom_name(a)).list;
+	dst.insert(dst.end(), moved.begin(), moved.end());
+	BOOST_FOREACH(config *c, moved) {
+		ordered_children.push_back(child_pos(a, c));
 	}
 }
 
@@ -792,7 +1020,7 @@ void config::recursive_clear_value(const std::string& key)
 {
 	check_valid();
 
-	values.erase(key);
+	remove_attribute(key);
 
 	BOOST_FOREACH(const any_child &value, all_children_range()) {
 		const_cast<config *>(&value.cfg)->recursive_clear_value(key);
@@ -800,53 +1028,45 @@ void config::recursive_clear_value(const std::string& key)
 }
 
 std::vector<config::child_pos>::iterator config::remove_child(
-	const child_map::iterator &pos, unsigned index)
+	std::vector<child_pos>::iterator pos)
 {
-	/* Find the position with the correct index and decrement all the
-	   indices in the ordering that are above this index. */
-	unsigned found = 0;
-	BOOST_FOREACH(child_pos &p, ordered_children)
-	{
-		if (p.pos != pos) continue;
-		if (p.index == index)
-			found = &p - &ordered_children.front();
-		else if (p.index > index)
-			--p.index;
-	}
-
-	// Remove from the child map.
-	delete pos->second[index];
-	pos->second.erase(pos->second.begin() + index);
+	// Remove from the child group.
+	child_list& v = find_group(pos->atom)->list;
+	v.erase(std::find(v.begin(), v.end(), pos->cfg));
+	delete pos->cfg;
 
 	// Erase from the ordering and return the next position.
-	return ordered_children.erase(ordered_children.begin() + found);
+	return ordered_children.erase(pos);
 }
 
 config::all_children_iterator config::erase(const config::all_children_iterator& i)
 {
-	return all_children_iterator(remove_child(i.i_->pos, i.i_->index));
+	return all_children_iterator(remove_child(ordered_children.begin() + (i.i_ - ordered_children.begin())));
 }
 
 void config::remove_child(const std::string &key, unsigned index)
 {
 	check_valid();
 
-	child_map::iterator i = children.find(key);
-	if (i == children.end() || index >= i->second.size()) {
+	const child_group* g = children.empty() ? NULL : find_group(find_atom(key));
+	if (!g || index >= g->list.size()) {
 		ERR_CF << "Error: attempting to delete non-existing child: "
 			<< key << "[" << index << "]\n";
 		return;
 	}
 
-	remove_child(i, index);
+	const config* cfg = g->list[index];
+	std::vector<child_pos>::iterator ord = ordered_children.begin();
+	for (; ord->cfg != cfg; ++ord) {}
+	remove_child(ord);
 }
 
 const config::attribute_value &config::operator[](const std::string &key) const
 {
 	check_valid();
 
-	const attribute_map::const_iterator i = values.find(key);
-	if (i != values.end()) return i->second;
+	const attribute_value* v = get(key);
+	if (v) return *v;
 	static const attribute_value empty_attribute;
 	return empty_attribute;
 }
@@ -854,29 +1074,30 @@ const config::attribute_value &config::operator[](const std::string &key) const
 const config::attribute_value *config::get(const std::string &key) const
 {
 	check_valid();
-	attribute_map::const_iterator i = values.find(key);
-	return i != values.end() ? &i->second : NULL;
+	if (values.empty()) return NULL;
+	const int i = attribute_index(key);
+	return i != -1 ? &values[i].second : NULL;
 }
 
 config::attribute_value &config::operator[](const std::string &key)
 {
 	check_valid();
-	return values[key];
+	return attribute_by_key(key);
 }
 
 const config::attribute_value &config::get_old_attribute(const std::string &key, const std::string &old_key, const std::string &msg) const
 {
 	check_valid();
 
-	attribute_map::const_iterator i = values.find(key);
-	if (i != values.end())
-		return i->second;
+	const attribute_value* v = get(key);
+	if (v)
+		return *v;
 
-	i = values.find(old_key);
-	if (i != values.end()) {
+	v = get(old_key);
+	if (v) {
 		if (!msg.empty())
 			lg::wml_error << msg;
-		return i->second;
+		return *v;
 	}
 
 	static const attribute_value empty_attribute;
@@ -889,14 +1110,16 @@ void config::merge_attributes(const config &cfg)
 	check_valid(cfg);
 
 	assert(this != &cfg);
-	BOOST_FOREACH(const attribute &v, cfg.values) {
+	for (size_t i = 0; i < cfg.values.size(); ++i) {
+		const attribute &v = cfg.values[i];
 
-		std::string key = v.first;
-		if (key.substr(0,7) == "add_to_") {
+		const std::string& key = v.first;
+		if (key.compare(0, 7, "add_to_") == 0) {
 			std::string add_to = key.substr(7);
-			values[add_to] = values[add_to].to_int() + v.second.to_int();
+			attribute_value& a = (*this)[add_to];
+			a = a.to_int() + v.second.to_int();
 		} else
-			values[v.first] = v.second;
+			attribute_by_key(key) = v.second;
 	}
 }
 
@@ -931,94 +1154,53 @@ config &config::find_child(const std::string &key, const std::string &name,
 {
 	check_valid();
 
-	const child_map::iterator i = children.find(key);
-	if(i == children.end()) {
-		DBG_CF << "Key »" << name << "« value »" << value
-				<< "« pair not found as child of key »" << key << "«.\n";
+	child_group* g = children.empty() ? NULL : find_group(find_atom(key));
+	if(!g) {
+		DBG_CF << "Key " << name << " value " << value
+				<< " pair not found as child of key " << key << ".\n";
 
 		return invalid;
 	}
 
-	const child_list::iterator j = std::find_if(i->second.begin(),
-	                                            i->second.end(),
+	const child_list::iterator j = std::find_if(g->list.begin(),
+	                                            g->list.end(),
 	                                            config_has_value(name,value));
-	if(j != i->second.end()) {
+	if(j != g->list.end()) {
 		return **j;
 	} else {
-		DBG_CF << "Key »" << name << "« value »" << value
-				<< "« pair not found as child of key »" << key << "«.\n";
+		DBG_CF << "Key " << name << " value " << value
+				<< " pair not found as child of key " << key << ".\n";
 
 		return invalid;
 	}
 }
 
-namespace {
-	/**
-	 * Helper struct for iterative config clearing.
-	 */
-	struct config_clear_state
-	{
-		config_clear_state()
-			: c(NULL)
-			, mi()
-			, vi(0)
-		{
-		}
-
-		config* c; //the config being inspected
-		config::child_map::iterator mi; //current child map entry
-		size_t vi; //index into the child map item vector
-	};
-}
-
 void config::clear()
 {
 	// No validity check for this function.
 
-	if (!children.empty()) {
-		//start with this node, the first entry in the child map,
-		//zeroeth element in that entry
-		config_clear_state init;
-		init.c = this;
-		init.mi = children.begin();
-		init.vi = 0;
-		std::deque<config_clear_state> l;
-		l.push_back(init);
-
-		while (!l.empty()) {
-			config_clear_state& state = l.back();
-			if (state.mi != state.c->children.end()) {
-				std::vector<config*>& v = state.mi->second;
-				if (state.vi < v.size()) {
-					config* c = v[state.vi];
-					++state.vi;
-					if (c->children.empty()) {
-						delete c; //special case for a slight speed increase?
-					} else {
-						//descend to the next level
-						config_clear_state next;
-						next.c = c;
-						next.mi = c->children.begin();
-						next.vi = 0;
-						l.push_back(next);
-					}
-				} else {
-					state.vi = 0;
-					++state.mi;
-				}
-			} else {
-				//reached end of child map for this element - all child nodes
-				//have been deleted, so it's safe to clear the map, delete the
-				//node and move up one level
-				state.c->children.clear();
-				if (state.c != this) delete state.c;
-				l.pop_back();
+	if (!ordered_children.empty()) {
+		// Delete iteratively, deep trees would overflow the stack.
+		std::vector<config*> pending;
+		BOOST_FOREACH(const child_pos &pos, ordered_children) {
+			pending.push_back(pos.cfg);
+		}
+		ordered_children.clear();
+
+		while (!pending.empty()) {
+			config* c = pending.back();
+			pending.pop_back();
+			BOOST_FOREACH(const child_pos &pos, c->ordered_children) {
+				pending.push_back(pos.cfg);
 			}
+			c->ordered_children.clear();
+			c->children.clear();
+			delete c;
 		}
 	}
 
+	children.clear();
 	values.clear();
-	ordered_children.clear();
 }
 
 bool config::empty() const
@@ -1030,7 +1212,7 @@ bool config::empty() const
 
 config::all_children_iterator::reference config::all_children_iterator::operator*() const
 {
-	return any_child(&i_->pos->first, i_->pos->second[i_->index]);
+	return any_child(&atom_name(i_->atom), i_->cfg);
 }
 
 config::all_children_iterator config::ordered_begin() const
@@ -1068,8 +1250,8 @@ void config::get_diff(const config& c, config& res) const
 
 	attribute_map::const_iterator i;
 	for(i = values.begin(); i != values.end(); ++i) {
-		const attribute_map::const_iterator j = c.values.find(i->first);
-		if(j == c.values.end() || (i->second != j->second && i->second != "")) {
+		const attribute_value* j = c.get(i->first);
+		if(j == NULL || (i->second != *j && i->second != "")) {
 			if(inserts == NULL) {
 				inserts = &res.add_child("insert");
 			}
@@ -1081,8 +1263,8 @@ void config::get_diff(const config& c, config& res) const
 	config* deletes = NULL;
 
 	for(i = c.values.begin(); i != c.values.end(); ++i) {
-		const attribute_map::const_iterator itor = values.find(i->first);
-		if(itor == values.end() || itor->second == "") {
+		const attribute_value* itor = get(i->first);
+		if(itor == NULL || *itor == "") {
 			if(deletes == NULL) {
 				deletes = &res.add_child("delete");
 			}
@@ -1091,29 +1273,30 @@ void config::get_diff(const config& c, config& res) const
 		}
 	}
 
-	std::vector<std::string> entities;
+	std::vector<uint32_t> entities;
 
 	child_map::const_iterator ci;
 	for(ci = children.begin(); ci != children.end(); ++ci) {
-		entities.push_back(ci->first);
+		entities.push_back(ci->atom);
 	}
 
 	for(ci = c.children.begin(); ci != c.children.end(); ++ci) {
-		if(children.count(ci->first) == 0) {
-			entities.push_back(ci->first);
+		if(find_group(ci->atom) == NULL) {
+			entities.push_back(ci->atom);
 		}
 	}
 
-	for(std::vector<std::string>::const_iterator itor = entities.begin(); itor != entities.end(); ++itor) {
+	for(std::vector<uint32_t>::const_iterator itor = entities.begin(); itor != entities.end(); ++itor) {
 
-		const child_map::const_iterator itor_a = children.find(*itor);
-		const child_map::const_iterator itor_b = c.children.find(*itor);
+		const child_group* itor_a = find_group(*itor);
+		const child_group* itor_b = c.find_group(*itor);
+		const std::string& key = atom_name(*itor);
 
 		static const child_list dummy;
 
 		// Get the two child lists. 'b' has to be modified to look like 'a'.
-		const child_list& a = itor_a != children.end() ? itor_a->second : dummy;
-		const child_list& b = itor_b != c.children.end() ? itor_b->second : dummy;
+		const child_list& a = itor_a != NULL ? itor_a->list : dummy;
+		const child_list& b = itor_b != NULL ? itor_b->list : dummy;
 
 		size_t ndeletes = 0;
 		size_t ai = 0, bi = 0;
@@ -1132,8 +1315,8 @@ void config::get_diff(const config& c, config& res) const
 				if(b.size() - bi > a.size() - ai) {
 					config& new_delete = res.add_child("delete_child");
 					buf << bi - ndeletes;
-					new_delete.values["index"] = buf.str();
-					new_delete.add_child(*itor);
+					new_delete["index"] = buf.str();
+					new_delete.add_child(key);
 
 					++ndeletes;
 					++bi;
@@ -1144,8 +1327,8 @@ void config::get_diff(const config& c, config& res) const
 				else if(b.size() - bi < a.size() - ai) {
 					config& new_insert = res.add_child("insert_child");
 					buf << ai;
-					new_insert.values["index"] = buf.str();
-					new_insert.add_child(*itor,*a[ai]);
+					new_insert["index"] = buf.str();
+					new_insert.add_child(key,*a[ai]);
 
 					++ai;
 				}
@@ -1155,8 +1338,8 @@ void config::get_diff(const config& c, config& res) const
 				else {
 					config& new_change = res.add_child("change_child");
 					buf << bi;
-					new_change.values["index"] = buf.str();
-					new_change.add_child(*itor,a[ai]->get_diff(*b[bi]));
+					new_change["index"] = buf.str();
+					new_change.add_child(key,a[ai]->get_diff(*b[bi]));
 
 					++ai;
 					++bi;
@@ -1170,17 +1353,17 @@ void config::apply_diff(const config& diff, bool track /* = false */)
 {
 	check_valid(diff);
 
-	if (track) values[diff_track_attribute] = "modified";
+	if (track) (*this)[diff_track_attribute] = "modified";
 
 	if (const config &inserts = diff.child("insert")) {
 		BOOST_FOREACH(const attribute &v, inserts.attribute_range()) {
-			values[v.first] = v.second;
+			(*this)[v.first] = v.second;
 		}
 	}
 
 	if (const config &deletes = diff.child("delete")) {
 		BOOST_FOREACH(const attribute &v, deletes.attribute_range()) {
-			values.erase(v.first);
+			remove_attribute(v.first);
 		}
 	}
 
@@ -1193,12 +1376,12 @@ void config::apply_diff(const config& diff, bool track /* = false */)
 				continue;
 			}
 
-			const child_map::iterator itor = children.find(item.key);
-			if(itor == children.end() || index >= itor->second.size()) {
+			const child_group* itor = find_group(find_atom(item.key));
+			if(itor == NULL || index >= itor->list.size()) {
 				throw error("error in diff: could not find element '" + item.key + "'");
 			}
 
-			itor->second[index]->apply_diff(item.cfg, track);
+			itor->list[index]->apply_diff(item.cfg, track);
 		}
 	}
 
@@ -1218,11 +1401,11 @@ void config::apply_diff(const config& diff, bool track /* = false */)
 			if (!track) {
 				remove_child(item.key, index);
 			} else {
-				const child_map::iterator itor = children.find(item.key);
-				if(itor == children.end() || index >= itor->second.size()) {
+				const child_group* itor = find_group(find_atom(item.key));
+				if(itor == NULL || index >= itor->list.size()) {
 					throw error("error in diff: could not find element '" + item.key + "'");
 				}
-				itor->second[index]->values[diff_track_attribute] = "deleted";
+				(*itor->list[index])[diff_track_attribute] = "deleted";
 			}
 		}
 	}
@@ -1248,12 +1431,12 @@ void config::clear_diff_track(const config& diff)
 				continue;
 			}
 
-			const child_map::iterator itor = children.find(item.key);
-			if(itor == children.end() || index >= itor->second.size()) {
+			const child_group* itor = find_group(find_atom(item.key));
+			if(itor == NULL || index >= itor->list.size()) {
 				throw error("error in diff: could not find element '" + item.key + "'");
 			}
 
-			itor->second[index]->clear_diff_track(item.cfg);
+			itor->list[index]->clear_diff_track(item.cfg);
 		}
 	}
 	BOOST_FOREACH(const any_child &value, all_children_range()) {
@@ -1268,8 +1451,8 @@ void config::merge_with(const config& c)
 {
 	check_valid(c);
 
-	std::vector<child_pos> to_remove;
-	std::map<std::string, unsigned> visitations;
+	std::vector<config*> to_remove;
+	std::map<uint32_t, unsigned> visitations;
 
 	// Merge attributes first
 	merge_attributes(c);
@@ -1277,37 +1460,34 @@ void config::merge_with(const config& c)
 	// Now merge shared tags
 	all_children_iterator::Itor i, i_end = ordered_children.end();
 	for(i = ordered_children.begin(); i != i_end; ++i) {
-		const std::string& tag = i->pos->first;
-		const child_map::const_iterator j = c.children.find(tag);
-		if (j != c.children.end()) {
-			unsigned &visits = visitations[tag];
-			if(visits < j->second.size()) {
+		const child_group* j = c.find_group(i->atom);
+		if (j != NULL) {
+			unsigned &visits = visitations[i->atom];
+			if(visits < j->list.size()) {
 				// Get a const config so we do not add attributes.
-				const config & merge_child = *j->second[visits++];
+				const config & merge_child = *j->list[visits++];
 
 				if ( merge_child["__remove"].to_bool() ) {
-					to_remove.push_back(*i);
+					to_remove.push_back(i->cfg);
 				} else
-					(i->pos->second[i->index])->merge_with(merge_child);
+					i->cfg->merge_with(merge_child);
 			}
 		}
 	}
 
 	// Now add any unvisited tags
 	for(child_map::const_iterator j = c.children.begin(); j != c.children.end(); ++j) {
-		const std::string& tag = j->first;
-		unsigned &visits = visitations[tag];
-		while(visits < j->second.size()) {
-			add_child(tag, *j->second[visits++]);
+		unsigned &visits = visitations[j->atom];
+		while(visits < j->list.size()) {
+			push_child(j->atom, atom_name(j->atom), new config(*j->list[visits++]));
 		}
 	}
 
 	// Remove those marked so
-	std::map<std::string, unsigned> removals;
-	BOOST_FOREACH(const child_pos& pos, to_remove) {
-		const std::string& tag = pos.pos->first;
-		unsigned &removes = removals[tag];
-		remove_child(tag, pos.index - removes++);
+	BOOST_FOREACH(const config* cfg, to_remove) {
+		std::vector<child_pos>::iterator ord = ordered_children.begin();
+		for (; ord->cfg != cfg; ++ord) {}
+		remove_child(ord);
 	}
 
 }
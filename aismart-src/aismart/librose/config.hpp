@@ -114,8 +114,29 @@ public:
 	{ return this != &invalid ? &safe_bool_impl::nonnull : NULL; }
 #endif
 
+	/**
+	 * Keys are interned into a global table, an atom is the index of a key in it.
+	 * Atoms and names live until exit, so key can be compared by atom and
+	 * the reference returned by atom_name is always valid. They are thread safe,
+	 * find_atom and atom_name never lock, atom locks only when key is new.
+	 * Attributes are not interned, they are looked up by key.
+	 */
+	static uint32_t atom(const std::string& key);
+	/** Returns -1 if @a key was never interned, so no config has it. */
+	static int find_atom(const std::string& key);
+	static const std::string& atom_name(uint32_t atom);
+
 	typedef std::vector<config*> child_list;
-	typedef std::map<std::string,child_list> child_map;
+
+	/** Children with same key. */
+	struct child_group
+	{
+		child_group(uint32_t atom) : atom(atom), list() {}
+		uint32_t atom;
+		child_list list;
+	};
+	/** Sorted by key. */
+	typedef std::vector<child_group> child_map;
 
 	struct const_child_iterator;
 
@@ -247,6 +268,9 @@ public:
 		attribute_value(const attribute_value &);
 		/// Default implementation, but defined out-of-line for efficiency reasons.
 		attribute_value &operator=(const attribute_value &);
+		/// Attributes are kept in a vector, it must not copy them when it grows.
+		attribute_value(attribute_value &&) BOOST_NOEXCEPT;
+		attribute_value &operator=(attribute_value &&) BOOST_NOEXCEPT;
 
 		// Numeric assignments:
 		attribute_value &operator=(bool v);
@@ -305,8 +329,9 @@ public:
 		static const std::string s_true, s_false;
 	};
 
-	typedef std::map<std::string, attribute_value> attribute_map;
-	typedef attribute_map::value_type attribute;
+	typedef std::pair<std::string, attribute_value> attribute;
+	/** Sorted by key, lookup is binary search. */
+	typedef std::vector<attribute> attribute_map;
 
 	struct const_attribute_iterator
 	{
@@ -486,19 +511,19 @@ public:
 
 	struct child_pos
 	{
-		child_pos(child_map::iterator p, unsigned i) : pos(p), index(i) {}
-		child_map::iterator pos;
-		unsigned index;
+		child_pos(uint32_t a, config* c) : atom(a), cfg(c) {}
+		uint32_t atom;
+		config* cfg;
 
-		bool operator==(const child_pos& o) const { return pos == o.pos && index == o.index; }
+		bool operator==(const child_pos& o) const { return cfg == o.cfg; }
 		bool operator!=(const child_pos& o) const { return !operator==(o); }
 	};
 
 	struct any_child
 	{
-		const child_map::key_type &key;
+		const std::string &key;
 		const config &cfg;
-		any_child(const child_map::key_type *k, const config *c): key(*k), cfg(*c) {}
+		any_child(const std::string *k, const config *c): key(*k), cfg(*c) {}
 	};
 
 	struct all_children_iterator
@@ -618,9 +643,20 @@ public:
 
 private:
 	/**
-	 * Removes the child at position @a pos of @a l.
+	 * Removes the child at position @a pos of ordered_children.
 	 */
-	std::vector<child_pos>::iterator remove_child(const child_map::iterator &l, unsigned pos);
+	std::vector<child_pos>::iterator remove_child(std::vector<child_pos>::iterator pos);
+
+	/** Returns index of attribute, or -1 if it does not exist. */
+	int attribute_index(const std::string& key) const;
+	/** Returns attribute, inserts an empty one at sorted position if it does not exist. */
+	attribute_value& attribute_by_key(const std::string& key);
+
+	const child_group* find_group(int atom) const;
+	child_group* find_group(int atom)
+	{ return const_cast<child_group*>(const_cast<const config*>(this)->find_group(atom)); }
+	child_group& group(uint32_t atom, const std::string& key);
+	config& push_child(uint32_t atom, const std::string& key, config* cfg);
 
 	/** All the attributes of this node. */
 	attribute_map values;
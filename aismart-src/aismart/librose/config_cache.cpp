@@ -237,6 +237,7 @@ void teditor_::wml2bin_desc::refresh_checksum(const std::string& working_dir)
 #define BASENAME_LANGUAGE	"language.bin"
 
 // file processor function only support prefixed with game_config::path.
+// while locked, directories are preprocessed in parallel, and expansions of unchanged files are reused.
 int teditor_::tres_path_lock::deep = 0;
 teditor_::tres_path_lock::tres_path_lock(teditor_& o)
 	: original_(game_config::path)
@@ -244,10 +245,12 @@ teditor_::tres_path_lock::tres_path_lock(teditor_& o)
 	VALIDATE(!deep, null_str);
 	deep ++;
 	game_config::path = o.working_dir_;
+	set_preprocessor_cache_dir(get_user_data_dir() + "/cache/preprocessor");
 }
 
 teditor_::tres_path_lock::~tres_path_lock()
 {
+	set_preprocessor_cache_dir(null_str);
 	game_config::path = original_;
 	deep --;
 }
@@ -2689,6 +2689,20 @@ void display::draw_window_anim()
 	drawing_buffer_commit(video().getTexture(), clip_rect_commit());
 }
 
+bool display::window_anim_running() const
+{
+	if (area_anims_.empty() || in_theme()) {
+		return false;
+	}
+	for (std::map<int, animation*>::const_iterator it = area_anims_.begin(); it != area_anims_.end(); ++ it) {
+		const animation& anim = *it->second;
+		if (anim.type() == anim_window && anim.started()) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void display::undraw_window_anim()
 {
 	if (area_anims_.empty() || in_theme()) {
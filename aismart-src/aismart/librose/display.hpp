@@ -529,6 +529,8 @@ public:
 	void clear_area_anims();
 	void draw_window_anim();
 	void undraw_window_anim();
+	// there is window animation that requires drawing every frame.
+	bool window_anim_running() const;
 
 	gui2::tdialog* get_theme() { return dlg_; }
 	gui2::twidget* get_theme_object(const std::string& id) const ;
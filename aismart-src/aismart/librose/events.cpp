@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <utility>
 #include <iomanip>
+#include <atomic>
 
 struct tevents_context
 {
@@ -478,7 +479,58 @@ void dump_events(const std::vector<SDL_Event>& events)
 	posix_print("%s\n", ss.str().c_str());
 }
 
-void pump()
+// there is WAKEUP_EVENT in queue, don't push more.
+static std::atomic<bool> wakeup_pending(false);
+static uint32_t wakeup_ticks = 0;
+
+void wakeup()
+{
+	if (wakeup_pending.exchange(true)) {
+		return;
+	}
+
+	SDL_Event event;
+	event.type = WAKEUP_EVENT;
+	event.user.type = WAKEUP_EVENT;
+	event.user.code = 0;
+	event.user.data1 = NULL;
+	event.user.data2 = NULL;
+	SDL_PushEvent(&event);
+}
+
+void require_wakeup(uint32_t ticks)
+{
+	if (!wakeup_ticks || ticks < wakeup_ticks) {
+		wakeup_ticks = ticks;
+	}
+}
+
+bool wait(int timeout)
+{
+	const uint32_t now = SDL_GetTicks();
+	if (longpress_event.timestamp) {
+		const int remain = longpress_event.timestamp + gui2::settings::longpress_time - now;
+		timeout = std::min(timeout, std::max(remain, 0));
+	}
+	if (wakeup_ticks) {
+		const int remain = wakeup_ticks - now;
+		timeout = std::min(timeout, std::max(remain, 0));
+		wakeup_ticks = 0;
+	}
+	// posted messages wake by socket server, delayed messages require timeout.
+	const int rtc_delay = instance->sdl_thread().GetDelay();
+	if (rtc_delay >= 0) {
+		timeout = std::min(timeout, rtc_delay);
+	}
+
+	if (timeout <= 0) {
+		return SDL_HasEvents(SDL_FIRSTEVENT, SDL_LASTEVENT) == SDL_TRUE;
+	}
+	// NULL event: don't remove it from queue, pump will process it.
+	return SDL_WaitEventTimeout(NULL, timeout) == 1;
+}
+
+int pump()
 {
 	if (instance->terminating()) {
 		// let main thread throw quit exception.
@@ -492,6 +544,11 @@ void pump()
 	std::vector<SDL_Event> events;
 	// ignore user input events when receive SDL_WINDOWEVENT. include before and after.
 	while (SDL_PollEvent(&temp_event)) {
+		if (temp_event.type == WAKEUP_EVENT) {
+			// it only makes wait return.
+			wakeup_pending = false;
+			continue;
+		}
 		++ poll_count;
 		if (!begin_ignoring && temp_event.type == SDL_WINDOWEVENT) {
 			begin_ignoring = poll_count;
@@ -626,6 +683,7 @@ void pump()
 	for (size_t i1 = 0, i2 = pump_monitors.size(); i1 != i2 && i1 < pump_monitors.size(); ++i1) {
 		pump_monitors[i1]->monitor_process();
 	}
+	return events.size();
 }
 
 int discard(Uint32 event_mask_min, Uint32 event_mask_max)
@@ -23,6 +23,8 @@
 // our user-defined timer event type
 #define SDL_LONGPRESS	SDL_USEREVENT
 #define TIMER_EVENT		(SDL_USEREVENT + 1)
+// pushed by wakeup, pump drops it.
+#define WAKEUP_EVENT	(SDL_USEREVENT + 2)
 
 enum HOTKEY_COMMAND {
 	HOTKEY_NULL,
@@ -132,7 +134,19 @@ namespace events
 {
 
 //causes events to be dispatched to all handler objects.
-void pump();
+//return count of dispatched events.
+int pump();
+
+// let main thread return from wait. it can be called from any thread.
+void wakeup();
+
+// next wait of main thread must return at ticks. it is valid for next wait only,
+// state that is polled during draw should require again after every draw.
+void require_wakeup(uint32_t ticks);
+
+// block main thread until there is event, or timeout(millisecond) elapsed.
+// it returns early when longpress, require_wakeup or rtc's delayed message is due.
+bool wait(int timeout);
 
 class pump_monitor {
 //pump_monitors receive notifcation after an events::pump() occurs
@@ -41,6 +41,7 @@
 #include <list>
 #include <set>
 #include <stack>
+#include <unordered_map>
 
 static lg::log_domain log_font("font");
 #define DBG_FT LOG_STREAM(debug, log_font)
@@ -152,11 +153,37 @@ struct char_block_map
 
 static char_block_map char_blocks;
 
-//cache sizes of small text
-typedef std::map<std::string,SDL_Rect> line_size_cache_map;
+//cache sizes of small text, key is (style, size, line).
+struct line_size_key
+{
+	line_size_key(const std::string& line, int font_size, int style)
+		: line(line)
+		, font_size(font_size)
+		, style(style)
+	{}
 
-//map of styles -> sizes -> cache
-static std::map<int,std::map<int,line_size_cache_map> > line_size_cache;
+	bool operator==(const line_size_key& that) const
+	{
+		return font_size == that.font_size && style == that.style && line == that.line;
+	}
+
+	std::string line;
+	int font_size;
+	int style;
+};
+
+struct line_size_key_hash
+{
+	size_t operator()(const line_size_key& key) const
+	{
+		return std::hash<std::string>()(key.line) ^ (key.font_size << 8) ^ key.style;
+	}
+};
+
+typedef std::unordered_map<line_size_key, SDL_Rect, line_size_key_hash> line_size_cache_map;
+static line_size_cache_map line_size_cache;
+// sizes are small, but texts such as chat message are different each time.
+static const size_t max_line_size_cache = 8192;
 
 #define is_unprintable_wchar(ch)	((ch) < 0x20 && (ch) != '\t')
 #define is_unprintable_uchar(ch)	((ch) < 0x20 && (ch) != '\t')
@@ -262,6 +289,10 @@ static TTF_Font* get_font(font_id id)
 	return font;
 }
 
+namespace font {
+static void clear_text_caches();
+}
+
 static void clear_fonts()
 {
 	for(std::map<font_id,TTF_Font*>::iterator i = font_table.begin(); i != font_table.end(); ++i) {
@@ -272,6 +303,7 @@ static void clear_fonts()
 	font_names.clear();
 	char_blocks.cbmap.clear();
 	line_size_cache.clear();
+	font::clear_text_caches();
 }
 
 struct font_style_setter
@@ -435,11 +467,16 @@ public:
 	}
 	bool operator!=(text_surface const &t) const { return !operator==(t); }
 
+	size_t hash_value() const { return hash_; }
+	// bytes of rendered surfaces, 0 before get_surfaces.
+	size_t bytes() const;
+
 private:
 	void hash();
+	surface render_glyphs(TTF_Font* ttfont, const text_chunk& chunk) const;
 
 private:
-	int hash_;
+	size_t hash_;
 	int font_size_;
 	SDL_Color color_;
 	int style_;
@@ -468,11 +505,17 @@ text_surface::text_surface(std::string const &str, int size,
 
 void text_surface::hash()
 {
-	int h = 0;
-	for (std::string::const_iterator it = str_.begin(), it_end = str_.end(); it != it_end; ++it) {
-		h = ((h << 9) | (h >> (sizeof(int) * 8 - 9))) ^ (*it);
+	const uint32_t color = (color_.a << 24) | (color_.r << 16) | (color_.g << 8) | color_.b;
+	hash_ = std::hash<std::string>()(str_) ^ (font_size_ << 4) ^ style_ ^ (color * 31);
+}
+
+size_t text_surface::bytes() const
+{
+	size_t ret = 0;
+	for (std::vector<surface>::const_iterator it = surfs_.begin(); it != surfs_.end(); ++ it) {
+		ret += (*it)->w * (*it)->h * 4;
 	}
-	hash_ = h;
+	return ret;
 }
 
 void text_surface::measure() const
@@ -517,6 +560,109 @@ size_t text_surface::height() const
 	return h_;
 }
 
+// glyph atlas. glyph is rendered once in white, key is (subset, size, style, ch),
+// text is composed from glyphs with color, so repeated characters aren't rendered again.
+static bool glyph_atlas = false;
+static std::unordered_map<uint64_t, surface> glyph_cache;
+static size_t glyph_cache_bytes = 0;
+static const size_t max_glyph_cache_bytes = 4 * 1024 * 1024;
+
+static surface get_glyph(TTF_Font* ttfont, const font_id& id, int style, Uint16 ch)
+{
+	const uint64_t key = ((uint64_t)(style & 0xff) << 48) | ((uint64_t)(id.size & 0xffff) << 32) | ((id.subset & 0xffff) << 16) | ch;
+	std::unordered_map<uint64_t, surface>::const_iterator it = glyph_cache.find(key);
+	if (it != glyph_cache.end()) {
+		return it->second;
+	}
+
+	const SDL_Color white = {0xff, 0xff, 0xff, 0xff};
+	surface surf(TTF_RenderGlyph_Blended(ttfont, ch, white));
+	if (surf.null()) {
+		return surf;
+	}
+	if (glyph_cache_bytes + surf->w * surf->h * 4 > max_glyph_cache_bytes) {
+		glyph_cache.clear();
+		glyph_cache_bytes = 0;
+	}
+	glyph_cache.insert(std::make_pair(key, surf));
+	glyph_cache_bytes += surf->w * surf->h * 4;
+	return surf;
+}
+
+// return null surface if chunk can not be composed from glyphs, caller should render it normally.
+surface text_surface::render_glyphs(TTF_Font* ttfont, const text_chunk& chunk) const
+{
+	if (!glyph_atlas || (style_ & (TTF_STYLE_UNDERLINE | TTF_STYLE_STRIKETHROUGH))) {
+		return surface();
+	}
+
+	std::vector<Uint16> chars;
+	for (utils::utf8_iterator it(chunk.text), end = utils::utf8_iterator::end(chunk.text); it != end; ++ it) {
+		const wchar_t ch = *it;
+		if (ch > 0xffff || !TTF_GlyphIsProvided(ttfont, ch)) {
+			return surface();
+		}
+		chars.push_back(ch);
+	}
+
+	int w, h;
+	if (chars.empty() || TTF_SizeUTF8(ttfont, chunk.text.c_str(), &w, &h) || !w || !h) {
+		return surface();
+	}
+	surface ret = create_neutral_surface(w, h);
+	if (ret.null()) {
+		return ret;
+	}
+
+	const bool kerning = TTF_GetFontKerning(ttfont) != 0;
+	const int ascent = TTF_FontAscent(ttfont);
+	const font_id id(chunk.subset, font_size_);
+	const Uint32 rgb = (color_.r << 16) | (color_.g << 8) | color_.b;
+	int pen = 0;
+	{
+		surface_lock dst_lock(ret);
+		Uint32* dst_pixels = dst_lock.pixels();
+		for (size_t n = 0; n < chars.size(); n ++) {
+			const Uint16 ch = chars[n];
+			int minx, maxx, miny, maxy, advance;
+			if (TTF_GlyphMetrics(ttfont, ch, &minx, &maxx, &miny, &maxy, &advance)) {
+				return surface();
+			}
+			if (kerning && n) {
+				pen += TTF_GetFontKerningSizeGlyphs(ttfont, chars[n - 1], ch);
+			}
+			const surface glyph = get_glyph(ttfont, id, style_, ch);
+			if (glyph.null()) {
+				return surface();
+			}
+
+			// same placement as TTF_RenderUTF8_Blended(2.0.14): glyph surface's left is at pen + minx,
+			// and its top row is maxy, that is ascent - maxy below top of line.
+			const int xorigin = pen + minx;
+			const int yorigin = ascent - maxy;
+			const_surface_lock src_lock(glyph);
+			const Uint32* src_pixels = src_lock.pixels();
+			const int src_stride = glyph->pitch / 4;
+			for (int y = std::max(0, -yorigin); y < glyph->h && yorigin + y < h; y ++) {
+				for (int x = std::max(0, -xorigin); x < glyph->w && xorigin + x < w; x ++) {
+					// like TTF_RenderUTF8_Blended, alpha is glyph's coverage, color_.a is not applied.
+					const Uint32 alpha = src_pixels[y * src_stride + x] >> 24;
+					if (!alpha) {
+						continue;
+					}
+					// glyphs of same color may overlap, keep opaquer one.
+					Uint32& dst = dst_pixels[(yorigin + y) * w + xorigin + x];
+					if (alpha > (dst >> 24)) {
+						dst = (alpha << 24) | rgb;
+					}
+				}
+			}
+			pen += advance;
+		}
+	}
+	return ret;
+}
+
 std::vector<surface> const &text_surface::get_surfaces() const
 {
 	if (initialized_) {
@@ -538,7 +684,10 @@ std::vector<surface> const &text_surface::get_surfaces() const
 			continue;
 		font_style_setter const style_setter(ttfont, style_);
 
-		surface s = surface(TTF_RenderUTF8_Blended(ttfont, chunk.text.c_str(), color_));
+		surface s = render_glyphs(ttfont, chunk);
+		if (s.null()) {
+			s = surface(TTF_RenderUTF8_Blended(ttfont, chunk.text.c_str(), color_));
+		}
 		if (!s.null()) {
 			surfs_.push_back(s);
 		}
@@ -549,46 +698,202 @@ std::vector<surface> const &text_surface::get_surfaces() const
 
 namespace font {
 
+//
+// rendered text_surface, most recently used is at front. lookup is by hash, and total bytes of surfaces
+// is limited by budget instead of count, so many short labels don't evict each other.
+//
 class text_cache
 {
 public:
 	static text_surface &find(text_surface const &t);
-	static void resize(unsigned int size);
+	static void set_budget(size_t bytes);
+	static void clear();
+
 private:
-	typedef std::list< text_surface > text_list;
+	struct tentry
+	{
+		tentry(const text_surface& surf)
+			: surf(surf)
+			, bytes(0)
+		{}
+
+		text_surface surf;
+		size_t bytes;
+	};
+	typedef std::list<tentry> text_list;
+
+	// key points to surf of list's node, node isn't moved by splice.
+	struct tkey_hash
+	{
+		size_t operator()(const text_surface* t) const { return t->hash_value(); }
+	};
+	struct tkey_equal
+	{
+		bool operator()(const text_surface* a, const text_surface* b) const { return *a == *b; }
+	};
+	typedef std::unordered_map<const text_surface*, text_list::iterator, tkey_hash, tkey_equal> tindex;
+
+	static void trim();
+
 	static text_list cache_;
-	static unsigned int max_size_;
+	static tindex index_;
+	static size_t bytes_;
+	static size_t budget_;
 };
 
 text_cache::text_list text_cache::cache_;
-unsigned int text_cache::max_size_ = 50;
+text_cache::tindex text_cache::index_;
+size_t text_cache::bytes_ = 0;
+size_t text_cache::budget_ = 4 * 1024 * 1024;
 
-void text_cache::resize(unsigned int size)
+void text_cache::set_budget(size_t bytes)
 {
-	DBG_FT << "Text cache: resize from: " << max_size_ << " to: "
-		<< size << " items in cache: " << cache_.size() << '\n';
+	DBG_FT << "Text cache: budget from: " << budget_ << " to: "
+		<< bytes << " bytes in cache: " << bytes_ << '\n';
+
+	budget_ = bytes;
+	trim();
+}
 
-	while(size < cache_.size()) {
+void text_cache::clear()
+{
+	index_.clear();
+	cache_.clear();
+	bytes_ = 0;
+}
+
+void text_cache::trim()
+{
+	// keep front, it is being returned.
+	while (bytes_ > budget_ && cache_.size() > 1) {
+		const tentry& back = cache_.back();
+		bytes_ -= back.bytes;
+		index_.erase(&back.surf);
 		cache_.pop_back();
 	}
-	max_size_ = size;
 }
 
-
 text_surface &text_cache::find(text_surface const &t)
 {
-	text_list::iterator it_bgn = cache_.begin(), it_end = cache_.end();
-	text_list::iterator it = std::find(it_bgn, it_end, t);
-	if (it != it_end) {
-		cache_.splice(it_bgn, cache_, it);
+	tindex::iterator it = index_.find(&t);
+	if (it != index_.end()) {
+		cache_.splice(cache_.begin(), cache_, it->second);
+		return cache_.front().surf;
+	}
+
+	cache_.push_front(tentry(t));
+	tentry& entry = cache_.front();
+	index_.insert(std::make_pair(&entry.surf, cache_.begin()));
+
+	entry.surf.get_surfaces();
+	entry.bytes = entry.surf.bytes();
+	bytes_ += entry.bytes;
+	trim();
+
+	return entry.surf;
+}
+
+//
+// surfaces of get_rendered_text, and sizes of get_rendered_text_size. key includes maximum width,
+// so multi-line text isn't laid out again by tintegrate. text that has animation isn't cached,
+// and editable text isn't cached, tintegrate keeps state for it.
+//
+struct rendered_key
+{
+	rendered_key(const std::string& text, int maximum_width, int font_size, const SDL_Color& color)
+		: text(text)
+		, maximum_width(maximum_width)
+		, font_size(font_size)
+		, color((color.a << 24) | (color.r << 16) | (color.g << 8) | color.b)
+	{}
+
+	bool operator==(const rendered_key& that) const
+	{
+		return maximum_width == that.maximum_width && font_size == that.font_size && color == that.color && text == that.text;
+	}
+
+	std::string text;
+	int maximum_width;
+	int font_size;
+	uint32_t color;
+};
+
+struct rendered_key_hash
+{
+	size_t operator()(const rendered_key& key) const
+	{
+		return std::hash<std::string>()(key.text) ^ ((size_t)key.maximum_width * 31) ^ (key.font_size << 8) ^ key.color;
+	}
+};
+
+struct rendered_value
+{
+	rendered_value(const surface& surf, const tpoint& size)
+		: surf(surf)
+		, size(size)
+	{}
+
+	surface surf;
+	tpoint size;
+};
+
+typedef std::list<std::pair<rendered_key, rendered_value> > rendered_list;
+static rendered_list rendered_cache;
+static std::unordered_map<rendered_key, rendered_list::iterator, rendered_key_hash> rendered_index;
+static size_t rendered_bytes = 0;
+static size_t rendered_budget = 4 * 1024 * 1024;
+
+static size_t rendered_surface_bytes(const surface& surf)
+{
+	return surf.null()? 0: surf->w * surf->h * 4;
+}
+
+static void trim_rendered_cache()
+{
+	while (rendered_bytes > rendered_budget && !rendered_cache.empty()) {
+		const std::pair<rendered_key, rendered_value>& back = rendered_cache.back();
+		rendered_bytes -= rendered_surface_bytes(back.second.surf);
+		rendered_index.erase(back.first);
+		rendered_cache.pop_back();
+	}
+}
+
+static rendered_value* find_rendered(const rendered_key& key)
+{
+	std::unordered_map<rendered_key, rendered_list::iterator, rendered_key_hash>::iterator it = rendered_index.find(key);
+	if (it == rendered_index.end()) {
+		return NULL;
+	}
+	rendered_cache.splice(rendered_cache.begin(), rendered_cache, it->second);
+	return &rendered_cache.front().second;
+}
+
+static void insert_rendered(const rendered_key& key, const surface& surf, const tpoint& size)
+{
+	rendered_value* value = find_rendered(key);
+	if (value) {
+		rendered_bytes += rendered_surface_bytes(surf) - rendered_surface_bytes(value->surf);
+		value->surf = surf;
+		value->size = size;
+
 	} else {
-		if (cache_.size() >= max_size_) {
-			cache_.pop_back();
-		}
-		cache_.push_front(t);
+		rendered_cache.push_front(std::make_pair(key, rendered_value(surf, size)));
+		rendered_index.insert(std::make_pair(key, rendered_cache.begin()));
+		rendered_bytes += rendered_surface_bytes(surf);
 	}
+	trim_rendered_cache();
+}
+
+static void clear_text_caches()
+{
+	text_cache::clear();
 
-	return cache_.front();
+	rendered_index.clear();
+	rendered_cache.clear();
+	rendered_bytes = 0;
+
+	glyph_cache.clear();
+	glyph_cache_bytes = 0;
 }
 
 surface get_rendered_text(const std::string& text, int maximum_width, int font_size, const SDL_Color& color, bool editable)
@@ -602,8 +907,20 @@ surface get_rendered_text(const std::string& text, int maximum_width, int font_s
 			maximum_width = INT32_MAX;
 		}
 
+		const rendered_key key(text, maximum_width, font_size, color);
+		if (!editable) {
+			const rendered_value* value = find_rendered(key);
+			if (value && !value->surf.null()) {
+				return value->surf;
+			}
+		}
+
 		tintegrate integrate(text, maximum_width, font_size, color, editable, false);
-		return integrate.get_surface();
+		surface surf = integrate.get_surface();
+		if (!editable && !integrate.exist_anim()) {
+			insert_rendered(key, surf, integrate.get_size());
+		}
+		return surf;
 	}
 	catch (utils::invalid_utf8_exception&) {
 		// Invalid UTF-8 string
@@ -618,10 +935,22 @@ tpoint get_rendered_text_size(const std::string& text, int maximum_width, int fo
 		return tpoint(0, 0);
 	}
 	try {
+		const rendered_key key(text, maximum_width, font_size, color);
+		if (!editable) {
+			const rendered_value* value = find_rendered(key);
+			if (value) {
+				return value->size;
+			}
+		}
+
 		tintegrate integrate(text, maximum_width, font_size, color, editable, false);
 		tpoint size = integrate.get_size();
 
 		VALIDATE(size.x <= maximum_width, null_str);
+		if (!editable && !integrate.exist_anim()) {
+			// surface is rendered when get_rendered_text requires it.
+			insert_rendered(key, surface(), size);
+		}
 
 		return size;
 	}
@@ -719,10 +1048,9 @@ int line_minus1_width(const std::string& text, int font_size, int style)
 
 SDL_Rect line_size(const std::string& line, int font_size, int style)
 {
-	line_size_cache_map& cache = line_size_cache[style][font_size];
-
-	const line_size_cache_map::const_iterator i = cache.find(line);
-	if (i != cache.end()) {
+	line_size_key key(line, font_size, style);
+	const line_size_cache_map::const_iterator i = line_size_cache.find(key);
+	if (i != line_size_cache.end()) {
 		return i->second;
 	}
 
@@ -735,7 +1063,10 @@ SDL_Rect line_size(const std::string& line, int font_size, int style)
 	res.h = s.height();
 	res.x = res.y = 0;
 
-	cache.insert(std::pair<std::string,SDL_Rect>(line,res));
+	if (line_size_cache.size() >= max_line_size_cache) {
+		line_size_cache.clear();
+	}
+	line_size_cache.insert(std::make_pair(key, res));
 	return res;
 }
 
@@ -1157,10 +1488,23 @@ bool load_font_config()
 void cache_mode(CACHE mode)
 {
 	if(mode == CACHE_LOBBY) {
-		text_cache::resize(1000);
+		text_cache::set_budget(16 * 1024 * 1024);
+		rendered_budget = 16 * 1024 * 1024;
 	} else {
-		text_cache::resize(50);
+		text_cache::set_budget(4 * 1024 * 1024);
+		rendered_budget = 4 * 1024 * 1024;
+	}
+	trim_rendered_cache();
+}
+
+void set_glyph_atlas(bool enable)
+{
+	if (enable == glyph_atlas) {
+		return;
 	}
+	glyph_atlas = enable;
+	// rendered surfaces may be different a little, don't mix them.
+	clear_text_caches();
 }
 
 
@@ -202,8 +202,13 @@ void undraw_floating_labels();
 bool load_font_config();
 
 enum CACHE { CACHE_LOBBY, CACHE_GAME };
+// lobby mode has larger byte budget of text caches.
 void cache_mode(CACHE mode);
 
+// compose text from cached glyphs instead of rendering whole string by SDL_ttf.
+// only for characters in BMP, and not for underline/strikethrough style. default is false.
+void set_glyph_atlas(bool enable);
+
 }
 
 #define font_min_relative_size	(font::default_relative_size - 5)
@@ -36,16 +36,73 @@ map_formula_callable::map_formula_callable(
     	const formula_callable* fallback) :
 	formula_callable(false),
 	values_(),
+	slot_values_(),
+	slot_exists_(),
+	stamp_(next_stamp()),
 	fallback_(fallback)
 {}
 
+uint64_t map_formula_callable::next_stamp()
+{
+	static uint64_t stamp = 0;
+	return ++ stamp;
+}
+
+// scalar only, callable/list/map maybe changed inside even if they are equal.
+static bool same_scalar_variant(const variant& a, const variant& b)
+{
+	if (a.is_int() && b.is_int()) {
+		return a.as_int() == b.as_int();
+	} else if (a.is_string() && b.is_string()) {
+		return a.as_string() == b.as_string();
+	} else if (a.is_null() && b.is_null()) {
+		return true;
+	}
+	return false;
+}
+
 map_formula_callable& map_formula_callable::add(const std::string& key,
                                                 const variant& value)
 {
-	values_[key] = value;
+	// slot maybe registered after last add, so always set it.
+	set_slot_value(key, value);
+
+	std::map<std::string, variant>::iterator it = values_.find(key);
+	if (it != values_.end()) {
+		if (same_scalar_variant(it->second, value)) {
+			// keep stamp, so memoized results of formulas are still valid.
+			return *this;
+		}
+		it->second = value;
+	} else {
+		values_.insert(std::make_pair(key, value));
+	}
+	stamp_ = next_stamp();
 	return *this;
 }
 
+void map_formula_callable::set_slot_value(const std::string& key, const variant& value)
+{
+	const int slot = find_formula_slot(key);
+	if (slot < 0) {
+		return;
+	}
+	if (slot >= (int)slot_values_.size()) {
+		slot_values_.resize(slot + 1);
+		slot_exists_.resize(slot + 1, false);
+	}
+	slot_values_[slot] = value;
+	slot_exists_[slot] = true;
+}
+
+void map_formula_callable::clear()
+{
+	values_.clear();
+	slot_values_.clear();
+	slot_exists_.clear();
+	stamp_ = next_stamp();
+}
+
 variant map_formula_callable::get_value(const std::string& key) const
 {
 	return map_get_value_default(values_, key,
@@ -65,6 +122,8 @@ void map_formula_callable::get_inputs(std::vector<formula_input>* inputs) const
 void map_formula_callable::set_value(const std::string& key, const variant& value)
 {
 	values_[key] = value;
+	set_slot_value(key, value);
+	stamp_ = next_stamp();
 }
 
 namespace {
@@ -187,6 +246,14 @@ public:
 		return s.str();
 	}
 
+	bool compile(formula_program& program) const {
+		if (!operand_->compile(program)) {
+			return false;
+		}
+		program.emit_unary(op_ == NOT? formula_program::UNARY_NOT: formula_program::UNARY_NEG);
+		return true;
+	}
+
 private:
 	variant execute(const formula_callable& variables, formula_debugger *fdb) const {
 		const variant res = operand_->evaluate(variables,fdb);
@@ -353,11 +420,26 @@ public:
 		s << left_->str() << op_str_ << right_->str();
 		return s.str();
 	}
+
+	bool compile(formula_program& program) const {
+		// dice is random, can not be folded or cached.
+		if (op_ == DICE || !left_->compile(program) || !right_->compile(program)) {
+			return false;
+		}
+		program.emit_binary(apply, op_);
+		return true;
+	}
+
 private:
 	variant execute(const formula_callable& variables, formula_debugger *fdb) const {
 		const variant left = left_->evaluate(variables,add_debug_info(fdb,0,"left_OP"));
 		const variant right = right_->evaluate(variables,add_debug_info(fdb,1,"OP_right"));
-		switch(op_) {
+		return apply(op_, left, right);
+	}
+
+	// shared by tree and bytecode.
+	static variant apply(int op, const variant& left, const variant& right) {
+		switch(op) {
 		case AND:
 			return left.as_bool() == false ? left : right;
 		case OR:
@@ -495,6 +577,14 @@ public:
 	{
 		return id_;
 	}
+	bool compile(formula_program& program) const {
+		// self is callable itself, not a value in it.
+		if (id_ == "self") {
+			return false;
+		}
+		program.emit_load(id_);
+		return true;
+	}
 private:
 	variant execute(const formula_callable& variables, formula_debugger * /*fdb*/) const {
 		return variables.query_value(id_);
@@ -508,6 +598,10 @@ public:
 	std::string str() const {
 		return "";
 	}
+	bool compile(formula_program& program) const {
+		program.emit_const(variant());
+		return true;
+	}
 private:
 	variant execute(const formula_callable& /*variables*/, formula_debugger * /*fdb*/) const {
 		return variant();
@@ -525,6 +619,10 @@ public:
 		s << i_;
 		return s.str();
 	}
+	bool compile(formula_program& program) const {
+		program.emit_const(variant(i_));
+		return true;
+	}
 private:
 	variant execute(const formula_callable& /*variables*/, formula_debugger * /*fdb*/) const {
 		return variant(i_);
@@ -544,6 +642,10 @@ public:
 		s << i_ << '.' << f_;
 		return s.str();
 	}
+	bool compile(formula_program& program) const {
+		program.emit_const(variant(i_ * 1000 + f_, variant::DECIMAL_VARIANT));
+		return true;
+	}
 private:
 	variant execute(const formula_callable& /*variables*/, formula_debugger * /*fdb*/) const {
 		return variant(i_ * 1000 + f_, variant::DECIMAL_VARIANT );
@@ -584,6 +686,14 @@ public:
 	{
 		return str_.as_string();
 	}
+	bool compile(formula_program& program) const {
+		// substitution is a nested formula, evaluate it by tree.
+		if (!subs_.empty()) {
+			return false;
+		}
+		program.emit_const(str_);
+		return true;
+	}
 private:
 	variant execute(const formula_callable& variables, formula_debugger *fdb) const {
 		if(subs_.empty()) {
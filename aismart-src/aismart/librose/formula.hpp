@@ -69,6 +69,7 @@ private:
 	expression_ptr expr_;
 	std::string str_;
 	friend class formula_debugger;
+	friend class formula_program;
 };
 
 struct formula_error : public game::error
@@ -18,6 +18,10 @@
 #include "reference_counted_object.hpp"
 #include "variant.hpp"
 
+#include <map>
+#include <vector>
+#include <stdint.h>
+
 namespace game_logic
 {
 
@@ -156,9 +160,19 @@ class map_formula_callable : public formula_callable {
 public:
 	explicit map_formula_callable(const formula_callable* fallback=NULL);
 	map_formula_callable& add(const std::string& key, const variant& value);
-	void set_fallback(const formula_callable* fallback) { fallback_ = fallback; }
+	void set_fallback(const formula_callable* fallback) { fallback_ = fallback; stamp_ = next_stamp(); }
 	bool empty() const { return values_.empty(); }
-	void clear() { values_.clear(); }
+	void clear();
+
+	// value of key that has a formula slot, NULL if key isn't in this map.
+	const variant* slot_value(int slot) const
+	{
+		return slot < (int)slot_exists_.size() && slot_exists_[slot]? &slot_values_[slot]: NULL;
+	}
+
+	// changed whenever content is changed. different contents never have same stamp,
+	// copy has same stamp as source until either is changed.
+	uint64_t stamp() const { return stamp_; }
 
 	typedef std::map<std::string,variant>::const_iterator const_iterator;
 
@@ -169,7 +183,13 @@ private:
 	variant get_value(const std::string& key) const;
 	void get_inputs(std::vector<formula_input>* inputs) const;
 	void set_value(const std::string& key, const variant& value);
+	void set_slot_value(const std::string& key, const variant& value);
+	static uint64_t next_stamp();
+
 	std::map<std::string,variant> values_;
+	std::vector<variant> slot_values_;
+	std::vector<bool> slot_exists_;
+	uint64_t stamp_;
 	const formula_callable* fallback_;
 };
 
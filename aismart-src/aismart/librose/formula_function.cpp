@@ -116,6 +116,51 @@ public:
 	     : function_expression("if", args, 3, -1)
 	{}
 
+	bool compile(formula_program& program) const {
+		std::vector<int> ends;
+		bool selected = false;
+		for(size_t n = 0; n < args().size()-1 && !selected; n += 2) {
+			if (!args()[n]->compile(program)) {
+				return false;
+			}
+			variant cond;
+			if (program.pop_constant(cond)) {
+				// condition is constant, only compile the branch it selects.
+				if (!cond.as_bool()) {
+					continue;
+				}
+				if (!args()[n+1]->compile(program)) {
+					return false;
+				}
+				selected = true;
+				break;
+			}
+
+			const int skip = program.emit_jump(true);
+			const int depth = program.depth();
+			if (!args()[n+1]->compile(program)) {
+				return false;
+			}
+			ends.push_back(program.emit_jump(false));
+			program.patch_jump(skip);
+			program.set_depth(depth);
+		}
+
+		if (!selected) {
+			if((args().size()%2) != 0) {
+				if (!args().back()->compile(program)) {
+					return false;
+				}
+			} else {
+				program.emit_const(variant());
+			}
+		}
+		for (std::vector<int>::const_iterator it = ends.begin(); it != ends.end(); ++ it) {
+			program.patch_jump(*it);
+		}
+		return true;
+	}
+
 private:
 	variant execute(const formula_callable& variables, formula_debugger *fdb) const {
 		for(size_t n = 0; n < args().size()-1; n += 2) {
@@ -18,6 +18,7 @@
 
 #include "formula.hpp"
 #include "formula_callable.hpp"
+#include "formula_program.hpp"
 
 namespace game_logic {
 
@@ -37,6 +38,9 @@ public:
 
 	const char* get_name() const { return name_; }
 	virtual std::string str() const = 0;
+
+	// emit bytecode of this expression into program, return false if it can't be compiled.
+	virtual bool compile(formula_program& /*program*/) const { return false; }
 private:
 	virtual variant execute(const formula_callable& variables, formula_debugger *fdb = NULL) const = 0;
 	const char* name_;
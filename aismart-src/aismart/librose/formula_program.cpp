@@ -0,0 +1,234 @@
+#define GETTEXT_DOMAIN "rose-lib"
+
+#include "formula_program.hpp"
+#include "formula.hpp"
+#include "formula_callable.hpp"
+#include "formula_function.hpp"
+#include "serialization/string_utils.hpp"
+#include "wml_exception.hpp"
+
+#include <unordered_map>
+
+namespace game_logic
+{
+
+// function static, map_formula_callable maybe used during static initialization.
+static std::unordered_map<std::string, int>& slot_map()
+{
+	static std::unordered_map<std::string, int> slots;
+	return slots;
+}
+
+int formula_slot(const std::string& name)
+{
+	std::unordered_map<std::string, int>& slots = slot_map();
+	std::unordered_map<std::string, int>::const_iterator it = slots.find(name);
+	if (it != slots.end()) {
+		return it->second;
+	}
+	const int slot = slots.size();
+	slots.insert(std::make_pair(name, slot));
+	return slot;
+}
+
+int find_formula_slot(const std::string& name)
+{
+	const std::unordered_map<std::string, int>& slots = slot_map();
+	std::unordered_map<std::string, int>::const_iterator it = slots.find(name);
+	return it != slots.end()? it->second: -1;
+}
+
+formula_program::formula_program(const std::string& str)
+	: str_(str)
+	, formula_(new formula(str))
+	, compiled_(false)
+	, label_(0)
+	, depth_(0)
+	, max_depth_(0)
+{
+	compiled_ = formula_->expr_->compile(*this);
+	if (compiled_) {
+		VALIDATE(depth_ == 1, null_str);
+		// tree isn't required any more.
+		formula_.reset();
+	} else {
+		code_.clear();
+		constants_.clear();
+		loads_.clear();
+	}
+}
+
+void formula_program::push(const tinstruction& ins, int stack_delta)
+{
+	code_.push_back(ins);
+	depth_ += stack_delta;
+	if (depth_ > max_depth_) {
+		max_depth_ = depth_;
+	}
+}
+
+bool formula_program::trailing_constants(int count) const
+{
+	const int size = code_.size();
+	if (size - count < label_) {
+		return false;
+	}
+	for (int at = size - count; at < size; at ++) {
+		if (code_[at].op != OP_CONST) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void formula_program::emit_const(const variant& value)
+{
+	constants_.push_back(value);
+	push(tinstruction(OP_CONST, constants_.size() - 1), 1);
+}
+
+void formula_program::emit_load(const std::string& name)
+{
+	loads_.push_back(tload(formula_slot(name), name));
+	push(tinstruction(OP_LOAD, loads_.size() - 1), 1);
+}
+
+void formula_program::emit_unary(tunary op)
+{
+	if (trailing_constants(1)) {
+		try {
+			const variant& operand = constants_[code_.back().arg];
+			const variant result = op == UNARY_NOT? (operand.as_bool()? variant(0): variant(1)): -operand;
+			constants_[code_.back().arg] = result;
+			return;
+		} catch (type_error&) {
+			// let it fail at evaluation, as tree does.
+		}
+	}
+	push(tinstruction(op == UNARY_NOT? OP_NOT: OP_NEG, 0), 0);
+}
+
+void formula_program::emit_binary(tbinary_fn fn, int op)
+{
+	if (trailing_constants(2)) {
+		try {
+			const int size = code_.size();
+			const variant result = fn(op, constants_[code_[size - 2].arg], constants_[code_[size - 1].arg]);
+			code_.pop_back();
+			depth_ --;
+			constants_[code_.back().arg] = result;
+			return;
+		} catch (type_error&) {
+			// let it fail at evaluation, as tree does.
+		}
+	}
+	push(tinstruction(OP_BINARY, op, fn), -1);
+}
+
+int formula_program::emit_jump(bool if_false)
+{
+	if (if_false) {
+		push(tinstruction(OP_JUMP_IF_FALSE, -1), -1);
+	} else {
+		push(tinstruction(OP_JUMP, -1), 0);
+	}
+	return code_.size() - 1;
+}
+
+void formula_program::patch_jump(int at)
+{
+	VALIDATE(at >= 0 && at < (int)code_.size() && code_[at].arg == -1, null_str);
+	code_[at].arg = code_.size();
+	label_ = code_.size();
+}
+
+bool formula_program::pop_constant(variant& value)
+{
+	if (!trailing_constants(1)) {
+		return false;
+	}
+	value = constants_[code_.back().arg];
+	code_.pop_back();
+	depth_ --;
+	return true;
+}
+
+variant formula_program::evaluate(const map_formula_callable& variables, bool* cacheable) const
+{
+	if (!compiled_) {
+		if (cacheable) {
+			*cacheable = false;
+		}
+		return formula_->evaluate(variables);
+	}
+
+	// canvas formulas are shallow, avoid heap for them.
+	const int local_depth = 16;
+	variant local[local_depth];
+	std::vector<variant> heap;
+	variant* stack = local;
+	if (max_depth_ > local_depth) {
+		heap.resize(max_depth_);
+		stack = &heap[0];
+	}
+
+	bool slots_only = true;
+	int sp = 0;
+	try {
+		const int size = code_.size();
+		for (int pc = 0; pc < size; ) {
+			const tinstruction& ins = code_[pc ++];
+			switch (ins.op) {
+			case OP_CONST:
+				stack[sp ++] = constants_[ins.arg];
+				break;
+
+			case OP_LOAD:
+			{
+				const tload& load = loads_[ins.arg];
+				const variant* value = variables.slot_value(load.slot);
+				if (value) {
+					stack[sp ++] = *value;
+				} else {
+					// not in this map, maybe in fallback.
+					slots_only = false;
+					stack[sp ++] = variables.query_value(load.name);
+				}
+				break;
+			}
+
+			case OP_NOT:
+				stack[sp - 1] = stack[sp - 1].as_bool()? variant(0): variant(1);
+				break;
+
+			case OP_NEG:
+				stack[sp - 1] = -stack[sp - 1];
+				break;
+
+			case OP_BINARY:
+				stack[sp - 2] = ins.fn(ins.arg, stack[sp - 2], stack[sp - 1]);
+				sp --;
+				break;
+
+			case OP_JUMP:
+				pc = ins.arg;
+				break;
+
+			case OP_JUMP_IF_FALSE:
+				if (!stack[-- sp].as_bool()) {
+					pc = ins.arg;
+				}
+				break;
+			}
+		}
+	} catch (type_error& e) {
+		throw twml_exception(e.user_message, "executing formula: " + str_);
+	}
+
+	if (cacheable) {
+		*cacheable = slots_only;
+	}
+	return stack[0];
+}
+
+}
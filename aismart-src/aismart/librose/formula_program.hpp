@@ -0,0 +1,102 @@
+#ifndef LIBROSE_FORMULA_PROGRAM_HPP_INCLUDED
+#define LIBROSE_FORMULA_PROGRAM_HPP_INCLUDED
+
+#include "formula_fwd.hpp"
+#include "variant.hpp"
+
+#include <vector>
+
+namespace game_logic
+{
+
+class map_formula_callable;
+
+// global slot of a variable name. slots are shared by all programs and map_formula_callable,
+// so program reads variable by index instead of std::map<std::string, variant> lookup.
+// formula_slot registers name if it doesn't exist, find_formula_slot returns -1 for it.
+// both must be called on main thread.
+int formula_slot(const std::string& name);
+int find_formula_slot(const std::string& name);
+
+//
+// formula compiled once into stack bytecode. constants are folded during compile, variables are
+// resolved to slots. if any expression of formula can't be compiled(list, map, where, functions except if...),
+// program evaluates parsed tree instead, it is still parsed once.
+//
+class formula_program
+{
+public:
+	typedef variant (*tbinary_fn)(int op, const variant& left, const variant& right);
+	enum tunary { UNARY_NOT, UNARY_NEG };
+
+	explicit formula_program(const std::string& str);
+
+	// cacheable is set to true if result depends only on values that are in variables' slots,
+	// in this case, same variables.stamp() gets same result.
+	variant evaluate(const map_formula_callable& variables, bool* cacheable = NULL) const;
+
+	bool compiled() const { return compiled_; }
+	const std::string& str() const { return str_; }
+
+	// used by formula_expression::compile.
+	void emit_const(const variant& value);
+	void emit_load(const std::string& name);
+	void emit_unary(tunary op);
+	void emit_binary(tbinary_fn fn, int op);
+	// return position that is used by patch_jump.
+	int emit_jump(bool if_false);
+	// jump at to current end of code.
+	void patch_jump(int at);
+	// remove trailing constant, so caller can fold it, for example condition of if.
+	bool pop_constant(variant& value);
+
+	int depth() const { return depth_; }
+	void set_depth(int depth) { depth_ = depth; }
+
+private:
+	enum topcode { OP_CONST, OP_LOAD, OP_NOT, OP_NEG, OP_BINARY, OP_JUMP, OP_JUMP_IF_FALSE };
+
+	struct tinstruction
+	{
+		tinstruction(topcode op, int arg, tbinary_fn fn = NULL)
+			: op(op)
+			, arg(arg)
+			, fn(fn)
+		{}
+
+		topcode op;
+		int arg; // const index, load index, binary op or jump target.
+		tbinary_fn fn;
+	};
+
+	struct tload
+	{
+		tload(int slot, const std::string& name)
+			: slot(slot)
+			, name(name)
+		{}
+
+		int slot;
+		std::string name;
+	};
+
+	void push(const tinstruction& ins, int stack_delta);
+	bool trailing_constants(int count) const;
+
+private:
+	std::string str_;
+	formula_ptr formula_; // used when not compiled.
+	bool compiled_;
+
+	std::vector<tinstruction> code_;
+	std::vector<variant> constants_;
+	std::vector<tload> loads_;
+
+	int label_; // code before label_ is a jump target's, it can not be folded.
+	int depth_;
+	int max_depth_;
+};
+
+}
+
+#endif
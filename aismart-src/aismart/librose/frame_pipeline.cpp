@@ -0,0 +1,227 @@
+#define GETTEXT_DOMAIN "rose-lib"
+
+#include "frame_pipeline.hpp"
+#include "wml_exception.hpp"
+
+#include "libyuv/convert_from.h"
+#include "libyuv/planar_functions.h"
+#include "libyuv/scale.h"
+
+tframe_pipeline::tframe_pipeline(int slots)
+	: slots_(slots)
+	, running_(false)
+	, bgr_required_(false)
+	, bgr_size_(0, 0)
+	, next_seq_(0)
+{
+	VALIDATE(slots >= 2, null_str);
+}
+
+tframe_pipeline::~tframe_pipeline()
+{
+	stop();
+}
+
+void tframe_pipeline::add_stage(const std::string& name, const tstage_fn& fn)
+{
+	VALIDATE(!running_, null_str);
+
+	stage_fns_.push_back(fn);
+	conds_.push_back(std::unique_ptr<threading::condition>(new threading::condition));
+	queues_.push_back(std::deque<int>());
+	stats_.stages.push_back(tstage_stats(name));
+}
+
+void tframe_pipeline::set_bgr(bool required, const tpoint& size)
+{
+	VALIDATE(!running_ && size.x >= 0 && size.y >= 0, null_str);
+	bgr_required_ = required;
+	bgr_size_ = size;
+}
+
+void tframe_pipeline::start()
+{
+	VALIDATE(!running_ && !stage_fns_.empty(), null_str);
+	VALIDATE((int)slots_.size() > (int)stage_fns_.size(), "every stage requires one slot at least, and one for capture");
+
+	{
+		threading::lock lock(mutex_);
+		free_slots_.clear();
+		for (int at = 0; at < (int)slots_.size(); at ++) {
+			free_slots_.push_back(at);
+		}
+		for (std::vector<std::deque<int> >::iterator it = queues_.begin(); it != queues_.end(); ++ it) {
+			it->clear();
+		}
+		running_ = true;
+	}
+
+	for (int at = 0; at < (int)stage_fns_.size(); at ++) {
+		workers_.push_back(std::unique_ptr<tstage_worker>(new tstage_worker(*this, at)));
+	}
+}
+
+void tframe_pipeline::stop()
+{
+	if (!running_) {
+		return;
+	}
+	{
+		threading::lock lock(mutex_);
+		running_ = false;
+		for (std::vector<std::unique_ptr<threading::condition> >::iterator it = conds_.begin(); it != conds_.end(); ++ it) {
+			(*it)->notify_all();
+		}
+	}
+	// tworker's destructor waits thread to exit.
+	workers_.clear();
+
+	for (std::vector<tframe>::iterator it = slots_.begin(); it != slots_.end(); ++ it) {
+		it->payload.reset();
+	}
+}
+
+bool tframe_pipeline::push(const cv::Mat& frame, const ti420_planes* i420)
+{
+	VALIDATE(frame.type() == CV_8UC4, null_str);
+
+	int slot = -1;
+	{
+		threading::lock lock(mutex_);
+		if (!running_) {
+			return false;
+		}
+		stats_.pushed ++;
+		if (!free_slots_.empty()) {
+			slot = free_slots_.back();
+			free_slots_.pop_back();
+
+		} else if (!queues_[0].empty()) {
+			// drop oldest frame that hasn't been processed.
+			slot = queues_[0].front();
+			queues_[0].pop_front();
+			stats_.dropped ++;
+
+		} else {
+			// all slots are in flight.
+			stats_.dropped ++;
+			return false;
+		}
+	}
+
+	// this slot isn't in any queue, so fill it without lock.
+	tframe& dst = slots_[slot];
+	if (!dst.surf.get() || dst.surf->w != frame.cols || dst.surf->h != frame.rows) {
+		dst.surf = create_neutral_surface(frame.cols, frame.rows);
+	}
+	// locked texture's rows maybe padded, copy row by row.
+	libyuv::ARGBCopy(frame.data, frame.step, (uint8_t*)dst.surf->pixels, dst.surf->pitch, frame.cols, frame.rows);
+
+	if (i420) {
+		VALIDATE(i420->width == frame.cols && i420->height == frame.rows, null_str);
+		// create reuses buffer when size isn't changed.
+		dst.gray.create(frame.rows, frame.cols, CV_8UC1);
+		libyuv::CopyPlane(i420->y, i420->stride_y, dst.gray.data, dst.gray.step, frame.cols, frame.rows);
+
+		if (bgr_required_) {
+			const int width = bgr_size_.x? bgr_size_.x: frame.cols;
+			const int height = bgr_size_.y? bgr_size_.y: frame.rows;
+			dst.bgr.create(height, width, CV_8UC3);
+			if (width == frame.cols && height == frame.rows) {
+				libyuv::I420ToRGB24(i420->y, i420->stride_y, i420->u, i420->stride_u, i420->v, i420->stride_v,
+					dst.bgr.data, dst.bgr.step, width, height);
+			} else {
+				// scale planes, it is a quarter of BGR's bytes.
+				const int half_width = (width + 1) / 2;
+				const int half_height = (height + 1) / 2;
+				scaled_i420_.resize(width * height + 2 * half_width * half_height);
+				uint8_t* y = &scaled_i420_[0];
+				uint8_t* u = y + width * height;
+				uint8_t* v = u + half_width * half_height;
+				libyuv::I420Scale(i420->y, i420->stride_y, i420->u, i420->stride_u, i420->v, i420->stride_v, frame.cols, frame.rows,
+					y, width, u, half_width, v, half_width, width, height, libyuv::kFilterBilinear);
+				libyuv::I420ToRGB24(y, width, u, half_width, v, half_width, dst.bgr.data, dst.bgr.step, width, height);
+			}
+		} else {
+			dst.bgr.release();
+		}
+	} else {
+		dst.gray.release();
+		dst.bgr.release();
+	}
+	dst.seq = next_seq_ ++;
+	dst.captured_ticks = SDL_GetTicks();
+
+	{
+		threading::lock lock(mutex_);
+		queues_[0].push_back(slot);
+		conds_[0]->notify_one();
+	}
+	return true;
+}
+
+void tframe_pipeline::run_stage(int stage)
+{
+	const bool last_stage = stage == (int)stage_fns_.size() - 1;
+	std::deque<int>& queue = queues_[stage];
+	threading::condition& cond = *conds_[stage].get();
+
+	while (true) {
+		int slot = -1;
+		{
+			threading::lock lock(mutex_);
+			while (running_ && queue.empty()) {
+				cond.wait(mutex_);
+			}
+			if (!running_) {
+				break;
+			}
+			slot = queue.front();
+			queue.pop_front();
+		}
+
+		tframe& frame = slots_[slot];
+		const uint32_t start = SDL_GetTicks();
+		stage_fns_[stage](frame);
+		const uint32_t end = SDL_GetTicks();
+
+		threading::lock lock(mutex_);
+		tstage_stats& stats = stats_.stages[stage];
+		stats.frames ++;
+		stats.last_ms = end - start;
+		stats.total_ms += stats.last_ms;
+		if (stats.last_ms > stats.max_ms) {
+			stats.max_ms = stats.last_ms;
+		}
+
+		if (last_stage) {
+			const uint32_t latency = end - frame.captured_ticks;
+			stats_.published ++;
+			stats_.latency_total_ms += latency;
+			if (latency > stats_.latency_max_ms) {
+				stats_.latency_max_ms = latency;
+			}
+			free_slots_.push_back(slot);
+
+		} else {
+			queues_[stage + 1].push_back(slot);
+			conds_[stage + 1]->notify_one();
+		}
+	}
+}
+
+tframe_pipeline::tstats tframe_pipeline::stats() const
+{
+	threading::lock lock(mutex_);
+	return stats_;
+}
+
+void tframe_pipeline::reset_stats()
+{
+	threading::lock lock(mutex_);
+	tstats stats;
+	for (std::vector<tstage_stats>::const_iterator it = stats_.stages.begin(); it != stats_.stages.end(); ++ it) {
+		stats.stages.push_back(tstage_stats(it->name));
+	}
+	stats_ = stats;
+}
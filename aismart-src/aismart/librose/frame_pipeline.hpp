@@ -0,0 +1,157 @@
+#ifndef LIBROSE_FRAME_PIPELINE_HPP_INCLUDED
+#define LIBROSE_FRAME_PIPELINE_HPP_INCLUDED
+
+#include "thread.hpp"
+#include "sdl_utils.hpp"
+
+#include <opencv2/core/mat.hpp>
+#include <boost/function.hpp>
+
+#include <deque>
+
+// stage can attach its result to frame, and next stage use it.
+class tframe_payload
+{
+public:
+	virtual ~tframe_payload() {}
+};
+
+// planes of I420 frame, memory is owned by capture.
+struct ti420_planes
+{
+	const uint8_t* y;
+	int stride_y;
+	const uint8_t* u;
+	int stride_u;
+	const uint8_t* v;
+	int stride_v;
+	int width;
+	int height;
+};
+
+struct tframe
+{
+	tframe()
+		: seq(0)
+		, captured_ticks(0)
+	{}
+
+	surface surf; // BGRA
+	cv::Mat gray; // Y plane of I420 frame, it is gray image. empty if capture didn't give planes.
+	cv::Mat bgr; // converted from I420 planes when set_bgr requires it, else empty.
+	int seq;
+	uint32_t captured_ticks;
+	std::unique_ptr<tframe_payload> payload;
+};
+
+//
+// capture --> stage#0 --> stage#1 --> ... --> last stage
+//
+// every stage runs on its own thread, frame is passed between stages through preallocated slots.
+// when there is no free slot, push replaces the oldest frame that stage#0 hasn't started (drop-oldest).
+//
+class tframe_pipeline
+{
+public:
+	typedef boost::function<void (tframe&)> tstage_fn;
+
+	struct tstage_stats
+	{
+		tstage_stats(const std::string& name)
+			: name(name)
+			, frames(0)
+			, total_ms(0)
+			, max_ms(0)
+			, last_ms(0)
+		{}
+
+		std::string name;
+		int frames;
+		uint32_t total_ms;
+		uint32_t max_ms;
+		uint32_t last_ms;
+	};
+
+	struct tstats
+	{
+		tstats()
+			: pushed(0)
+			, dropped(0)
+			, published(0)
+			, latency_total_ms(0)
+			, latency_max_ms(0)
+		{}
+
+		std::vector<tstage_stats> stages;
+		int pushed;
+		int dropped;
+		int published;
+		uint32_t latency_total_ms; // capture to end of last stage.
+		uint32_t latency_max_ms;
+	};
+
+	explicit tframe_pipeline(int slots = 3);
+	~tframe_pipeline();
+
+	// must be called before start.
+	void add_stage(const std::string& name, const tstage_fn& fn);
+
+	void start();
+	void stop();
+	bool running() const { return running_; }
+
+	// must be called before start. when required, frame.bgr is converted from I420 planes by libyuv,
+	// stage doesn't convert from BGRA surface. size is (0, 0): same as frame.
+	void set_bgr(bool required, const tpoint& size = tpoint(0, 0));
+
+	// called by capture(main) thread. frame is BGRA. i420 is planes of same frame, if it isn't NULL,
+	// frame.gray and frame.bgr are filled from it.
+	// return false if pipeline isn't running or frame is dropped.
+	bool push(const cv::Mat& frame, const ti420_planes* i420 = NULL);
+
+	tstats stats() const;
+	void reset_stats();
+
+private:
+	class tstage_worker: public tworker
+	{
+	public:
+		tstage_worker(tframe_pipeline& pipeline, int stage)
+			: pipeline_(pipeline)
+			, stage_(stage)
+		{
+			thread_->Start();
+		}
+
+	private:
+		void DoWork() override { pipeline_.run_stage(stage_); }
+		void OnWorkStart() override {}
+		void OnWorkDone() override {}
+
+	private:
+		tframe_pipeline& pipeline_;
+		const int stage_;
+	};
+
+	void run_stage(int stage);
+
+private:
+	mutable threading::mutex mutex_;
+	std::vector<std::unique_ptr<threading::condition> > conds_;
+
+	std::vector<tframe> slots_;
+	std::vector<int> free_slots_;
+	std::vector<std::deque<int> > queues_; // queues_[n]: slots waiting stage#n.
+
+	std::vector<tstage_fn> stage_fns_;
+	std::vector<std::unique_ptr<tstage_worker> > workers_;
+
+	volatile bool running_;
+	bool bgr_required_;
+	tpoint bgr_size_;
+	std::vector<uint8_t> scaled_i420_; // used by push only.
+	int next_seq_;
+	tstats stats_;
+};
+
+#endif
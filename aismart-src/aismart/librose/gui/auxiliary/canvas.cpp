@@ -9,6 +9,7 @@
 #include "gui/auxiliary/formula.hpp"
 #include "gui/widgets/helper.hpp"
 #include "gui/widgets/control.hpp"
+#include "gui/widgets/window.hpp"
 #include "wml_exception.hpp"
 #include "font.hpp"
 #include "display.hpp"
@@ -718,6 +719,9 @@ public:
 	/** Implement shape::draw(). */
 	void draw(texture& canvas, const int canvas_width, const int canvas_height, const game_logic::map_formula_callable& variables, std::vector<SDL_Rect>& drawn_rects);
 
+	// file that last draw is waiting async decode. empty if it isn't waiting.
+	const std::string& pending_file() const { return pending_file_; }
+
 private:
 	tformula<unsigned>
 		x_, /**< The x coordinate of the image. */
@@ -728,6 +732,7 @@ private:
 	/** The image is cached in this surface. */
 	surface image_;
 
+	std::string pending_file_;
 
 
 	/**
@@ -770,10 +775,13 @@ timage::timage(const config& cfg)
 	, w_(cfg["w"])
 	, h_(cfg["h"])
 	, image_()
+	, pending_file_()
 	, image_name_(cfg["name"])
 	, resize_mode_(get_resize_mode(cfg["resize_mode"]))
 	, vertical_mirror_(cfg["vertical_mirror"])
 {
+	type = tcanvas::image_shape;
+
 /*WIKI
  * @page = GUICanvasWML
  *
@@ -837,6 +845,7 @@ void timage::draw(texture& canvas, const int canvas_width, const int canvas_heig
 	 * silly unless there has been a resize. So to optimize we should use an
 	 * extra flag or do the calculation in a separate routine.
 	 */
+	pending_file_.clear();
 	std::string name = image_name_(variables);
 	if (name.empty()) {
 		return;
@@ -847,12 +856,21 @@ void timage::draw(texture& canvas, const int canvas_width, const int canvas_heig
 	 * cache the output, also not if no formula is used.
 	 */
 	{
+		// decode on worker threads, canvas keeps dirty until image is ready.
 		surface tmp;
+		bool ready = true;
+		std::string file;
 		if (twidget::hdpi_scale > 1) {
-			tmp = image::get_image(image::locator(get_hdpi_name(name, twidget::hdpi_scale)));
+			file = get_hdpi_name(name, twidget::hdpi_scale);
+			tmp = image::get_image_async(image::locator(file), ready);
 		}
-		if (!tmp) {
-			tmp = image::get_image(image::locator(name));
+		if (ready && !tmp) {
+			file = name;
+			tmp = image::get_image_async(image::locator(file), ready);
+		}
+		if (!ready) {
+			pending_file_ = file;
+			return;
 		}
 		if (!tmp) {
 			return;
@@ -1536,6 +1554,7 @@ void tcanvas::draw(const tcontrol& widget, const SDL_Rect& canvas_clip_rect, boo
 	// below will change target. require save/recover clip setting of preview target.
 	texture_clip_rect_setter clip(NULL);
 
+	std::vector<std::string> waiting_files;
 	if (dirty_ || force || !animated || mixed_) {
 		// create surface
 		canvas_ = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, w_, h_);
@@ -1566,6 +1585,12 @@ void tcanvas::draw(const tcontrol& widget, const SDL_Rect& canvas_clip_rect, boo
 			} 
 
 			shape.draw(canvas_, w_, h_, variables_, drawn_rects);
+			if (shape.type == image_shape) {
+				const std::string& file = static_cast<timage&>(shape).pending_file();
+				if (!file.empty()) {
+					waiting_files.push_back(file);
+				}
+			}
 		}
 
 		if (share_canvas_integrate) {
@@ -1621,7 +1646,14 @@ void tcanvas::draw(const tcontrol& widget, const SDL_Rect& canvas_clip_rect, boo
 		}
 	} 
 
-	dirty_ = false;
+	// redraw when images that are decoding become ready.
+	dirty_ = !waiting_files.empty();
+	if (dirty_) {
+		twindow* window = const_cast<tcontrol&>(widget).get_window();
+		if (window) {
+			window->wait_async_images(const_cast<tcontrol&>(widget), waiting_files);
+		}
+	}
 }
 
 void tcanvas::blit(const tcontrol& widget, texture& surf, SDL_Rect rect, bool force, const std::vector<int>& post_anims)
@@ -65,7 +65,7 @@ namespace event {
 class thandler: public tevent_handler
 {
 	friend bool gui2::is_in_dialog();
-	friend void gui2::absolute_draw();
+	friend bool gui2::absolute_draw(bool force);
 	friend std::vector<twindow*> gui2::connectd_window();
 	friend void gui2::clear_textures();
 public:
@@ -101,8 +101,14 @@ private:
 
 	/***** Handlers *****/
 
-	/** Fires a draw event. */
-	void draw();
+	/**
+	 * Fires a draw event.
+	 *
+	 * @param force               Flip even if nothing changed.
+	 *
+	 * @returns                   Whether screen is flipped.
+	 */
+	bool draw(bool force);
 
 	/**
 	 * Fires a video resize event.
@@ -432,10 +438,10 @@ void thandler::disconnect(twindow* window)
 	} 
 }
 
-void thandler::draw()
+bool thandler::draw(bool force)
 {
 	if (dispatchers_.empty()) {
-		return;
+		return false;
 	}
 
 	display* disp = display::get_singleton();
@@ -443,7 +449,11 @@ void thandler::draw()
 	twindow* window = dispatchers_.back();
 	CVideo& video = window->video();
 
-	window->draw();
+	const bool redrawn = window->draw();
+	if (!force && !redrawn && window->drawn() && !window->float_widgets_dirty() && !disp->window_anim_running()) {
+		// screen texture is same as last flip.
+		return false;
+	}
 
 	// tip's buff will used to other place, require remember first.
 	window->draw_float_widgets();
@@ -460,6 +470,7 @@ void thandler::draw()
 		window->set_drawn();
 		window->dialog()->app_first_drawn(*window);
 	}
+	return true;
 }
 
 void thandler::video_resize(const tpoint& new_size)
@@ -676,9 +687,9 @@ void disconnect_dispatcher(twindow* dispatcher)
 
 } // namespace event
 
-void absolute_draw()
+bool absolute_draw(bool force)
 {
-	event::handler->draw();
+	return event::handler->draw(force);
 }
 
 std::vector<twindow*> connectd_window()
@@ -247,7 +247,8 @@ void disconnect_dispatcher(twindow* dispatcher);
 
 } // namespace event
 
-void absolute_draw();
+// force: flip even if nothing changed. return whether screen is flipped.
+bool absolute_draw(bool force = true);
 std::vector<twindow*> connectd_window();
 void clear_textures();
 
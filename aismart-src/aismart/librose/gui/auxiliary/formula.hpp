@@ -18,6 +18,7 @@
 
 #include "formula_callable.hpp"
 #include "../../formula.hpp"
+#include "formula_program.hpp"
 #include "gui/widgets/helper.hpp"
 #include "serialization/string_utils.hpp"
 #include "util.hpp"
@@ -111,7 +112,8 @@ private:
 	 * Executes the formula.
 	 *
 	 * This function does the calculation and can only be called if the object
-	 * contains a formula.
+	 * contains a formula. The formula is compiled on first call, and result is
+	 * reused while stamp of variables isn't changed.
 	 *
 	 * @param variables           The state variables which might be used in
 	 *                            the formula. For example a screen_width can
@@ -122,6 +124,9 @@ private:
 	 */
 	T execute(const game_logic::map_formula_callable& variables) const;
 
+	/** Converts result of formula to the template type. */
+	static T cast(const variant& result);
+
 	/**
 	 * Contains the formuale for the variable.
 	 *
@@ -138,6 +143,13 @@ private:
 
 	/** If there's no formula it contains the value. */
 	T value_;
+
+	/** Compiled formula_, created on first execute. */
+	mutable boost::shared_ptr<game_logic::formula_program> program_;
+
+	/** Stamp of variables that memo_ is calculated from, 0 if none. */
+	mutable uint64_t memo_stamp_;
+	mutable T memo_;
 };
 
 template<class T>
@@ -145,6 +157,9 @@ tformula<T>::tformula(const std::string& str, const T value)
 	: formula_()
 	, formula2_(false)
 	, value_(value)
+	, program_()
+	, memo_stamp_(0)
+	, memo_()
 {
 	if (str.empty()) {
 		return;
@@ -172,47 +187,63 @@ inline T tformula<T>::operator()(
 	}
 }
 
-template<>
-inline bool tformula<bool>::execute(
+template<class T>
+inline T tformula<T>::execute(
 		const game_logic::map_formula_callable& variables) const
 {
-	return game_logic::formula(formula_).evaluate(variables).as_bool();
+	if (memo_stamp_ && memo_stamp_ == variables.stamp()) {
+		return memo_;
+	}
+	if (!program_) {
+		program_.reset(new game_logic::formula_program(formula_));
+	}
+
+	bool cacheable = false;
+	const T result = cast(program_->evaluate(variables, &cacheable));
+	if (cacheable) {
+		memo_stamp_ = variables.stamp();
+		memo_ = result;
+	} else {
+		memo_stamp_ = 0;
+	}
+	return result;
+}
+
+template<>
+inline bool tformula<bool>::cast(const variant& result)
+{
+	return result.as_bool();
 }
 
 template<>
-inline int tformula<int>::execute(
-		const game_logic::map_formula_callable& variables) const
+inline int tformula<int>::cast(const variant& result)
 {
-	return game_logic::formula(formula_).evaluate(variables).as_int();
+	return result.as_int();
 }
 
 template<>
-inline unsigned tformula<unsigned>::execute(
-		const game_logic::map_formula_callable& variables) const
+inline unsigned tformula<unsigned>::cast(const variant& result)
 {
-	return game_logic::formula(formula_).evaluate(variables).as_int();
+	return result.as_int();
 }
 
 template<>
-inline std::string tformula<std::string>::execute(
-		const game_logic::map_formula_callable& variables) const
+inline std::string tformula<std::string>::cast(const variant& result)
 {
-	return game_logic::formula(formula_).evaluate(variables).as_string();
+	return result.as_string();
 }
 
 template<>
-inline t_string tformula<t_string>::execute(
-		const game_logic::map_formula_callable& variables) const
+inline t_string tformula<t_string>::cast(const variant& result)
 {
-	return game_logic::formula(formula_).evaluate(variables).as_string();
+	return result.as_string();
 }
 
 template<class T>
-inline T tformula<T>::execute(
-		const game_logic::map_formula_callable& /*variables*/) const
+inline T tformula<T>::cast(const variant& /*result*/)
 {
-	// Every type needs its own execute function avoid instantiation of the
-	// default execute.
+	// Every type needs its own cast function avoid instantiation of the
+	// default cast.
 	BOOST_STATIC_ASSERT(sizeof(T) == 0);
 	return T();
 }
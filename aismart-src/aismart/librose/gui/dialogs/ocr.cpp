@@ -15,6 +15,7 @@
 
 #include <boost/bind.hpp>
 #include <numeric>
+#include <unordered_map>
 
 #include "video.hpp"
 
@@ -28,11 +29,9 @@ tocr::tocr(const surface& target, std::vector<std::unique_ptr<tocr_line> >& line
 	, verbose_(false)
 	, paper_(nullptr)
 	, save_(nullptr)
-	, current_surf_(std::make_pair(false, surface()))
+	, pipeline_(3)
 	, blended_tex_(std::make_pair(false, texture()))
 	, blended_tex_pixels_(nullptr)
-	, setting_(false)
-	, recognition_thread_running_(false)
 	, original_local_offset_(0, 0)
 	, current_local_offset_(0, 0)
 #ifdef _WIN32
@@ -91,6 +90,8 @@ void tocr::pre_show(CVideo& video, twindow& window)
 	save_->set_active(false);
 
 	if (!target_.get()) {
+		pipeline_.add_stage("detect", boost::bind(&tocr::did_detect_frame, this, _1));
+		pipeline_.add_stage("publish", boost::bind(&tocr::did_publish_frame, this, _1));
 		start_avcapture();
 	}
 }
@@ -104,10 +105,12 @@ void tocr::post_show(twindow& window)
 
 const trect* point_in_conside_histogram(const std::set<trect>& conside_region, const SDL_Rect& next_char_allow_rect)
 {
-	for (std::set<trect>::const_iterator it = conside_region.begin(); it != conside_region.end(); ++ it) {
+	// set is sorted by x first, so rects starting at next_char_allow_rect.x are continuous.
+	std::set<trect>::const_iterator it = conside_region.lower_bound(trect(next_char_allow_rect.x, INT_MIN, INT_MIN, INT_MIN));
+	for (; it != conside_region.end() && it->x == next_char_allow_rect.x; ++ it) {
 		const trect& rect = *it;
 
-		if (rect.x == next_char_allow_rect.x && rect.x + rect.w <= next_char_allow_rect.x + next_char_allow_rect.w && 
+		if (rect.x + rect.w <= next_char_allow_rect.x + next_char_allow_rect.w && 
 			rect.y >= next_char_allow_rect.y && rect.y + rect.h <= next_char_allow_rect.y + next_char_allow_rect.h) {
 			return &rect;
 		}
@@ -686,57 +689,30 @@ void grow_lines(const surface& src_surf, bool verbose_, const cv::Mat& gray, std
 	}
 }
 
-void erase_bboxes_base_lines(std::set<trect>& bboxes, const std::vector<std::unique_ptr<tocr_line> >& lines)
-{
-	const int count = lines.size();
-	std::unique_ptr<SDL_Rect> bounding_rects(new SDL_Rect[count]);
-	SDL_Rect* bounding_rects_ptr = bounding_rects.get();
-	int at = 0;
-	for (std::vector<std::unique_ptr<tocr_line> >::const_iterator it = lines.begin(); it != lines.end(); ++ it, at ++) {
-		const tocr_line& line = *it->get();
-		memcpy(bounding_rects_ptr + at, &line.bounding_rect, sizeof(SDL_Rect));
-	}
-
-	bool erase;
-	for (std::set<trect>::iterator it = bboxes.begin(); it != bboxes.end(); ) {
-		const trect& rect = *it;
-		erase = false;
-		for (int at = 0; at < count; at ++) {
-			if (rect.rect_overlap2(bounding_rects_ptr[at])) {
-				erase = true;
-				break;
-			}
-		}
-		if (erase) {
-			bboxes.erase(it ++);
-		} else {
-			++ it;
-		}
-	}
-}
-
-void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr_line> >& lines)
+void tocr::detect_and_blend_surf(surface& surf, bool verbose, std::vector<std::unique_ptr<tocr_line> >& lines, const cv::Mat& gray_in)
 {
 	lines.clear();
 
 	tsurface_2_mat_lock lock(surf);
-	cv::Mat rgb, gray;
-	cv::cvtColor(lock.mat, rgb, cv::COLOR_BGRA2BGR);
-	cv::cvtColor(lock.mat, gray, cv::COLOR_BGRA2GRAY);
+	cv::Mat gray = gray_in;
+	if (gray.empty()) {
+		cv::cvtColor(lock.mat, gray, cv::COLOR_BGRA2GRAY);
+	}
+	VALIDATE(gray.cols == surf->w && gray.rows == surf->h, null_str);
 	const int image_area = gray.rows * gray.cols;
 	const int delta = 1;
 	const int min_area = 30;
 	const double max_area_ratio = 0.05;
 
-	std::vector<std::vector<cv::Point> > inv_msers, msers;
-    std::vector<cv::Rect> inv_bboxes, bboxes;
+	cv::MSERRegions inv_char_regions, char_regions;
 /*
 	cv::Ptr<cv::MSER> mser = cv::MSER::create(delta, min_area, int(max_area_ratio * image_area), 0.25, 0.2);
 	mser->detectRegions(gray, msers, bboxes);
 */
 
 	cv::Ptr<cv::MSER2> mser = cv::MSER2::create(delta, min_area, int(max_area_ratio * image_area));
-	mser->detectRegions(gray, inv_msers, inv_bboxes, msers, bboxes);
+	mser->detectRegions(gray, inv_char_regions, char_regions);
+	const std::vector<cv::Rect>& bboxes = char_regions.bboxes;
 
 	const int min_char_width = 8;
 	const int min_char_height = 8;
@@ -752,9 +728,14 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 		bboxes2.insert(trect(rect.x, rect.y, rect.width, rect.height));
 	}
 
-	std::map<tpoint, int> regions;
+	// histogram of size.
+	struct tsize_hash
+	{
+		size_t operator()(const tpoint& size) const { return (size.x << 16) ^ size.y; }
+	};
+	std::unordered_map<tpoint, int, tsize_hash> regions;
 
-	std::map<tpoint, int>::iterator find;
+	std::unordered_map<tpoint, int, tsize_hash>::iterator find;
 	int max_value = 0;
 	tpoint max_point(0, 0);
 	for (std::set<trect>::const_iterator it = bboxes2.begin(); it != bboxes2.end(); ++ it) {
@@ -796,7 +777,7 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 		}
 	}
 
-	if (verbose_) {
+	if (verbose) {
 		// mser and conside png
 		cv::Mat mser_mat = lock.mat.clone();
 		cv::Mat conside_mat = lock.mat.clone();
@@ -814,7 +795,8 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 		int hscale = 16, vscale = 24;
 		cv::Mat histogram_mat = cv::Mat::zeros(max_value * vscale, regions.size() * hscale, CV_8UC3);
 		int at = 0;
-		for (std::map<tpoint, int>::const_iterator it = regions.begin(); it != regions.end(); ++ it, at ++) {
+		const std::map<tpoint, int> sorted_regions(regions.begin(), regions.end());
+		for (std::map<tpoint, int>::const_iterator it = sorted_regions.begin(); it != sorted_regions.end(); ++ it, at ++) {
 			int height = it->second * vscale;
 			cv::Scalar color(255, 255, 255);
 			if (at) {
@@ -833,10 +815,12 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 	}
 
 
-	std::set<trect> conside_rect;
+	// chars that have been in lines.
+	const int grid_cell_size = 32;
+	trect_grid conside_rect(gray.cols, gray.rows, grid_cell_size);
 	for (std::set<trect>::const_iterator it = conside_region.begin(); it != conside_region.end(); ++ it) {
 		const trect& rect = *it;
-		if (rect_overlap_rect_set(conside_rect, rect)) {
+		if (conside_rect.overlap(rect)) {
 			continue;
 		}
 		int x = rect.x + rect.w;
@@ -853,7 +837,7 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 			// const SDL_Rect next_char_allow_rect{x2, average_rect.y - average_rect.h / 4, average_rect.w * 3 / 2, average_rect.h * 3 / 2};
 			const SDL_Rect next_char_allow_rect{x2, average_rect.y - average_rect.h / 5, average_rect.w * 3 / 2, average_rect.h * 3 / 2};
 			const trect* new_rect = point_in_conside_histogram(conside_region, next_char_allow_rect);
-			if (new_rect && !rect_overlap_rect_set(conside_rect, *new_rect)) {
+			if (new_rect && !conside_rect.overlap(*new_rect)) {
 				VALIDATE(!rect_overlap_rect_set(valid_chars, *new_rect), null_str);
 				valid_chars.insert(*new_rect);
 				bonus = min_char_gap; // find a valid char, reset relative variable.
@@ -867,12 +851,14 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 			}
 		}
 		if (valid_chars.size() >= can_line_valid_chars) {
-			conside_rect.insert(valid_chars.begin(), valid_chars.end());
+			for (std::set<trect>::const_iterator it2 = valid_chars.begin(); it2 != valid_chars.end(); ++ it2) {
+				conside_rect.insert(*it2);
+			}
 			lines.push_back(std::unique_ptr<tocr_line>(new tocr_line(valid_chars)));
 		}
 	}
 
-	if (verbose_) {
+	if (verbose) {
 		generate_mark_line_png(lines, surf, join_file_png(0, 3, "line-strong-seed-1.png"));
 	}
 
@@ -935,7 +921,7 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 
 			const SDL_Rect base_rect {rect.x - clip_rect.x, rect.y - clip_rect.y, rect.w, rect.h};
 			SDL_Rect char_rect;
-			bool has_char = locate_character(gray(clip_rect), base_rect, -1, true, char_rect, verbose_ && line_at == 12 && char_at == 1, 4);
+			bool has_char = locate_character(gray(clip_rect), base_rect, -1, true, char_rect, verbose && line_at == 12 && char_at == 1, 4);
 			VALIDATE(has_char, null_str);
 
 			char_rect.x += clip_rect.x;
@@ -954,103 +940,111 @@ void tocr::detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr
 		}
 	}
 
-	if (verbose_) {
+	if (verbose) {
 		generate_mark_line_png(lines, surf, join_file_png(0, 4, "line-strong-seed-2.png"));
 	}
 
-	grow_lines(surf, verbose_, gray, lines);
+	grow_lines(surf, verbose, gray, lines);
 
-	if (verbose_) {
+	if (verbose) {
 		generate_mark_line_png(lines, surf, join_file_png(0, 5, "line-grown.png"));
 	}
-
-	erase_bboxes_base_lines(bboxes2, lines);
 }
 
-void tocr::texecutor::DoWork()
+void tocr::did_detect_frame(tframe& frame)
 {
-	ocr_.recognition_thread_running_ = true;
-	while (ocr_.avcapture_.get()) {
-		if (ocr_.setting_) {
-			// main thread is setting.
-			// seting action may be risk recognition_mutex_.
-			SDL_Delay(10);
-			continue;
-		}
-		threading::lock lock(ocr_.recognition_mutex_);
-		if (!ocr_.avcapture_.get()) {
-			continue;
-		}
-		if (!ocr_.current_surf_.first) {
-			SDL_Delay(10);
-			continue;
+	if (!frame.payload.get()) {
+		frame.payload.reset(new tlines_payload);
+	}
+	tlines_payload& payload = *static_cast<tlines_payload*>(frame.payload.get());
+
+	// when lines were found and scene only moves a little, detect in region around them.
+	const bool full = frame.gray.empty() || tracker_.track(frame.gray);
+	if (full) {
+		// Y plane of camera frame is gray image, no conversion.
+		detect_and_blend_surf(frame.surf, verbose_, payload.lines, frame.gray);
+
+	} else {
+		const int margin = 32;
+		const cv::Rect roi = tracker_.search_rect(margin);
+		// view of roi in frame.surf, detect without copy, and what is blended goes into frame.
+		const SDL_PixelFormat& fmt = *frame.surf->format;
+		surface roi_surf = SDL_CreateRGBSurfaceFrom((uint8_t*)frame.surf->pixels + roi.y * frame.surf->pitch + roi.x * fmt.BytesPerPixel,
+			roi.width, roi.height, fmt.BitsPerPixel, frame.surf->pitch, fmt.Rmask, fmt.Gmask, fmt.Bmask, fmt.Amask);
+		VALIDATE(roi_surf.get(), null_str);
+		detect_and_blend_surf(roi_surf, verbose_, payload.lines, frame.gray(roi));
+
+		for (std::vector<std::unique_ptr<tocr_line> >::iterator it = payload.lines.begin(); it != payload.lines.end(); ++ it) {
+			tocr_line& line = **it;
+			std::set<trect> chars;
+			for (std::set<trect>::const_iterator it2 = line.chars.begin(); it2 != line.chars.end(); ++ it2) {
+				chars.insert(trect(it2->x + roi.x, it2->y + roi.y, it2->w, it2->h));
+			}
+			line.chars.swap(chars);
 		}
+	}
 
-		std::vector<std::unique_ptr<tocr_line> > lines;
-		ocr_.detect_and_blend_surf(ocr_.current_surf_.second, lines);
+	std::vector<cv::Rect> rects;
+	for (std::vector<std::unique_ptr<tocr_line> >::iterator it = payload.lines.begin(); it != payload.lines.end(); ++ it) {
+		tocr_line& line = **it;
+		line.calculate_bounding_rect();
+		rects.push_back(cv::Rect(line.bounding_rect.x, line.bounding_rect.y, line.bounding_rect.w, line.bounding_rect.h));
+	}
+	tracker_.update(rects, full);
+}
 
-		{
-			threading::lock lock(ocr_.variable_mutex_);
-			ocr_.current_surf_.first = false;
+void tocr::did_publish_frame(tframe& frame)
+{
+	std::vector<std::unique_ptr<tocr_line> >& lines = static_cast<tlines_payload*>(frame.payload.get())->lines;
+	if (lines.empty()) {
+		return;
+	}
 
-			if (ocr_.avcapture_.get() && !lines.empty()) {
-				// user maybe want last look ocr_.lines_
-				surface& src_surf = ocr_.current_surf_.second;
+	threading::lock lock(variable_mutex_);
+	// user maybe want last look lines_
+	surface& src_surf = frame.surf;
 
-				if (ocr_.camera_surf_.get()) {
-					VALIDATE(ocr_.camera_surf_->w == src_surf->w && ocr_.camera_surf_->h == src_surf->h, null_str);
-					surface_lock lock(ocr_.camera_surf_);
-					Uint32* pixels = lock.pixels();
-					memcpy(pixels, src_surf->pixels, src_surf->w * src_surf->h * 4); 
+	if (camera_surf_.get()) {
+		VALIDATE(camera_surf_->w == src_surf->w && camera_surf_->h == src_surf->h, null_str);
+		surface_lock lock(camera_surf_);
+		Uint32* pixels = lock.pixels();
+		memcpy(pixels, src_surf->pixels, src_surf->w * src_surf->h * 4); 
 
-				} else {
-					ocr_.camera_surf_ = clone_surface(src_surf);
-				}
+	} else {
+		camera_surf_ = clone_surface(src_surf);
+	}
 
-				generate_mark_line_png(ocr_.lines_, src_surf, null_str);
+	generate_mark_line_png(lines_, src_surf, null_str);
 
-				memcpy(ocr_.blended_tex_pixels_, src_surf->pixels, src_surf->w * src_surf->h * 4); 
-				ocr_.blended_tex_.first = true;
+	memcpy(blended_tex_pixels_, src_surf->pixels, src_surf->w * src_surf->h * 4); 
+	blended_tex_.first = true;
 
-				ocr_.lines_.clear();
-				for (std::vector<std::unique_ptr<tocr_line> >::const_iterator it = lines.begin(); it != lines.end(); ++ it) {
-					ocr_.lines_.push_back(std::unique_ptr<tocr_line>(new tocr_line(*it->get())));
-				}
-			}
-		}
+	lines_.clear();
+	for (std::vector<std::unique_ptr<tocr_line> >::iterator it = lines.begin(); it != lines.end(); ++ it) {
+		lines_.push_back(std::move(*it));
 	}
-	ocr_.recognition_thread_running_ = false;
+	lines.clear();
 }
 
 void tocr::start_avcapture()
 {
 	VALIDATE(!target_.get(), null_str);
-	VALIDATE(!recognition_thread_running_ && !avcapture_.get(), null_str);
-
-	tsetting_lock setting_lock(*this);
-	threading::lock lock(recognition_mutex_);
+	VALIDATE(!pipeline_.running() && !avcapture_.get(), null_str);
 
 	avcapture_.reset(new tavcapture());
 	paper_->set_timer_interval(30);
 
-	current_surf_ = std::make_pair(false, surface());
-
-	executor_.reset(new texecutor(*this));
+	tracker_.reset();
+	pipeline_.start();
 }
 
 void tocr::stop_avcapture()
 {
 	VALIDATE(!target_.get(), null_str);
 
-	{
-		tsetting_lock setting_lock(*this);
-		threading::lock lock(recognition_mutex_);
-		avcapture_.reset();
-		paper_->set_timer_interval(0);
-
-		current_surf_ = std::make_pair(false, surface());
-	}
-	executor_.reset();
+	pipeline_.stop();
+	avcapture_.reset();
+	paper_->set_timer_interval(0);
 }
 
 SDL_Rect tocr::app_did_draw_frame(bool remote, cv::Mat& frame, const SDL_Rect& draw_rect)
@@ -1066,14 +1060,10 @@ SDL_Rect tocr::app_did_draw_frame(bool remote, cv::Mat& frame, const SDL_Rect& d
 	SDL_QueryTexture(blended_tex_.second.get(), nullptr, nullptr, &tex_width, &tex_height);
 	VALIDATE(tex_width == frame.cols || tex_height == frame.rows, null_str); 
 
-	if (!current_surf_.first) {
-		threading::lock lock(variable_mutex_);
-		if (!current_surf_.second.get()) {
-			current_surf_.second = create_neutral_surface(frame.cols, frame.rows);
-		}
-		memcpy(current_surf_.second->pixels, frame.data, frame.cols * frame.rows * 4); 
-		current_surf_.first = true;
-	}
+	// caller locks avcapture's mutex, planes are valid during push.
+	ti420_planes planes;
+	const bool has_planes = avcapture_->i420_planes(remote, planes) && planes.width == frame.cols && planes.height == frame.rows;
+	pipeline_.push(frame, has_planes? &planes: NULL);
 
 	return draw_rect;
 }
@@ -1094,7 +1084,7 @@ void tocr::did_draw_paper(ttrack& widget, const SDL_Rect& widget_rect, const boo
 		surf = clone_surface(target_);
 	
 	
-		detect_and_blend_surf(surf, lines_);
+		detect_and_blend_surf(surf, verbose_, lines_);
 		generate_mark_line_png(lines_, surf, null_str);
 
 		render_surface(renderer, surf, nullptr, &widget_rect);
@@ -4,6 +4,8 @@
 #include "gui/dialogs/dialog.hpp"
 #include "ocr/ocr.hpp"
 #include "rtc_client.hpp"
+#include "frame_pipeline.hpp"
+#include "roi_tracker.hpp"
 
 namespace gui2 {
 
@@ -18,6 +20,10 @@ public:
 	~tocr();
 	surface target(tpoint& offset) const;
 
+	// detect text lines in surf, and blend them into it. used by camera pipeline and benchmark.
+	// gray is gray image of surf, for example Y plane of camera frame. if it is empty, converted from surf.
+	static void detect_and_blend_surf(surface& surf, bool verbose, std::vector<std::unique_ptr<tocr_line> >& lines, const cv::Mat& gray = cv::Mat());
+
 private:
 	/** Inherited from tdialog. */
 	void pre_show(CVideo& video, twindow& window);
@@ -34,28 +40,16 @@ private:
 	void did_mouse_motion_paper(ttrack& widget, const tpoint& first, const tpoint& last);
 	void save(twindow& window);
 
-	void detect_and_blend_surf(surface& surf, std::vector<std::unique_ptr<tocr_line> >& lines);
-
 	void start_avcapture();
 	void stop_avcapture();
 	SDL_Rect app_did_draw_frame(bool remote, cv::Mat& frame, const SDL_Rect& draw_rect);
 
-	class texecutor: public tworker
+	void did_detect_frame(tframe& frame);
+	void did_publish_frame(tframe& frame);
+
+	struct tlines_payload: public tframe_payload
 	{
-	public:
-		texecutor(tocr& ocr)
-			: ocr_(ocr)
-		{
-			thread_->Start();
-		}
-
-	private:
-		void DoWork() override;
-		void OnWorkStart() override {}
-		void OnWorkDone() override {}
-
-	private:
-		tocr& ocr_;
+		std::vector<std::unique_ptr<tocr_line> > lines;
 	};
 
 private:
@@ -66,37 +60,16 @@ private:
 	ttrack* paper_;
 	tbutton* save_;
 
-	class tsetting_lock
-	{
-	public:
-		tsetting_lock(tocr& ocr)
-			: ocr_(ocr)
-		{
-			VALIDATE(!ocr_.setting_, null_str);
-			ocr_.setting_ = true;
-		}
-		~tsetting_lock()
-		{
-			ocr_.setting_ = false;
-		}
-
-	private:
-		tocr& ocr_;
-	};
-	bool setting_;
-	bool recognition_thread_running_;
-
-	std::pair<bool, surface> current_surf_; // first: valid. now can recognition.
 	std::unique_ptr<tavcapture> avcapture_;
+	tframe_pipeline pipeline_;
+	troi_tracker tracker_; // used by detect stage only.
 
 	threading::mutex variable_mutex_;
-	threading::mutex recognition_mutex_;
 
 	std::pair<bool, texture> blended_tex_;
 	uint8_t* blended_tex_pixels_;
 	surface camera_surf_;
 
-	std::unique_ptr<texecutor> executor_;
 	tpoint thumbnail_size_;
 	tpoint original_local_offset_;
 	tpoint current_local_offset_;
@@ -122,6 +122,10 @@ tcontrol::~tcontrol()
 	while (!post_anims_.empty()) {
 		erase_animation(post_anims_.front());
 	}
+	twindow* window = get_window();
+	if (window) {
+		window->remove_image_waiter(this);
+	}
 }
 
 tpoint tcontrol::calculate_best_size_bh_multiline(const int width, const bool multiline)
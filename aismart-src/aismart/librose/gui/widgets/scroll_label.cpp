@@ -24,6 +24,7 @@
 #include "gui/widgets/scrollbar.hpp"
 #include "gui/widgets/spacer.hpp"
 #include "gui/widgets/window.hpp"
+#include "events.hpp"
 
 #include <boost/bind.hpp>
 
@@ -124,6 +125,8 @@ bool tscroll_label::exist_anim()
 				vertical_scrollbar_->set_item_position(item_position);
 				scrollbar_moved();
 			}
+			// it is polled during draw, don't let main loop sleep over next scroll.
+			events::require_wakeup(last_scroll_ticks_ + interval);
 		}
 	} else {
 		last_scroll_ticks_ = now;
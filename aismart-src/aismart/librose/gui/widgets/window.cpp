@@ -23,6 +23,7 @@
 #include "gui/widgets/window.hpp"
 #include "font.hpp"
 #include "display.hpp"
+#include "image.hpp"
 #include "gettext.hpp"
 #include "gui/auxiliary/event/distributor.hpp"
 #include "gui/auxiliary/event/message.hpp"
@@ -75,6 +76,7 @@ bool twindow::eat_left_up = false;
 const std::string twindow::visual_layout_id = "visual_layout";
 surface twindow::last_frame_buffer;
 twindow* twindow::init_instance = nullptr;
+twindow::tframe_stats twindow::frame_stats_;
 
 namespace {
 /**
@@ -113,6 +115,35 @@ static void delay_event(const SDL_Event& event, const Uint32 delay)
 	SDL_AddTimer(delay, delay_event_callback, new SDL_Event(event));
 }
 
+/**
+ * Milliseconds of one refresh of display that window is on.
+ */
+static int frame_interval(SDL_Window* window)
+{
+	SDL_DisplayMode mode;
+	if (window && SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0) {
+		return 1000 / mode.refresh_rate;
+	}
+	return 1000 / 60;
+}
+
+/**
+ * Maximum wait when nothing changed. timers, input and cross-thread wakeup
+ * push events, it is only for states that are polled in pump, for example network.
+ */
+static const int max_idle_wait = 100;
+
+/**
+ * Redraws before widget's underlay is captured, and bytes of all underlays.
+ */
+static const int underlay_capture_hits = 2;
+static const int max_underlay_bytes = 16 * 1024 * 1024;
+
+static bool rect_contains(const SDL_Rect& outer, const SDL_Rect& inner)
+{
+	return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.w <= outer.x + outer.w && inner.y + inner.h <= outer.y + outer.h;
+}
+
 } // namespace
 
 bool twindow::set_orientation_resolution()
@@ -197,6 +228,9 @@ twindow::twindow(CVideo& video,
 	, original_landscape_(current_landscape)
 	, tooltip_at_(twidget::npos)
 	, drag_widget_(nullptr)
+	, underlays_()
+	, underlay_bytes_(0)
+	, image_waiters_()
 	, event_distributor_(new event::tdistributor(
 			*this, event::tdispatcher::front_child))
 {
@@ -368,14 +402,39 @@ int twindow::show(const bool restore)
 	invalidate_layout();
 	suspend_drawing_ = false;
 
+	const int interval = frame_interval(video_.getWindow());
+
 	try {
 		// Start our loop drawing will happen here as well.
 		for (status_ = (status_ == REQUEST_CLOSE)? status_: SHOWING; status_ != REQUEST_CLOSE; ) {
+			const uint32_t start = SDL_GetTicks();
 			// process installed callback if valid, to allow e.g. network polling
-			events::pump();
-			absolute_draw();
-			// Add a delay so we don't keep spinning if there's no event.
-			SDL_Delay(10);
+			bool busy = events::pump() > 0;
+			std::vector<std::string> ready_files;
+			if (image::pump_async_decodes(&ready_files)) {
+				wake_image_waiters(ready_files);
+				busy = true;
+			}
+			if (!absolute_draw(busy)) {
+				// nothing changed, sleep until there is event.
+				frame_stats_.idle_waits ++;
+				events::wait(max_idle_wait);
+				continue;
+			}
+
+			const uint32_t end = SDL_GetTicks();
+			frame_stats_.frames ++;
+			frame_stats_.last_ms = end - start;
+			frame_stats_.total_ms += frame_stats_.last_ms;
+			if (frame_stats_.last_ms > frame_stats_.max_ms) {
+				frame_stats_.max_ms = frame_stats_.last_ms;
+			}
+
+			// animating or in touch, flip at most one frame every refresh.
+			const int remain = interval - (int)(end - start);
+			if (remain > 0) {
+				SDL_Delay(remain);
+			}
 		}
 	} catch(...) {
 		/**
@@ -412,13 +471,13 @@ int twindow::show(const bool restore)
 extern SDL_Rect dbg_start_rect;
 extern SDL_Rect dbg_end_rect;
 
-void twindow::draw()
+bool twindow::draw()
 {
 	display::tcanvas_drawing_buffer_lock lock(*display::get_singleton());
 	/***** ***** ***** ***** Init ***** ***** ***** *****/
 	// Prohibited from drawing?
 	if (suspend_drawing_) {
-		return;
+		return false;
 	}
 
 	// texture frame_buffer = video_.getTexture();
@@ -441,6 +500,8 @@ void twindow::draw()
 		}
 
 		layout();
+		// restorer_ and rect of widgets changed.
+		clear_underlays();
 
 		// Get new surface for restoring
 		SDL_Rect rect = get_rect();
@@ -491,6 +552,11 @@ void twindow::draw()
 	}
 */
 	int xsrc = 0, ysrc = 0;
+	const bool redrawn = !dirty_list_.empty();
+	SDL_Renderer* renderer = get_renderer();
+	const SDL_Rect frame_rect = ::create_rect(0, 0, frame_buffer_width, frame_buffer_height);
+	// damage rect and call stack of items drawn in this frame.
+	std::vector<std::pair<SDL_Rect, const std::vector<twidget*>*> > drawn_items;
 
 	BOOST_FOREACH(std::vector<twidget*>& item, dirty_list_) {
 
@@ -554,9 +620,60 @@ void twindow::draw()
 			}
 		}
 
-		if (!is_scene()) {
-			// Restore.
-			render_surface(get_renderer(), restorer_, NULL, &window_rect);
+		SDL_Rect damage;
+		if (!SDL_IntersectRect(&dirty_rect, &frame_rect, &damage)) {
+			damage = empty_rect;
+		}
+		const int64_t area = (int64_t)damage.w * damage.h;
+		frame_stats_.redrawn ++;
+
+		size_t first = 0;
+		bool restore = !is_scene(), merged = false;
+		// inside an item drawn before, its layers are above ancestors both have, don't cover them.
+		for (std::vector<std::pair<SDL_Rect, const std::vector<twidget*>*> >::const_reverse_iterator it = drawn_items.rbegin(); it != drawn_items.rend(); ++ it) {
+			if (!rect_contains(it->first, damage)) {
+				continue;
+			}
+			const std::vector<twidget*>& stack = *it->second;
+			while (first < stack.size() && first + 1 < item.size() && stack[first] == item[first]) {
+				first ++;
+			}
+			restore = false;
+			merged = true;
+			break;
+		}
+		if (merged) {
+			frame_stats_.merged ++;
+		} else {
+			frame_stats_.damage_pixels += area;
+		}
+
+		tunderlay* underlay = nullptr;
+		if (restore && area && item.size() >= 2 && item.back() == terminal) {
+			underlay = &underlays_[terminal];
+			std::vector<twidget*>& stack = underlay->stack;
+			if (underlay->rect != damage || stack.size() != item.size() - 1 || !std::equal(stack.begin(), stack.end(), item.begin())) {
+				release_underlay(*underlay);
+				underlay->rect = damage;
+				stack.assign(item.begin(), item.end() - 1);
+			}
+			if (underlay->tex.get()) {
+				// restore and ancestors are same as they were when captured.
+				ttexture_blend_none_lock lock(underlay->tex);
+				SDL_RenderCopy(renderer, underlay->tex.get(), NULL, &damage);
+				frame_stats_.underlay_hits ++;
+				frame_stats_.drawn_pixels += area;
+				first = item.size() - 1;
+				restore = false;
+				underlay = nullptr;
+
+			} else if (++ underlay->hits < underlay_capture_hits || underlay_bytes_ + area * 4 > max_underlay_bytes) {
+				underlay = nullptr;
+			}
+		}
+		if (restore) {
+			frame_stats_.drawn_pixels += area;
+			render_surface(renderer, restorer_, NULL, &window_rect);
 		}
 
 		/**
@@ -568,16 +685,25 @@ void twindow::draw()
 		 */
 
 		// Background.
-		for (std::vector<twidget*>::iterator itor = item.begin(); itor != item.end(); ++ itor) {
+		for (std::vector<twidget*>::iterator itor = item.begin() + std::min(first, item.size()); itor != item.end(); ++ itor) {
 			twidget* widget = *itor;
 
+			if (underlay && widget == terminal) {
+				texture_from_texture(frame_buffer, underlay->tex, &damage, 0, 0);
+				underlay_bytes_ += area * 4;
+			}
+
 			widget->draw_background(frame_buffer, xsrc, ysrc);
+			frame_stats_.drawn_pixels += area;
 
 			if (widget == terminal) {
 				widget->draw_children(frame_buffer, xsrc, ysrc);
 			}
 		}
 
+		erase_underlays(damage, item);
+		drawn_items.push_back(std::make_pair(damage, &item));
+
 		// Foreground.
 		for (std::vector<twidget*>::reverse_iterator ritor = item.rbegin(); ritor != item.rend(); ++ritor) {
 			twidget& widget = **ritor;
@@ -683,6 +809,7 @@ void twindow::draw()
 	populate_dirty_list(*this, call_stack);
 	VALIDATE(dirty_list_.empty(), "twinodw::draw, has dirty control!");
 */
+	return redrawn;
 }
 
 std::vector<std::vector<twidget*> >& twindow::dirty_list()
@@ -1203,6 +1330,74 @@ void twindow::insert_float_widget(const twindow_builder::tfloat_widget& builder,
 }
 
 // draw tooltip to screen
+void twindow::release_underlay(tunderlay& underlay)
+{
+	if (underlay.tex.get()) {
+		underlay.tex = nullptr;
+		underlay_bytes_ -= underlay.rect.w * underlay.rect.h * 4;
+	}
+	underlay.hits = 0;
+}
+
+void twindow::erase_underlays(const SDL_Rect& damage, const std::vector<twidget*>& call_stack)
+{
+	for (std::map<const twidget*, tunderlay>::iterator it = underlays_.begin(); it != underlays_.end(); ) {
+		// underlay of widget in call_stack has only layers under it, they aren't drawn.
+		if (!SDL_HasIntersection(&it->second.rect, &damage) || std::find(call_stack.begin(), call_stack.end(), it->first) != call_stack.end()) {
+			++ it;
+			continue;
+		}
+		release_underlay(it->second);
+		underlays_.erase(it ++);
+	}
+}
+
+void twindow::clear_underlays()
+{
+	underlays_.clear();
+	underlay_bytes_ = 0;
+}
+
+void twindow::wait_async_images(tcontrol& widget, const std::vector<std::string>& files)
+{
+	image_waiters_[&widget] = std::set<std::string>(files.begin(), files.end());
+}
+
+void twindow::wake_image_waiters(const std::vector<std::string>& ready_files)
+{
+	for (std::map<tcontrol*, std::set<std::string> >::iterator it = image_waiters_.begin(); it != image_waiters_.end(); ) {
+		bool ready = false;
+		for (std::vector<std::string>::const_iterator it2 = ready_files.begin(); it2 != ready_files.end(); ++ it2) {
+			if (it->second.count(*it2)) {
+				ready = true;
+				break;
+			}
+		}
+		if (!ready) {
+			++ it;
+			continue;
+		}
+		// its canvas is still dirty, redraw control. if there are other images, it will wait again.
+		it->first->set_dirty();
+		image_waiters_.erase(it ++);
+	}
+}
+
+bool twindow::float_widgets_dirty() const
+{
+	for (std::vector<std::unique_ptr<tfloat_widget> >::const_iterator it = float_widgets_.begin(); it != float_widgets_.end(); ++ it) {
+		const tfloat_widget& item = *(it->get());
+		const tcontrol& widget = *(item.widget.get());
+		if (widget.get_visible() != twidget::VISIBLE) {
+			continue;
+		}
+		if (item.need_layout || widget.get_dirty() || widget.get_redraw()) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void twindow::draw_float_widgets()
 {
 	SDL_Renderer* renderer = get_renderer();
@@ -1492,6 +1687,7 @@ void twindow::clear_texture()
 		item.buf = nullptr;
 		item.canvas = nullptr;
 	}
+	clear_underlays();
 	tpanel::clear_texture();
 }
 
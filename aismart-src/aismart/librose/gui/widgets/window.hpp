@@ -31,6 +31,7 @@
 #include "SDL.h"
 
 #include <string>
+#include <set>
 #include <boost/function.hpp>
 
 class CVideo;
@@ -133,6 +134,37 @@ public:
 	static const std::string visual_layout_id;
 	static surface last_frame_buffer;
 
+	// main loop of show. only accessed by main thread.
+	struct tframe_stats
+	{
+		tframe_stats()
+			: frames(0)
+			, idle_waits(0)
+			, last_ms(0)
+			, total_ms(0)
+			, max_ms(0)
+			, redrawn(0)
+			, merged(0)
+			, underlay_hits(0)
+			, damage_pixels(0)
+			, drawn_pixels(0)
+		{}
+
+		int frames; // flipped frames.
+		int idle_waits; // loops that nothing changed, so waited for event.
+		uint32_t last_ms; // pump and draw of last flipped frame.
+		uint32_t total_ms;
+		uint32_t max_ms;
+
+		// compositor of draw. overdraw is drawn_pixels / damage_pixels.
+		int redrawn; // dirty widgets.
+		int merged; // dirty widgets inside one drawn before, layers under both aren't drawn again.
+		int underlay_hits; // dirty widgets that cached underlay is used.
+		int64_t damage_pixels;
+		int64_t drawn_pixels; // every layer(restore, background of widget, underlay) counts.
+	};
+	static const tframe_stats& frame_stats() { return frame_stats_; }
+
 	event::tdistributor& distributor() { return *event_distributor_; }
 	void window_connect_disconnected(const bool connect);
 
@@ -207,8 +239,10 @@ public:
 	 * handler. This is done by a drawing event. When a window is shown it
 	 * manages an SDL timer which fires a drawing event every X milliseconds,
 	 * that event calls this routine. Don't call it manually.
+	 *
+	 * @returns                   Whether any widget is redrawn.
 	 */
-	void draw();
+	bool draw();
 
 	/**
 	 * Undraws the window.
@@ -470,6 +504,8 @@ public:
 	void insert_float_widget(const twindow_builder::tfloat_widget& builder, twidget& widget);
 	void draw_float_widgets();
 	void undraw_float_widgets();
+	// visible float widget requires layout or redraw.
+	bool float_widgets_dirty() const;
 	tfloat_widget* find_float_widget(const std::string& id) const;
 	const std::vector<std::unique_ptr<tfloat_widget> >& float_widgets() const { return float_widgets_; }
 
@@ -502,6 +538,8 @@ private:
 	void click_edit_button(const int id);
 
 private:
+	static tframe_stats frame_stats_;
+
 	/** Needed so we can change what's drawn on the screen. */
 	CVideo& video_;
 
@@ -664,11 +702,44 @@ private:
 	int tooltip_at_;
 	tfloat_widget* drag_widget_;
 
+	// restore and backgrounds of ancestors under a widget that is redrawn frequently,
+	// captured after they are drawn, so next redraw of widget blits it only.
+	struct tunderlay
+	{
+		tunderlay()
+			: tex()
+			, rect(empty_rect)
+			, stack()
+			, hits(0)
+		{}
+
+		texture tex;
+		SDL_Rect rect;
+		std::vector<twidget*> stack; // ancestors of widget.
+		int hits; // redraws with same rect and ancestors.
+	};
+	std::map<const twidget*, tunderlay> underlays_;
+	int underlay_bytes_;
+
+	void release_underlay(tunderlay& underlay);
+	// redraw in damage changes underlays that intersect it, except of widgets in call_stack.
+	void erase_underlays(const SDL_Rect& damage, const std::vector<twidget*>& call_stack);
+	void clear_underlays();
+
+	// controls whose canvas is waiting async decode, and files of the images.
+	std::map<tcontrol*, std::set<std::string> > image_waiters_;
+	// mark controls that wait one of ready_files dirty.
+	void wake_image_waiters(const std::vector<std::string>& ready_files);
+
 	bool scene_;
 
 	boost::function<void (twindow&, const int)> did_edit_click_;
 
 public:
+	// canvas of widget drew without these images, redraw it when one of them is decoded.
+	void wait_async_images(tcontrol& widget, const std::vector<std::string>& files);
+	void remove_image_waiter(tcontrol* widget) { image_waiters_.erase(widget); }
+
 	// mouse and keyboard_capture should be renamed and stored in the
 	// dispatcher. Chaining probably should remain exclusive to windows.
 	void mouse_capture(twidget* widget = nullptr);
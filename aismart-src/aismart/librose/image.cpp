@@ -32,203 +32,319 @@
 #include "gettext.hpp"
 #include "serialization/string_utils.hpp"
 #include "wml_exception.hpp"
+#include "events.hpp"
 
 #include "SDL_image.h"
 
 #include <boost/foreach.hpp>
 #include <boost/functional/hash.hpp>
 
+#include "thread.hpp"
+
 #include <list>
 #include <set>
+#include <deque>
+#include <unordered_map>
 
 static lg::log_domain log_display("display");
 #define ERR_DP LOG_STREAM(err, log_display)
 
-std::list<int> dummy_list;
-
 #if (defined(__APPLE__) && TARGET_OS_IPHONE) || defined(ANDROID)
-const size_t hash_table_size = 6000;
+const size_t surface_cache_bytes = 64 * 1024 * 1024;
+const size_t texture_cache_bytes = 64 * 1024 * 1024;
+const size_t bool_cache_items = 1500;
+const int decode_threads = 2;
 #else
-const size_t hash_table_size = 30000;
-// const size_t hash_table_size = 6000;
+const size_t surface_cache_bytes = 256 * 1024 * 1024;
+const size_t texture_cache_bytes = 256 * 1024 * 1024;
+const size_t bool_cache_items = 7500;
+const int decode_threads = 3;
 #endif
 
-struct hash_node {
-	size_t hash;
-	size_t hash1;
-	int index;
-};
+// bookkeeping of one entry(list node, hash node, key), it makes null entries count too.
+const size_t cache_entry_overhead = 64;
 
-template<typename T>
-struct cache_item
+static size_t cache_item_bytes(const surface& surf)
 {
-	cache_item(): 
-		item(), 
-		pos_in_hash_table(-1),
-		position(dummy_list.end())
-	{}
+	return surf? surf->h * surf->pitch: 0;
+}
 
-	T item;
-	int pos_in_hash_table;
-	std::list<int>::iterator position;
-};
+static size_t cache_item_bytes(const texture& tex)
+{
+	if (!tex.get()) {
+		return 0;
+	}
+	uint32_t format;
+	int w, h;
+	SDL_QueryTexture(tex.get(), &format, NULL, &w, &h);
+	return w * h * SDL_BYTESPERPIXEL(format);
+}
+
+static size_t cache_item_bytes(const bool&)
+{
+	return 0;
+}
 
 namespace image {
 
+//
+// LRU cache bounded by bytes of its items. all methods are thread-safe.
+//
 template<typename T>
 class cache_type
 {
 public:
-	cache_type(bool clear_cookie = true) :
-			cache_max_size_(hash_table_size / 4),
-			lru_list_(),
-			content_(),
-			clear_cookie_(clear_cookie)
+	cache_type(size_t max_bytes, bool clear_cookie = true)
+		: clear_cookie_(clear_cookie)
 	{
-		// content_.resize(cache_max_size_);
-		content_ = new cache_item<T>[cache_max_size_];
+		stats_.max_bytes = max_bytes;
+	}
 
-		for (int index = cache_max_size_ - 1; index >= 0; index --) {
-			lru_list_.push_front(index);
-			content_[index].position = lru_list_.begin();
-		}
-		for (int index = 0; index < hash_table_size; index ++) {
-			hash_table_[index].index = -1;
+	void flush(bool force = false)
+	{
+		threading::lock lock(mutex_);
+		if (force || clear_cookie_) {
+			lru_list_.clear();
+			index_.clear();
+			stats_.items = 0;
+			stats_.bytes = 0;
 		}
 	}
-	~cache_type() 
+
+	bool find(size_t hash, size_t hash1, T& data);
+	void add(size_t hash, size_t hash1, const T& item);
+
+	tcache_stats stats() const
 	{
-		delete []content_;
+		threading::lock lock(mutex_);
+		return stats_;
 	}
 
-	void flush(bool force = false) 
-	{ 
-		if (force || clear_cookie_) {
-			for (int index = cache_max_size_ - 1; index >= 0; index --) {
-				cache_item<T>& elt = content_[index];
-				if (elt.pos_in_hash_table != -1) {
-					hash_table_[elt.pos_in_hash_table].index = -1;
-					elt.item = NULL;
-				}
-				elt.pos_in_hash_table = -1;
-			}
-		}
-	}
-	int add(const T& item, size_t hash, size_t hash1);
+private:
+	struct tkey
+	{
+		tkey(size_t hash, size_t hash1)
+			: hash(hash)
+			, hash1(hash1)
+		{}
 
-	bool verify_pos();
-public:
-	
-	int cache_max_size_;
+		bool operator==(const tkey& that) const { return hash == that.hash && hash1 == that.hash1; }
+
+		size_t hash;
+		size_t hash1;
+	};
+
+	struct tkey_hash
+	{
+		size_t operator()(const tkey& key) const { return key.hash ^ (key.hash1 * 31); }
+	};
+
+	struct titem
+	{
+		titem(const tkey& key, const T& item, size_t bytes)
+			: key(key)
+			, item(item)
+			, bytes(bytes)
+		{}
+
+		tkey key;
+		T item;
+		size_t bytes;
+	};
+
+	typedef typename std::list<titem>::iterator titerator;
+
+	mutable threading::mutex mutex_;
 	bool clear_cookie_;
-    std::list<int> lru_list_;
-	// std::vector<cache_item<T> > content_;
-	cache_item<T>* content_;
-	hash_node hash_table_[hash_table_size];
+	std::list<titem> lru_list_; // front is the most recently used.
+	std::unordered_map<tkey, titerator, tkey_hash> index_;
+	tcache_stats stats_;
 };
 
 template<typename T>
-bool cache_type<T>::verify_pos()
+bool cache_type<T>::find(size_t hash, size_t hash1, T& data)
 {
-	size_t valid_in_locator_table, valid_in_content;
+	threading::lock lock(mutex_);
+	typename std::unordered_map<tkey, titerator, tkey_hash>::iterator it = index_.find(tkey(hash, hash1));
+	if (it == index_.end()) {
+		stats_.misses ++;
+		return false;
+	}
+	stats_.hits ++;
+	if (it->second != lru_list_.begin()) {
+		lru_list_.splice(lru_list_.begin(), lru_list_, it->second);
+	}
+	data = it->second->item;
+	return true;
+}
 
-	valid_in_locator_table = 0;
-	for (int index = 0; index < hash_table_size; index ++) {
-		if (hash_table_[index].index != -1) {
-			valid_in_locator_table ++;
-		}
+template<typename T>
+void cache_type<T>::add(size_t hash, size_t hash1, const T& item)
+{
+	const tkey key(hash, hash1);
+	const size_t bytes = cache_item_bytes(item) + cache_entry_overhead;
+
+	threading::lock lock(mutex_);
+	typename std::unordered_map<tkey, titerator, tkey_hash>::iterator it = index_.find(key);
+	if (it != index_.end()) {
+		// another thread added it during decode.
+		stats_.bytes -= it->second->bytes;
+		lru_list_.erase(it->second);
+		index_.erase(it);
+		stats_.items --;
 	}
 
-	valid_in_content = 0;
-	for (int index = cache_max_size_ - 1; index >= 0; index --) {
-		cache_item<T>& elt = content_[index];
-		if (elt.pos_in_hash_table != -1) {
-			valid_in_content ++;
-		}
+	lru_list_.push_front(titem(key, item, bytes));
+	index_.insert(std::make_pair(key, lru_list_.begin()));
+	stats_.items ++;
+	stats_.bytes += bytes;
+
+	// evict from tail, but always keep the new one even if it's larger than budget.
+	while (stats_.bytes > stats_.max_bytes && lru_list_.size() > 1) {
+		titem& victim = lru_list_.back();
+		stats_.bytes -= victim.bytes;
+		index_.erase(victim.key);
+		lru_list_.pop_back();
+		stats_.items --;
+		stats_.evictions ++;
 	}
-	return valid_in_locator_table == valid_in_content;
 }
 
-template<typename T>
-int cache_type<T>::add(const T& item, size_t hash, size_t hash1)
+template <typename T>
+bool locator::locate_in_cache(cache_type<T>& cache, T& data) const
 {
-	// in hash_table, find a empty position.
-	size_t pos = hash % hash_table_size;
-	while (hash_table_[pos].index != -1) {
-		if (++ pos == hash_table_size) {
-			pos = 0;
+	return cache.find(hash_, hash1_, data);
+}
+
+template <typename T>
+void locator::add_to_cache(cache_type<T>& cache, const T& data) const
+{
+	cache.add(hash_, hash1_, data);
+}
+
+//
+// IMG_Load on worker threads. path lookup and post-process are on main thread,
+// they use filesystem/image globals that aren't thread-safe.
+//
+class tdecode_pool
+{
+public:
+	struct ttask
+	{
+		locator loc;
+		std::string location;
+		std::string localized;
+		surface res;
+	};
+
+	tdecode_pool(int threads)
+		: running_(true)
+	{
+		for (int at = 0; at < threads; at ++) {
+			workers_.push_back(std::unique_ptr<tdecode_worker>(new tdecode_worker(*this)));
 		}
 	}
 
-	// calcuate index of content_
-	int index = lru_list_.back();
+	~tdecode_pool()
+	{
+		{
+			threading::lock lock(mutex_);
+			running_ = false;
+			cond_.notify_all();
+		}
+		// tworker's destructor waits thread to exit.
+		workers_.clear();
+	}
 
-	cache_item<T>& elt = content_[index];
-	if (elt.pos_in_hash_table != -1) {
-		hash_table_[elt.pos_in_hash_table].index = -1;
+	// return false if it's in queue or decoding.
+	bool push(const locator& loc)
+	{
+		{
+			threading::lock lock(mutex_);
+			if (pending_.count(loc)) {
+				return false;
+			}
+			pending_.insert(loc);
+		}
+
+		ttask task;
+		task.loc = loc;
+		task.location = loc.image_file_location(task.localized);
+
+		threading::lock lock(mutex_);
+		queue_.push_back(task);
+		cond_.notify_one();
+		return true;
 	}
-	elt.item = item;
-	elt.pos_in_hash_table = pos;
 
-	lru_list_.erase(elt.position);
-	lru_list_.push_front(index);
-	elt.position = lru_list_.begin();
+	void take_finished(std::vector<ttask>& tasks)
+	{
+		threading::lock lock(mutex_);
+		for (std::vector<ttask>::const_iterator it = finished_.begin(); it != finished_.end(); ++ it) {
+			pending_.erase(it->loc);
+		}
+		tasks.swap(finished_);
+		finished_.clear();
+	}
 
-	// fill (hash,hash1,index)
-	hash_table_[pos].hash = hash;
-	hash_table_[pos].hash1 = hash1;
-	hash_table_[pos].index = index;
+private:
+	class tdecode_worker: public tworker
+	{
+	public:
+		tdecode_worker(tdecode_pool& pool)
+			: pool_(pool)
+		{
+			thread_->Start();
+		}
 
-	return index;
-}
+	private:
+		void DoWork() override { pool_.run(); }
+		void OnWorkStart() override {}
+		void OnWorkDone() override {}
 
-template <typename T>
-int locator::in_cache(cache_type<T>& cache) const
-{
-	int stop_after_invalids = 4;
+	private:
+		tdecode_pool& pool_;
+	};
 
-	hash_node* hash_table = cache.hash_table_;
+	void run()
+	{
+		while (true) {
+			ttask task;
+			{
+				threading::lock lock(mutex_);
+				while (running_ && queue_.empty()) {
+					cond_.wait(mutex_);
+				}
+				if (!running_) {
+					break;
+				}
+				task = queue_.front();
+				queue_.pop_front();
+			}
 
-	size_t pos = hash_ % hash_table_size;
-	do {
-		while (hash_table[pos].index != -1) {
-			hash_node* node = hash_table + pos;
-			if (node->hash == hash_ && node->hash1 == hash1_) {
-				return node->index;
+			if (!task.location.empty()) {
+				task.res = IMG_Load(task.location.c_str());
 			}
-			if (++ pos == hash_table_size) {
-				pos = 0;
+
+			{
+				threading::lock lock(mutex_);
+				finished_.push_back(task);
 			}
+			// main thread maybe waiting for event.
+			events::wakeup();
 		}
-		if (++ pos == hash_table_size) {
-			pos = 0;
-		}
-	} while (-- stop_after_invalids);
-	return -1;
-}
-
-template <typename T>
-const T& locator::locate_in_cache(cache_type<T>& cache, int index) const
-{
-	static T dummy;
-	if (index < 0) {
-		return dummy;
-	}
-	std::list<int>& lru_list = cache.lru_list_;
-	cache_item<T>& elt = cache.content_[index];
-	if (index != lru_list.front()) {
-		lru_list.erase(elt.position);
-		lru_list.push_front(index);
-		elt.position = lru_list.begin();
 	}
-	return elt.item;
-}
 
-template <typename T>
-void locator::add_to_cache(cache_type<T>& cache, const T& data) const
-{
-	cache.add(data, hash_, hash1_);
-}
+private:
+	threading::mutex mutex_;
+	threading::condition cond_;
+	volatile bool running_;
+
+	std::deque<ttask> queue_;
+	std::vector<ttask> finished_;
+	std::set<locator> pending_; // in queue_, decoding or in finished_.
+	std::vector<std::unique_ptr<tdecode_worker> > workers_;
+};
 
 }
 
@@ -308,15 +424,18 @@ ttile_switch_lock::~ttile_switch_lock()
 namespace {
 
 /** Definition of all image maps */
-static image::image_cache images(false);
-static image::texture_cache unscaled_textures;
-static image::texture_cache masked_textures;
+static image::image_cache images(surface_cache_bytes, false);
+static image::texture_cache unscaled_textures(texture_cache_bytes / 2);
+static image::texture_cache masked_textures(texture_cache_bytes / 2);
 
 // cache storing if each image fit in a hex
-image::bool_cache in_hex_info_;
+image::bool_cache in_hex_info_(bool_cache_items * cache_entry_overhead);
 
 // cache storing if this is an empty hex
-image::bool_cache is_empty_hex_;
+image::bool_cache is_empty_hex_(bool_cache_items * cache_entry_overhead);
+
+// created when first async decode is requested.
+static std::unique_ptr<image::tdecode_pool> decode_pool;
 
 std::map<std::string, bool> image_existence_map;
 
@@ -334,11 +453,6 @@ int zoom = image::tile_size;
 
 } // end anon namespace
 
-void image_verify_pos()
-{
-	images.verify_pos();
-}
-
 namespace image {
 /*
 void tblits::clear(bool free_buf)
@@ -672,9 +786,9 @@ bool is_full_filename(const std::string& filename)
 #endif
 }
 
-surface locator::load_image_file() const
+std::string locator::image_file_location(std::string& localized) const
 {
-	surface res;
+	localized.clear();
 
 	std::string location;
 	if (is_full_filename(val_.filename_)) {
@@ -684,40 +798,55 @@ surface locator::load_image_file() const
 		location = get_binary_file_location("images", val_.filename_);
 	}
 
-	{
-		if (!location.empty()) {
-			// Check if there is a localized image.
-			const std::string loc_location = get_localized_path(location);
-			if (!loc_location.empty()) {
-				location = loc_location;
-			}
-
-			uint32_t start = SDL_GetTicks();
-
-			res = IMG_Load(location.c_str());
+	if (!location.empty()) {
+		// Check if there is a localized image.
+		localized = get_localized_path(location);
+		if (!localized.empty()) {
+			location = localized;
+		}
+	}
+	return location;
+}
 
-			uint32_t stop = SDL_GetTicks();
-			if (stop - start > 20) {
-				posix_print("IMG_Load(%s), used %i\n", location.c_str(), stop - start);
-			}
+surface locator::loaded_image_file(const std::string& location, const std::string& localized, const surface& res) const
+{
+	surface result = res;
 
-			// If there was no standalone localized image, check if there is an overlay.
-			if (!res.null() && loc_location.empty()) {
-				const std::string ovr_location = get_localized_path(location, "--overlay");
-				if (!ovr_location.empty()) {
-					add_localized_overlay(ovr_location, res);
-				}
-			}
+	// If there was no standalone localized image, check if there is an overlay.
+	if (!result.null() && localized.empty()) {
+		const std::string ovr_location = get_localized_path(location, "--overlay");
+		if (!ovr_location.empty()) {
+			add_localized_overlay(ovr_location, result);
 		}
 	}
 
-	if (res.null() && !val_.filename_.empty()) {
+	if (result.null() && !val_.filename_.empty()) {
 		ERR_DP << "could not open image '" << val_.filename_ << "'\n";
 		if (game_config::debug && val_.filename_ != game_config::images::missing)
 			return get_image(game_config::images::missing);
 	}
 
-	return res;
+	return result;
+}
+
+surface locator::load_image_file() const
+{
+	surface res;
+
+	std::string localized;
+	const std::string location = image_file_location(localized);
+	if (!location.empty()) {
+		uint32_t start = SDL_GetTicks();
+
+		res = IMG_Load(location.c_str());
+
+		uint32_t stop = SDL_GetTicks();
+		if (stop - start > 20) {
+			posix_print("IMG_Load(%s), used %i\n", location.c_str(), stop - start);
+		}
+	}
+
+	return loaded_image_file(location, localized, res);
 }
 
 surface locator::load_image_sub_file() const
@@ -1135,6 +1264,7 @@ manager::manager() {}
 
 manager::~manager()
 {
+	decode_pool.reset();
 	flush_cache();
 }
 
@@ -1269,43 +1399,110 @@ bool shoule_use_rle(const SDL_Surface* surf)
 	return true;
 }
 
+// Optimizes surface before storing it
+static void optimize_cached_surface(surface& res)
+{
+	if (res) {
+		res = create_optimized_surface(res);
+		bool rle = shoule_use_rle(res);
+		SDL_SetSurfaceRLE(res, rle? SDL_RLEACCEL: 0);
+	}
+}
+
 surface get_image(const image::locator& i_locator)
 {
 	surface res;
-	int index;
 
 	if (i_locator.is_void()) {
 		return res;
 	}
 
-	image_cache* imap = &images;
 	// return the image if already cached
-	if ((index = i_locator.in_cache(*imap)) >= 0) {
-		return i_locator.locate_in_cache(*imap, index);
+	if (i_locator.locate_in_cache(images, res)) {
+		return res;
 	}
 
 	// not cached, generate it
 	res = i_locator.load_from_disk();
+	optimize_cached_surface(res);
+	i_locator.add_to_cache(images, res);
 
-	// Optimizes surface before storing it
-	if (res) {
-		res = create_optimized_surface(res);
-		bool rle = shoule_use_rle(res);
-		SDL_SetSurfaceRLE(res, rle? SDL_RLEACCEL: 0);
+	return res;
+}
+
+surface get_image_async(const image::locator& i_locator, bool& ready)
+{
+	surface res;
+	ready = true;
+
+	if (i_locator.is_void()) {
+		return res;
 	}
-	i_locator.add_to_cache(*imap, res);
 
+	// finished decodes are pumped by window's loop, so it knows which canvases to redraw.
+	if (i_locator.locate_in_cache(images, res)) {
+		return res;
+	}
+
+	// sub file is cut from its parent, it's fast once parent is in cache.
+	if (i_locator.get_type() != locator::FILE) {
+		return get_image(i_locator);
+	}
+
+	if (!decode_pool.get()) {
+		decode_pool.reset(new tdecode_pool(decode_threads));
+	}
+	decode_pool->push(i_locator);
+	ready = false;
 	return res;
 }
 
+int pump_async_decodes(std::vector<std::string>* ready_files)
+{
+	if (!decode_pool.get()) {
+		return 0;
+	}
+
+	std::vector<tdecode_pool::ttask> tasks;
+	decode_pool->take_finished(tasks);
+	for (std::vector<tdecode_pool::ttask>::const_iterator it = tasks.begin(); it != tasks.end(); ++ it) {
+		const tdecode_pool::ttask& task = *it;
+		surface res = task.loc.loaded_image_file(task.location, task.localized, task.res);
+		optimize_cached_surface(res);
+		task.loc.add_to_cache(images, res);
+		if (ready_files) {
+			ready_files->push_back(task.loc.get_filename());
+		}
+	}
+	return tasks.size();
+}
+
+tcache_stats surface_cache_stats()
+{
+	return images.stats();
+}
+
+tcache_stats texture_cache_stats()
+{
+	const tcache_stats unscaled = unscaled_textures.stats();
+	const tcache_stats masked = masked_textures.stats();
+
+	tcache_stats result;
+	result.hits = unscaled.hits + masked.hits;
+	result.misses = unscaled.misses + masked.misses;
+	result.evictions = unscaled.evictions + masked.evictions;
+	result.items = unscaled.items + masked.items;
+	result.bytes = unscaled.bytes + masked.bytes;
+	result.max_bytes = unscaled.max_bytes + masked.max_bytes;
+	return result;
+}
+
 texture get_unscaled_texture(const image::locator& i_locator)
 {
-	int index;
 	texture res;
 	texture_cache* imap = &unscaled_textures;
 
-	if ((index = i_locator.in_cache(*imap)) >= 0) {
-		res = i_locator.locate_in_cache(*imap, index);
+	if (i_locator.locate_in_cache(*imap, res)) {
 	} else {
 		surface surf = get_image(i_locator);
 		if (!surf) {
@@ -1324,12 +1521,10 @@ texture get_unscaled_texture(const image::locator& i_locator)
 
 texture get_hex_masked_texture(const image::locator& i_locator)
 {
-	int index;
 	texture res;
 	texture_cache* imap = &masked_textures;
 
-	if ((index = i_locator.in_cache(*imap)) >= 0) {
-		res = i_locator.locate_in_cache(*imap, index);
+	if (i_locator.locate_in_cache(*imap, res)) {
 
 	} else {
 		surface surf = get_hexed2(i_locator);
@@ -1536,9 +1731,9 @@ surface get_hexmask()
 
 bool is_in_hex(const locator& i_locator)
 {
-	int index;
-	if ((index = i_locator.in_cache(in_hex_info_)) >= 0) {
-		return i_locator.locate_in_cache(in_hex_info_, index);
+	bool cached;
+	if (i_locator.locate_in_cache(in_hex_info_, cached)) {
+		return cached;
 	} else {
 		const surface image(get_image(i_locator));
 
@@ -1555,12 +1750,12 @@ bool is_in_hex(const locator& i_locator)
 
 bool is_empty_hex(const locator& i_locator)
 {
-	int index;
-	if ((index = i_locator.in_cache(is_empty_hex_)) < 0) {
+	bool is_empty_cached;
+	if (!i_locator.locate_in_cache(is_empty_hex_, is_empty_cached)) {
 		const surface surf = get_image(i_locator);
 		// emptiness of terrain image is checked during hex cut
 		// so, maybe in cache now, let's recheck
-		if ((index = i_locator.in_cache(is_empty_hex_)) < 0) {
+		if (!i_locator.locate_in_cache(is_empty_hex_, is_empty_cached)) {
 			//should never reach here
 			//but do it manually if it happens
 			//assert(false);
@@ -1570,7 +1765,7 @@ bool is_empty_hex(const locator& i_locator)
 			return is_empty;
 		}
 	}
-	return i_locator.locate_in_cache(is_empty_hex_, index);
+	return is_empty_cached;
 }
 
 bool exists(const image::locator& i_locator)
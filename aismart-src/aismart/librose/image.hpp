@@ -99,13 +99,18 @@ public:
 	// loads the image it is pointing to from the disk
 	surface load_from_disk() const;
 
+	// cache is thread-safe, so data is copied out.
 	template <typename T>
-	int in_cache(cache_type<T> &cache) const;
-	template <typename T>
-	const T &locate_in_cache(cache_type<T> &cache, int index) const;
+	bool locate_in_cache(cache_type<T> &cache, T &data) const;
 	template <typename T>
 	void add_to_cache(cache_type<T> &cache, const T &data) const;
 
+	// load_image_file is split into three steps, so decode(IMG_Load) can run on worker thread.
+	// step#1, main thread: location of the file to decode. localized is not empty if it's a localized one.
+	std::string image_file_location(std::string& localized) const;
+	// step#3, main thread: overlay/missing handling of decoded res.
+	surface loaded_image_file(const std::string& location, const std::string& localized, const surface& res) const;
+
 private:
 
 	surface load_image_file() const;
@@ -290,6 +295,29 @@ extern mini_terrain_cache_map mini_fogged_terrain_cache;
 
 void flush_cache(bool force = false);
 
+struct tcache_stats
+{
+	tcache_stats()
+		: hits(0)
+		, misses(0)
+		, evictions(0)
+		, items(0)
+		, bytes(0)
+		, max_bytes(0)
+	{}
+
+	int hits;
+	int misses;
+	int evictions;
+	int items;
+	size_t bytes;
+	size_t max_bytes;
+};
+
+// surface: decoded images. texture: unscaled and hex masked textures.
+tcache_stats surface_cache_stats();
+tcache_stats texture_cache_stats();
+
 ///the image manager is responsible for setting up images, and destroying
 ///all images when the program exits. It should probably
 ///be created once for the life of the program
@@ -334,6 +362,15 @@ void set_zoom(int zoom);
 ///SDL_FreeSurface()
 surface get_image(const locator& i_locator);
 
+///same as get_image, but file isn't decoded on calling thread. when it isn't cached,
+///decode is queued to worker threads, ready is false and a null surface is returned as placeholder.
+///call it again after pump_async_decodes reports its file.
+surface get_image_async(const locator& i_locator, bool& ready);
+
+///move finished decodes into cache, must be called on main thread.
+///return count of images that become ready since last call, ready_files(if not nullptr) receives their files.
+int pump_async_decodes(std::vector<std::string>* ready_files = nullptr);
+
 void render_blit(SDL_Renderer* renderer, const image::tblit& blit, const int xpos, const int ypos);
 
 ///function to get the standard hex mask
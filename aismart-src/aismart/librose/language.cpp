@@ -23,6 +23,7 @@
 #include "serialization/parser.hpp"
 #include "serialization/preprocessor.hpp"
 #include "loadscreen.hpp"
+#include "xwml.hpp"
 
 #include <stdexcept>
 #include <clocale>
@@ -87,18 +88,36 @@ const t_string& symbol_table::operator[](const char* key) const
 
 bool load_language_list()
 {
+	const std::string fname = game_config::path + "/xwml/" + "language.bin";
+	known_languages.clear();
+	known_languages.push_back(
+		language_def("", _("System default language"), "ltr", "", "A"));
+
+	// only [locale]s are required, read them from view.
+	const txwml_view view(fname);
+	if (view.valid()) {
+		const txwml_view::tnode root = view.root();
+		const int children = root.children();
+		for (int at = 0; at < children; at ++) {
+			const txwml_view::tnode lang = root.child_at(at);
+			if (lang.key() != "locale") {
+				continue;
+			}
+			known_languages.push_back(
+				language_def(lang.attribute("locale").to_string(), lang.attribute_tstr("name"), lang.attribute("dir").to_string(),
+							 lang.attribute("alternates").to_string(), lang.attribute("sort_name").to_string()));
+		}
+		return true;
+	}
+
 	config cfg;
 	try {
-		wml_config_from_file(game_config::path + "/xwml/" + "language.bin", cfg);
+		wml_config_from_file(fname, cfg);
 		
 	} catch(config::error &) {
 		return false;
 	}
 
-	known_languages.clear();
-	known_languages.push_back(
-		language_def("", _("System default language"), "ltr", "", "A"));
-
 	BOOST_FOREACH (const config &lang, cfg.child_range("locale"))
 	{
 		known_languages.push_back(
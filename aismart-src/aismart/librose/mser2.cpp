@@ -171,8 +171,7 @@ namespace cv
     struct WParams
     {
       Params p;
-      vector<vector<Point> >* msers;
-      vector<Rect>* bboxvec;
+      MSERRegions* regions;
       Pixel* pix0;
       int step;
       float similyThresh;
@@ -423,9 +422,10 @@ namespace cv
           return;
 
         int xmin = INT_MAX, ymin = INT_MAX, xmax = INT_MIN, ymax = INT_MIN, j = 0;
-        wp.msers->push_back(vector<Point>());
-        vector<Point>& region = wp.msers->back();
-        region.resize(size);
+        vector<Point>& points = wp.regions->points;
+        const size_t base = points.size();
+        points.resize(base + size);
+        Point* region = &points[base];
         const Pixel* pix0 = wp.pix0;
         int step = wp.step;
 
@@ -446,7 +446,8 @@ namespace cv
 
           region[j] = Point(x, y);
         }
-        wp.bboxvec->push_back(Rect(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1));
+        wp.regions->offsets.push_back((int)points.size());
+        wp.regions->bboxes.push_back(Rect(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1));
       }
 
       CompHistory* child_;
@@ -573,78 +574,73 @@ namespace cv
 
 
  
-    void preprocess1(const Mat& img, int* level_size)
+    // every pass has its own buffers, so dark and bright pass can run at the same time.
+    struct PassBuffers
+    {
+      vector<Pixel> pixbuf;
+      vector<Pixel*> heapbuf;
+      vector<CompHistory> histbuf;
+    };
+
+    static void levelSize(const Mat& img, int* level_size)
     {
       memset(level_size, 0, 256 * sizeof(level_size[0]));
 
       int i, j, cols = img.cols, rows = img.rows;
-      int step = cols;
-      pixbuf.resize(step*rows);
-      heapbuf.resize(cols*rows + 256);
-      histbuf.resize(cols*rows);
-      Pixel borderpix;
-      borderpix.setDir(5);
-
-      for (j = 0; j < step; j++)
-      {
-        pixbuf[j] = pixbuf[j + (rows - 1)*step] = borderpix;
-      }
-
       for (i = 1; i < rows - 1; i++)
       {
         const uchar* imgptr = img.ptr(i);
-        Pixel* pptr = &pixbuf[i*step];
-        pptr[0] = pptr[cols - 1] = borderpix;
         for (j = 1; j < cols - 1; j++)
         {
-          int val = imgptr[j];
-          level_size[val]++;
-          pptr[j].val = 0;
+          level_size[imgptr[j]]++;
         }
       }
     }
 
-    void preprocess2(const Mat& img, int* level_size)
+    static void preprocess(const Mat& img, PassBuffers& buf)
     {
-      int i;
+      int i, j, cols = img.cols, rows = img.rows;
+      int step = cols;
+      buf.pixbuf.resize(step*rows);
+      buf.heapbuf.resize(cols*rows + 256);
+      buf.histbuf.resize(cols*rows);
+      Pixel borderpix;
+      borderpix.setDir(5);
 
-      for (i = 0; i < 128; i++)
-        std::swap(level_size[i], level_size[255 - i]);
+      for (j = 0; j < step; j++)
+      {
+        buf.pixbuf[j] = buf.pixbuf[j + (rows - 1)*step] = borderpix;
+      }
 
-      if (!params.pass2Only)
+      for (i = 1; i < rows - 1; i++)
       {
-        int j, cols = img.cols, rows = img.rows;
-        int step = cols;
-        for (i = 1; i < rows - 1; i++)
+        Pixel* pptr = &buf.pixbuf[i*step];
+        pptr[0] = pptr[cols - 1] = borderpix;
+        for (j = 1; j < cols - 1; j++)
         {
-          Pixel* pptr = &pixbuf[i*step + 1];
-          for (j = 1; j < cols - 1; j++)
-          {
-            pptr[j].val = 0;
-          }
+          pptr[j].val = 0;
         }
       }
     }
 
-    void pass(const Mat& img, vector<vector<Point> >& msers, vector<Rect>& bboxvec,
-      Size size, const int* level_size, int mask)
+    void pass(const Mat& img, MSERRegions& regions, PassBuffers& buf,
+      Size size, const int* level_size, int mask) const
     {
-      CompHistory* histptr = &histbuf[0];
+      CompHistory* histptr = &buf.histbuf[0];
       int step = size.width;
-      Pixel *ptr0 = &pixbuf[0], *ptr = &ptr0[step + 1];
+      Pixel *ptr0 = &buf.pixbuf[0], *ptr = &ptr0[step + 1];
       const uchar* imgptr0 = img.ptr();
       Pixel** heap[256];
       ConnectedComp comp[257];
       ConnectedComp* comptr = &comp[0];
       WParams wp;
       wp.p = params;
-      wp.msers = &msers;
-      wp.bboxvec = &bboxvec;
+      wp.regions = &regions;
       wp.pix0 = ptr0;
       wp.step = step;
       wp.similyThresh = 0.7f;
 
-      heap[0] = &heapbuf[0];
+      heap[0] = &buf.heapbuf[0];
       heap[0][0] = 0;
 
       for (int i = 1; i < 256; i++)
@@ -768,10 +764,84 @@ namespace cv
       }
     }
 
+    class PassInvoker : public ParallelLoopBody
+    {
+    public:
+      PassInvoker(const MSER_Impl2& impl, const Mat& src, MSERRegions* regions[2], const int* level_size[2])
+        : impl_(impl)
+        , src_(src)
+      {
+        for (int i = 0; i < 2; i++) {
+          regions_[i] = regions[i];
+          level_size_[i] = level_size[i];
+        }
+      }
+
+      void operator()(const Range& range) const
+      {
+        for (int i = range.start; i < range.end; i++) {
+          // pass#0: darker to brighter (MSER+), pass#1: brighter to darker (MSER-)
+          impl_.pass(src_, *regions_[i], impl_.bufs[i], src_.size(), level_size_[i], i ? 255 : 0);
+        }
+      }
+
+    private:
+      const MSER_Impl2& impl_;
+      const Mat& src_;
+      MSERRegions* regions_[2];
+      const int* level_size_[2];
+    };
+
+    // return false if src isn't 8-bit gray, and src is continuous when return true.
+    bool prepareSrc(InputArray _src, Mat& src)
+    {
+      src = _src.getMat();
+      if (src.total() == 0 || src.type() != CV_8U) {
+        return false;
+      }
+      if (!src.isContinuous()) {
+        src.copyTo(tempsrc);
+        src = tempsrc;
+      }
+      return true;
+    }
+
+    // dark: MSER+ regions, skipped when dark is null. bright: MSER- regions.
+    void detectRegions2(const Mat& src, MSERRegions* dark, MSERRegions& bright)
+    {
+      int level_size[256], inv_level_size[256];
+      levelSize(src, level_size);
+      for (int i = 0; i < 256; i++) {
+        inv_level_size[i] = level_size[255 - i];
+      }
+
+      if (!dark) {
+        preprocess(src, bufs[1]);
+        pass(src, bright, bufs[1], src.size(), inv_level_size, 255);
+        return;
+      }
+
+      preprocess(src, bufs[0]);
+      preprocess(src, bufs[1]);
+      MSERRegions* regions[2] = { dark, &bright };
+      const int* level_sizes[2] = { level_size, inv_level_size };
+      parallel_for_(Range(0, 2), PassInvoker(*this, src, regions, level_sizes));
+    }
+
+    static void toVectors(const MSERRegions& regions, vector<vector<Point> >& msers, vector<Rect>& bboxes)
+    {
+      const int count = regions.size();
+      msers.reserve(msers.size() + count);
+      for (int i = 0; i < count; i++) {
+        const Point* pts = regions.region(i);
+        msers.push_back(vector<Point>(pts, pts + regions.regionSize(i)));
+      }
+      bboxes.insert(bboxes.end(), regions.bboxes.begin(), regions.bboxes.end());
+    }
+
     Mat tempsrc;
-    vector<Pixel> pixbuf;
-    vector<Pixel*> heapbuf;
-    vector<CompHistory> histbuf;
+    mutable PassBuffers bufs[2];
+    MSERRegions tempregions[2];
     
     Params params;
 
@@ -779,59 +849,59 @@ namespace cv
       vector<vector<Point>>& msers_yellow, vector<Rect>& bboxes_yellow);
 
     void detectRegions(InputArray _src, vector<vector<Point>>& msers, vector<Rect>& bboxes, int type);
+
+    void detectRegions(InputArray _src, MSERRegions& blue, MSERRegions& yellow);
+
+    void detectRegions(InputArray _src, MSERRegions& regions, int type);
   };
 
-  void MSER_Impl2::detectRegions(InputArray _src, vector<vector<Point>>& msers_blue, vector<Rect>& bboxes_blue,
-  vector<vector<Point>>& msers_yellow, vector<Rect>& bboxes_yellow)
+  void MSER_Impl2::detectRegions(InputArray _src, MSERRegions& blue, MSERRegions& yellow)
   {
-    Mat src = _src.getMat();
-    size_t npix = src.total();
-    if (npix == 0) return;
+    blue.clear();
+    yellow.clear();
 
-    Size size = src.size();
-    if (src.type() == CV_8U) {
-      int level_size[256];
-      if (!src.isContinuous()) {
-        src.copyTo(tempsrc);
-        src = tempsrc;
-      }
+    Mat src;
+    if (!prepareSrc(_src, src)) return;
+
+    // darker to brighter (MSER+) dont need when plate is blue
+    detectRegions2(src, params.pass2Only ? NULL : &yellow, blue);
+  }
+
+  void MSER_Impl2::detectRegions(InputArray _src, MSERRegions& regions, int type)
+  {
+    regions.clear();
 
-      // darker to brighter (MSER+)
-      // dont need when plate is blue
-      preprocess1(src, level_size);
-      if (!params.pass2Only)
-        pass(src, msers_yellow, bboxes_yellow, size, level_size, 0);
+    Mat src;
+    if (!prepareSrc(_src, src)) return;
 
-      // brighter to darker (MSER-)
-      preprocess2(src, level_size);
-      pass(src, msers_blue, bboxes_blue, size, level_size, 255);
+    if (!type) {
+      detectRegions2(src, NULL, regions);
+      return;
     }
+    // keep MSER+ regions ahead of MSER- regions.
+    MSERRegions& bright = tempregions[1];
+    bright.clear();
+    detectRegions2(src, &regions, bright);
+    regions.append(bright);
   }
 
-  void MSER_Impl2::detectRegions(InputArray _src, vector<vector<Point>>& msers, vector<Rect>& bboxes, int type)
+  void MSER_Impl2::detectRegions(InputArray _src, vector<vector<Point>>& msers_blue, vector<Rect>& bboxes_blue,
+  vector<vector<Point>>& msers_yellow, vector<Rect>& bboxes_yellow)
   {
-    Mat src = _src.getMat();
-    size_t npix = src.total();
-    if (npix == 0) return;
+    MSERRegions& blue = tempregions[1];
+    MSERRegions& yellow = tempregions[0];
+    detectRegions(_src, blue, yellow);
 
-    Size size = src.size();
-    if (src.type() == CV_8U) {
-      int level_size[256];
-      if (!src.isContinuous()) {
-        src.copyTo(tempsrc);
-        src = tempsrc;
-      }
+    toVectors(yellow, msers_yellow, bboxes_yellow);
+    toVectors(blue, msers_blue, bboxes_blue);
+  }
 
-      // darker to brighter (MSER+)
-      // dont need when plate is blue
-      preprocess1(src, level_size);
-      if (type) 
-        pass(src, msers, bboxes, size, level_size, 0);
+  void MSER_Impl2::detectRegions(InputArray _src, vector<vector<Point>>& msers, vector<Rect>& bboxes, int type)
+  {
+    MSERRegions& regions = tempregions[0];
+    detectRegions(_src, regions, type);
 
-      // brighter to darker (MSER-)
-      preprocess2(src, level_size);
-      pass(src, msers, bboxes, size, level_size, 255);
-    }
+    toVectors(regions, msers, bboxes);
   }
 
 
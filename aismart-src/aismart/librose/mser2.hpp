@@ -1,3 +1,6 @@
+#ifndef LIBROSE_MSER2_HPP_INCLUDED
+#define LIBROSE_MSER2_HPP_INCLUDED
+
 #ifndef __OPENCV_PRECOMP_H__
 #define __OPENCV_PRECOMP_H__
 
@@ -22,6 +25,40 @@ namespace cv
 
   using std::vector;
 
+  // all regions of one detection share one flat point array.
+  // points of region i are points[offsets[i]] ... points[offsets[i + 1] - 1].
+  struct MSERRegions
+  {
+    MSERRegions() { clear(); }
+
+    void clear()
+    {
+      points.clear();
+      offsets.assign(1, 0);
+      bboxes.clear();
+    }
+
+    int size() const { return (int)bboxes.size(); }
+    int regionSize(int i) const { return offsets[i + 1] - offsets[i]; }
+    const Point* region(int i) const { return &points[offsets[i]]; }
+    // n x 1 CV_32SC2 header on arena, same layout as Mat(vector<Point>). no copy.
+    Mat regionMat(int i) const { return Mat(regionSize(i), 1, CV_32SC2, (void*)region(i)); }
+
+    void append(const MSERRegions& that)
+    {
+      const int base = (int)points.size();
+      points.insert(points.end(), that.points.begin(), that.points.end());
+      for (size_t i = 1; i < that.offsets.size(); i++) {
+        offsets.push_back(base + that.offsets[i]);
+      }
+      bboxes.insert(bboxes.end(), that.bboxes.begin(), that.bboxes.end());
+    }
+
+    vector<Point> points;
+    vector<int> offsets;
+    vector<Rect> bboxes;
+  };
+
   class CV_EXPORTS_W MSER2
   {
   public:
@@ -35,6 +72,10 @@ namespace cv
       vector<vector<Point>>& msers_yellow, vector<Rect>& bboxes_yellow) = 0;
     CV_WRAP virtual void detectRegions(InputArray _src, vector<vector<Point>>& msers, vector<Rect>& bboxes, int type) = 0;
 
+    // dark-to-bright and bright-to-dark passes run concurrently, each with its own buffers.
+    virtual void detectRegions(InputArray _src, MSERRegions& blue, MSERRegions& yellow) = 0;
+    virtual void detectRegions(InputArray _src, MSERRegions& regions, int type) = 0;
+
     CV_WRAP virtual void setDelta(int delta) = 0;
     CV_WRAP virtual int getDelta() const = 0;
 
@@ -47,4 +88,6 @@ namespace cv
     CV_WRAP virtual void setPass2Only(bool f) = 0;
     CV_WRAP virtual bool getPass2Only() const = 0;
   };
-}
\ No newline at end of file
+}
+
+#endif
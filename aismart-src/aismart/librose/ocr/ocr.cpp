@@ -4,6 +4,68 @@
 #include "serialization/string_utils.hpp"
 #include "sdl_utils.hpp"
 #include "wml_exception.hpp"
+#include "posix2.h"
+
+trect_grid::trect_grid(int width, int height, int cell_size)
+	: cell_size_(cell_size)
+	, cols_(std::max(1, (width + cell_size - 1) / cell_size))
+	, rows_(std::max(1, (height + cell_size - 1) / cell_size))
+	, rects_()
+	, cells_(cols_ * rows_)
+	, stamps_()
+	, stamp_(0)
+{
+	VALIDATE(cell_size > 0, null_str);
+}
+
+void trect_grid::cell_range(const trect& rect, int& col0, int& row0, int& col1, int& row1) const
+{
+	col0 = posix_clip(rect.x / cell_size_, 0, cols_ - 1);
+	row0 = posix_clip(rect.y / cell_size_, 0, rows_ - 1);
+	col1 = posix_clip((rect.x + rect.w - 1) / cell_size_, 0, cols_ - 1);
+	row1 = posix_clip((rect.y + rect.h - 1) / cell_size_, 0, rows_ - 1);
+}
+
+void trect_grid::insert(const trect& rect)
+{
+	const int index = rects_.size();
+	rects_.push_back(rect);
+	stamps_.push_back(0);
+
+	int col0, row0, col1, row1;
+	cell_range(rect, col0, row0, col1, row1);
+	for (int row = row0; row <= row1; row ++) {
+		for (int col = col0; col <= col1; col ++) {
+			cells_[row * cols_ + col].push_back(index);
+		}
+	}
+}
+
+bool trect_grid::overlap(const trect& rect) const
+{
+	if (rects_.empty()) {
+		return false;
+	}
+	stamp_ ++;
+
+	int col0, row0, col1, row1;
+	cell_range(rect, col0, row0, col1, row1);
+	for (int row = row0; row <= row1; row ++) {
+		for (int col = col0; col <= col1; col ++) {
+			const std::vector<int>& cell = cells_[row * cols_ + col];
+			for (std::vector<int>::const_iterator it = cell.begin(); it != cell.end(); ++ it) {
+				if (stamps_[*it] == stamp_) {
+					continue;
+				}
+				stamps_[*it] = stamp_;
+				if (rects_[*it].rect_overlap(rect)) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
 
 void tocr_line::calculate_bounding_rect()
 {
@@ -4,6 +4,7 @@
 #include "util.hpp"
 #include "config.hpp"
 #include <set>
+#include <vector>
 
 struct trect
 {
@@ -81,6 +82,33 @@ struct trect
 	SDL_Rect to_SDL_Rect() const { return SDL_Rect{x, y, w, h}; }
 };
 
+//
+// uniform grid of rects. overlap query visits only rects in cells that it covers, instead of all rects.
+// part of rect out of grid's area is clamped into border cells.
+//
+class trect_grid
+{
+public:
+	trect_grid(int width, int height, int cell_size);
+
+	void insert(const trect& rect);
+	bool overlap(const trect& rect) const;
+	bool empty() const { return rects_.empty(); }
+
+private:
+	void cell_range(const trect& rect, int& col0, int& row0, int& col1, int& row1) const;
+
+private:
+	const int cell_size_;
+	const int cols_;
+	const int rows_;
+	std::vector<trect> rects_;
+	std::vector<std::vector<int> > cells_; // index of rects_.
+	// rect that spans cells is in every cell, stamp avoids testing it again in one query.
+	mutable std::vector<int> stamps_;
+	mutable int stamp_;
+};
+
 class tocr_line 
 {
 public:
@@ -340,10 +340,12 @@ void ocr_controller::did_recognize(gui2::tprogress_& progress)
 
 		symbols["field"] = line.field;
 		progress.set_message(vgettext2("Recognizeing $field", symbols));
+		progress.set_percentage(100 * recognized_chars / total_chars);
 
+		// collect all chars of this line, then inference them in one batch.
+		std::vector<cv::Mat> char_mats;
+		char_mats.reserve(line.chars.size());
 		for (std::set<trect>::const_iterator it2 = line.chars.begin(); it2 != line.chars.end(); ++ it2, char_at ++) {
-			progress.set_percentage(100 * recognized_chars / total_chars);
-
 			cv::Rect clip_rect(it2->x, it2->y, it2->w, it2->h);
 			cv::Mat tmp;
 			cv::threshold(gray(clip_rect), tmp, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
@@ -360,14 +362,16 @@ void ocr_controller::did_recognize(gui2::tprogress_& progress)
 				save_surface_to_file(tmp2, game_config::preferences_dir + "/3.png");
 			}
 */
-			uint32_t used_ticks_one = 0;
-			wchar_t wch = tensorflow2::inference_char(current_session_, pb_path_, tmp, &used_ticks_one);
-			result.append(UCS2_to_UTF8(wch));
-			used_ticks += used_ticks_one;
+			char_mats.push_back(tmp);
+		}
 
-			recognized_chars ++;
-			// SDL_Delay(100);
+		std::vector<uint32_t> char_ticks;
+		const std::vector<wchar_t> wchs = tensorflow2::inference_chars(current_session_, pb_path_, char_mats, &char_ticks);
+		for (int at = 0; at < (int)wchs.size(); at ++) {
+			result.append(UCS2_to_UTF8(wchs[at]));
+			used_ticks += char_ticks[at];
 		}
+		recognized_chars += char_mats.size();
 		recognize_result_.insert(std::make_pair(line.field, tocr_result(result, used_ticks)));
 	}
 	progress.set_percentage(gui2::tprogress_::finish_precentage);
@@ -7,7 +7,7 @@
 #include "ocr_unit_map.hpp"
 #include "map.hpp"
 
-#include <tensorflow/core/public/session.h>
+#include "tensorflow2.hpp"
 
 class ocr_controller : public base_controller, public events::mouse_handler_base
 {
@@ -71,7 +71,7 @@ private:
 	std::pair<ocr_unit*, int> adjusting_line_;
 	tpoint start_adjusting_xy_;
 
-	std::pair<std::string, std::unique_ptr<tensorflow::Session> > current_session_;
+	tensorflow2::tsession current_session_;
 	std::map<std::string, tocr_result> recognize_result_;
 };
 
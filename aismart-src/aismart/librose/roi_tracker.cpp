@@ -0,0 +1,161 @@
+#define GETTEXT_DOMAIN "rose-lib"
+
+#include "roi_tracker.hpp"
+#include "wml_exception.hpp"
+#include "serialization/string_utils.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+// gray is downscaled by it before block matching.
+static const int motion_scale = 4;
+// search range in downscaled pixels.
+static const int motion_radius = 6;
+// mean of squared difference per pixel, larger means region changed, not only moved.
+static const double max_motion_error = 400;
+// weight of new detection when smoothing.
+static const float smooth_alpha = 0.5f;
+
+static float overlap_ratio(const cv::Rect& a, const cv::Rect& b)
+{
+	const int intersection = (a & b).area();
+	if (!intersection) {
+		return 0;
+	}
+	return (float)intersection / (a.area() + b.area() - intersection);
+}
+
+troi_tracker::troi_tracker(int refresh_frames, int max_missed)
+	: refresh_frames_(refresh_frames)
+	, max_missed_(max_missed)
+	, prev_small_()
+	, frame_size_(0, 0)
+	, tracks_()
+	, frames_since_full_(0)
+	, lost_(true)
+{
+	VALIDATE(refresh_frames > 0 && max_missed >= 0, null_str);
+}
+
+void troi_tracker::reset()
+{
+	prev_small_.release();
+	frame_size_ = cv::Size(0, 0);
+	tracks_.clear();
+	frames_since_full_ = 0;
+	lost_ = true;
+}
+
+bool troi_tracker::estimate_motion(const cv::Mat& small, ttrack& track) const
+{
+	const cv::Rect bounds(0, 0, small.cols, small.rows);
+	const cv::Rect templ_rect = cv::Rect(track.rect.x / motion_scale, track.rect.y / motion_scale,
+		track.rect.width / motion_scale, track.rect.height / motion_scale) & bounds;
+	if (templ_rect.width < 2 || templ_rect.height < 2) {
+		return false;
+	}
+	const cv::Rect search = cv::Rect(templ_rect.x - motion_radius, templ_rect.y - motion_radius,
+		templ_rect.width + 2 * motion_radius, templ_rect.height + 2 * motion_radius) & bounds;
+
+	cv::Mat result;
+	cv::matchTemplate(small(search), prev_small_(templ_rect), result, cv::TM_SQDIFF);
+	double min_value;
+	cv::Point min_loc;
+	cv::minMaxLoc(result, &min_value, NULL, &min_loc, NULL);
+	if (min_value / templ_rect.area() > max_motion_error) {
+		return false;
+	}
+
+	const int dx = (search.x + min_loc.x - templ_rect.x) * motion_scale;
+	const int dy = (search.y + min_loc.y - templ_rect.y) * motion_scale;
+	track.x += dx;
+	track.y += dy;
+	track.rect.x += dx;
+	track.rect.y += dy;
+	return true;
+}
+
+bool troi_tracker::track(const cv::Mat& gray)
+{
+	VALIDATE(gray.type() == CV_8UC1, null_str);
+
+	cv::Mat small;
+	cv::resize(gray, small, cv::Size(gray.cols / motion_scale, gray.rows / motion_scale), 0, 0, cv::INTER_AREA);
+
+	if (gray.size() != frame_size_) {
+		tracks_.clear();
+		frame_size_ = gray.size();
+		prev_small_.release();
+	}
+
+	if (!prev_small_.empty()) {
+		for (std::vector<ttrack>::iterator it = tracks_.begin(); it != tracks_.end(); ++ it) {
+			if (!estimate_motion(small, *it)) {
+				lost_ = true;
+			}
+		}
+	}
+	prev_small_ = small;
+
+	frames_since_full_ ++;
+	return lost_ || tracks_.empty() || frames_since_full_ >= refresh_frames_;
+}
+
+cv::Rect troi_tracker::search_rect(int margin) const
+{
+	VALIDATE(!tracks_.empty(), null_str);
+
+	cv::Rect ret = tracks_.front().rect;
+	for (std::vector<ttrack>::const_iterator it = tracks_.begin(); it != tracks_.end(); ++ it) {
+		ret |= it->rect;
+	}
+	ret = cv::Rect(ret.x - margin, ret.y - margin, ret.width + 2 * margin, ret.height + 2 * margin);
+	return ret & cv::Rect(0, 0, frame_size_.width, frame_size_.height);
+}
+
+void troi_tracker::update(const std::vector<cv::Rect>& detected, bool full)
+{
+	if (full) {
+		frames_since_full_ = 0;
+		lost_ = false;
+	}
+
+	std::vector<bool> matched(tracks_.size(), false);
+	std::vector<ttrack> born;
+	for (std::vector<cv::Rect>::const_iterator it = detected.begin(); it != detected.end(); ++ it) {
+		const cv::Rect& rect = *it;
+		int best = -1;
+		float best_ratio = 0.3f;
+		for (int at = 0; at < (int)tracks_.size(); at ++) {
+			const float ratio = overlap_ratio(tracks_[at].rect, rect);
+			if (!matched[at] && ratio > best_ratio) {
+				best = at;
+				best_ratio = ratio;
+			}
+		}
+		if (best == -1) {
+			born.push_back(ttrack(rect));
+			continue;
+		}
+
+		ttrack& track = tracks_[best];
+		matched[best] = true;
+		track.x += smooth_alpha * (rect.x - track.x);
+		track.y += smooth_alpha * (rect.y - track.y);
+		track.w += smooth_alpha * (rect.width - track.w);
+		track.h += smooth_alpha * (rect.height - track.h);
+		track.rect = cv::Rect(cvRound(track.x), cvRound(track.y), cvRound(track.w), cvRound(track.h));
+		track.hits ++;
+		track.missed = 0;
+	}
+
+	std::vector<ttrack> tracks;
+	for (int at = 0; at < (int)tracks_.size(); at ++) {
+		ttrack& track = tracks_[at];
+		if (!matched[at] && ++ track.missed > max_missed_) {
+			continue;
+		}
+		tracks.push_back(track);
+	}
+	tracks.insert(tracks.end(), born.begin(), born.end());
+	tracks_.swap(tracks);
+}
@@ -0,0 +1,62 @@
+#ifndef LIBROSE_ROI_TRACKER_HPP_INCLUDED
+#define LIBROSE_ROI_TRACKER_HPP_INCLUDED
+
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+//
+// track regions that detector found between camera frames, so detector can run only in them.
+// motion of every region is estimated by block matching on downscaled gray(Y plane).
+// full frame detection is required periodically, when there is no region or a region is lost.
+// all methods must be called on one thread, normally pipeline's detect stage.
+//
+class troi_tracker
+{
+public:
+	struct ttrack
+	{
+		ttrack(const cv::Rect& rect)
+			: rect(rect)
+			, x(rect.x)
+			, y(rect.y)
+			, w(rect.width)
+			, h(rect.height)
+			, hits(1)
+			, missed(0)
+		{}
+
+		cv::Rect rect; // smoothed
+		float x, y, w, h; // smoothed, without rounding.
+		int hits;
+		int missed;
+	};
+
+	explicit troi_tracker(int refresh_frames = 15, int max_missed = 3);
+
+	// move tracks by motion from previous frame. return true if caller should detect in full frame.
+	bool track(const cv::Mat& gray);
+
+	// union of tracks expanded by margin, clipped to frame. valid after track returns false.
+	cv::Rect search_rect(int margin) const;
+
+	// detected rects of this frame in frame coordinate. full is whether detection ran in full frame.
+	void update(const std::vector<cv::Rect>& detected, bool full);
+
+	const std::vector<ttrack>& tracks() const { return tracks_; }
+	void reset();
+
+private:
+	bool estimate_motion(const cv::Mat& small, ttrack& track) const;
+
+private:
+	const int refresh_frames_;
+	const int max_missed_;
+
+	cv::Mat prev_small_;
+	cv::Size frame_size_;
+	std::vector<ttrack> tracks_;
+	int frames_since_full_;
+	bool lost_;
+};
+
+#endif
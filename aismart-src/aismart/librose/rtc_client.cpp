@@ -205,10 +205,29 @@ void trtc_client::VideoRenderer::OnFrame(const webrtc::VideoFrame& video_frame)
             pixels,
 			pitch,
             buffer->width(), buffer->height());
+		i420_ = buffer;
 	}
 	dirty_ = true;
 }
 
+bool trtc_client::i420_planes(bool remote, ti420_planes& planes) const
+{
+	const VideoRenderer* renderer = vrenderer(remote);
+	if (!renderer || !renderer->i420().get()) {
+		return false;
+	}
+	const webrtc::I420BufferInterface& buffer = *renderer->i420().get();
+	planes.y = buffer.DataY();
+	planes.stride_y = buffer.StrideY();
+	planes.u = buffer.DataU();
+	planes.stride_u = buffer.StrideU();
+	planes.v = buffer.DataV();
+	planes.stride_v = buffer.StrideV();
+	planes.width = buffer.width();
+	planes.height = buffer.height();
+	return true;
+}
+
 void trtc_client::set_renderer_texture_size(bool remote, int width, int height)
 {
 	texture& tex = remote? remote_tex_: local_tex_;
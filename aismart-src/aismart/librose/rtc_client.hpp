@@ -28,6 +28,7 @@
 #include "webrtc/base/sigslot.h"
 
 #include "sdl_utils.hpp"
+#include "frame_pipeline.hpp"
 
 class DummySetSessionDescriptionObserver
 	: public webrtc::SetSessionDescriptionObserver {
@@ -61,6 +62,9 @@ public:
 	threading::mutex& get_mutex(bool remote) { return remote? remote_mutex_: local_mutex_; }
 	uint8_t* pixels(bool remote) const { return remote? remote_pixels_: local_pixels_; }
 	texture& get_texture(bool remote) { return remote? remote_tex_: local_tex_; }
+	// planes of last I420 frame, they are valid while get_mutex(remote) is locked.
+	// return false if there is no frame.
+	bool i420_planes(bool remote, ti420_planes& planes) const;
 
 	class VideoRenderer : public rtc::VideoSinkInterface<webrtc::VideoFrame> {
 	public:
@@ -71,11 +75,14 @@ public:
 		void OnFrame(const webrtc::VideoFrame& frame) override;
 
 		bool dirty() const { return dirty_; }
+		// frame that was converted into pixels last, keep it so consumer can use planes without conversion.
+		const rtc::scoped_refptr<webrtc::I420BufferInterface>& i420() const { return i420_; }
 
 	private:
 		trtc_client& client_;
 		int bytesperpixel_;
 		rtc::scoped_refptr<webrtc::VideoTrackInterface> rendered_track_;
+		rtc::scoped_refptr<webrtc::I420BufferInterface> i420_;
 		bool remote_;
 		bool dirty_;
 	};
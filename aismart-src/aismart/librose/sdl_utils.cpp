@@ -161,7 +161,8 @@ tsurface_2_mat_lock::tsurface_2_mat_lock(const surface& surf)
 	if (SDL_MUSTLOCK(surface_)) {
 		locked_ = SDL_LockSurface(surface_) == 0;
 	}
-	mat = cv::Mat(surf->h, surf->w, CV_8UC4, surf->pixels);
+	// surface maybe view of part of a larger one, rows are pitch apart.
+	mat = cv::Mat(surf->h, surf->w, CV_8UC4, surf->pixels, surf->pitch);
 }
 
 tsurface_2_mat_lock::~tsurface_2_mat_lock()
@@ -183,8 +184,8 @@ ttexture_2_mat_lock::ttexture_2_mat_lock(texture& tex)
 	uint8_t* pixels = nullptr;
 	int pitch = 0;
 	SDL_LockTexture(tex.get(), NULL, (void**)&pixels, &pitch);
-	VALIDATE(pitch == width * 4, null_str);
-	mat = cv::Mat(height, width, CV_8UC4, pixels);
+	// some GPUs pad rows of texture, pitch maybe larger than width * 4.
+	mat = cv::Mat(height, width, CV_8UC4, pixels, pitch);
 }
 
 struct RGB2Gray
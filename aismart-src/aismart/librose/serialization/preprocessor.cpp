@@ -31,9 +31,17 @@
 #include "filesystem.hpp"
 #include "util.hpp"
 #include "wml_exception.hpp"
+#include "sha1.hpp"
+#include "thread.hpp"
 
 #include <boost/foreach.hpp>
 #include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
 
 static lg::log_domain log_config("config");
 #define ERR_CF LOG_STREAM(err, log_config)
@@ -45,9 +53,17 @@ static lg::log_domain log_config("config");
 using std::streambuf;
 
 
-// map associating each filename encountered to a number
-typedef std::map<std::string, int> t_file_number_map;
+// map associating each filename encountered to a number, and back.
+// the number is a hash of the filename, so a file gets the same code in every
+// run, and cached expansions, which contain codes, stay valid.
+typedef std::map<std::string, uint32_t> t_file_number_map;
 static t_file_number_map file_number_map;
+static std::map<uint32_t, std::string> file_name_map;
+// files are encoded on worker threads too.
+static threading::mutex file_number_mutex;
+// false once two filenames hashed to the same number, codes then depend on
+// the order files are encountered, and the cache can't be used.
+static std::atomic<bool> stable_file_numbers(true);
 
 static bool encode_filename = true;
 
@@ -58,13 +74,13 @@ static std::string get_filename(const std::string& file_code){
 
 	std::stringstream s;
 	s << file_code;
-	int n = 0;
+	uint32_t n = 0;
 	s >> std::hex >> n;
 
-	BOOST_FOREACH (const t_file_number_map::value_type& p, file_number_map){
-		if(p.second == n)
-			return p.first;
-	}
+	threading::lock lock(file_number_mutex);
+	std::map<uint32_t, std::string>::const_iterator it = file_name_map.find(n);
+	if (it != file_name_map.end())
+		return it->second;
 	return "<unknown>";
 }
 
@@ -73,12 +89,28 @@ static std::string get_file_code(const std::string& filename){
 	if(!encode_filename)
 		return filename;
 
-	// current number of encountered filenames
-	static int current_file_number = 0;
-
-	int& fnum = file_number_map[utils::escape(filename, " \\")];
-	if(fnum == 0)
-		fnum = ++current_file_number;
+	const std::string escaped = utils::escape(filename, " \\");
+	uint32_t fnum;
+	{
+		threading::lock lock(file_number_mutex);
+		t_file_number_map::const_iterator it = file_number_map.find(escaped);
+		if (it != file_number_map.end()) {
+			fnum = it->second;
+		} else {
+			// FNV-1a
+			fnum = 2166136261u;
+			for (std::string::const_iterator c = escaped.begin(); c != escaped.end(); ++c) {
+				fnum ^= static_cast<unsigned char>(*c);
+				fnum *= 16777619u;
+			}
+			while (fnum == 0 || file_name_map.count(fnum)) {
+				stable_file_numbers = false;
+				++fnum;
+			}
+			file_number_map[escaped] = fnum;
+			file_name_map[fnum] = escaped;
+		}
+	}
 
 	std::ostringstream shex;
 	shex << std::hex << fnum;
@@ -182,8 +214,76 @@ class preprocessor;
 class preprocessor_file;
 class preprocessor_data;
 class preprocessor_streambuf;
+class preprocessor_pool;
 struct preprocessor_deleter;
 
+/** Directory of the expansion cache, empty when disabled. */
+static std::string preprocessor_cache_dir;
+
+/**
+ * What an expansion done by a #preprocessor_job depends on and changes.
+ * Shared by all the buffers of that job.
+ */
+struct preprocessor_record
+{
+	struct dependency
+	{
+		bool directory;
+		/** Hash of the content of a file, or of the .cfg files of a directory. */
+		std::string hash;
+	};
+
+	preprocessor_record() : dependencies(), nfiles(0), sum_size(0), modified(0), defines(), cacheable(true) {}
+	void add_file(std::string const &name, const char *data, int size);
+	void add_directory(std::string const &name, std::vector< std::string > const &files);
+
+	std::map< std::string, dependency > dependencies;
+	/** Contribution to #preprocessor_checksum. */
+	size_t nfiles, sum_size;
+	time_t modified;
+	/**
+	 * Copy of the defines made by the first #define or #undef.
+	 * The defines given to the job are read by other jobs at the same time.
+	 */
+	std::unique_ptr< preproc_map > defines;
+	/** False when the result depends on something not tracked, e.g. #ifhave. */
+	bool cacheable;
+};
+
+/**
+ * Expansion of one file of a directory, run by a #preprocessor_pool.
+ * It starts from the state the target has between two files, so its output
+ * is the same as if the file were expanded in place.
+ */
+struct preprocessor_job
+{
+	enum STATE { QUEUED, RUNNING, DONE };
+
+	preprocessor_job(std::string const &name, preprocessor_streambuf const &t, std::string const &cache_key);
+	void run();
+
+	std::string name;
+	/** Defines of the target, they aren't modified until the job is done. */
+	preproc_map *defines;
+	std::string textdomain;
+	std::string location;
+	int linenum;
+	int depth;
+	bool quoted;
+	/** Name of the cache file, empty if the cache can't be used. */
+	std::string cache_key;
+
+	/** Protected by the mutex of the pool. */
+	STATE state;
+	std::string text;
+	preprocessor_record record;
+	std::exception_ptr error;
+
+private:
+	bool load_cache();
+	void save_cache() const;
+};
+
 /**
  * Base class for preprocessing an input.
  */
@@ -217,6 +317,10 @@ class preprocessor_streambuf: public streambuf
 	preprocessor *current_;       /**< Input preprocessor. */
 	preproc_map *defines_;
 	preproc_map default_defines_;
+	/** Set when expanding for a #preprocessor_job. */
+	preprocessor_record *record_;
+	/** Expands the files of directories in parallel, NULL on worker threads. */
+	preprocessor_pool *pool_;
 	std::string textdomain_;
 	std::string location_;
 	int linenum_;
@@ -230,10 +334,15 @@ class preprocessor_streambuf: public streambuf
 	friend class preprocessor_file;
 	friend class preprocessor_data;
 	friend struct preprocessor_deleter;
+	friend struct preprocessor_job;
 	preprocessor_streambuf(preprocessor_streambuf const &);
 public:
 	preprocessor_streambuf(preproc_map *);
+	explicit preprocessor_streambuf(preprocessor_job &);
 	void error(const std::string &, int);
+	preproc_map const &defines() const
+	{ return record_ && record_->defines ? *record_->defines : *defines_; }
+	preproc_map &writable_defines();
 };
 
 preprocessor_streambuf::preprocessor_streambuf(preproc_map *def) :
@@ -243,6 +352,8 @@ preprocessor_streambuf::preprocessor_streambuf(preproc_map *def) :
 	current_(NULL),
 	defines_(def),
 	default_defines_(),
+	record_(NULL),
+	pool_(NULL),
 	textdomain_("rose-lib"),
 	location_(""),
 	linenum_(0),
@@ -251,6 +362,23 @@ preprocessor_streambuf::preprocessor_streambuf(preproc_map *def) :
 {
 }
 
+preprocessor_streambuf::preprocessor_streambuf(preprocessor_job &job) :
+	streambuf(),
+	out_buffer_(""),
+	buffer_(),
+	current_(NULL),
+	defines_(job.defines),
+	default_defines_(),
+	record_(&job.record),
+	pool_(NULL),
+	textdomain_(job.textdomain),
+	location_(job.location),
+	linenum_(job.linenum),
+	depth_(job.depth),
+	quoted_(job.quoted)
+{
+}
+
 preprocessor_streambuf::preprocessor_streambuf(preprocessor_streambuf const &t) :
 	streambuf(),
 	out_buffer_(""),
@@ -258,6 +386,8 @@ preprocessor_streambuf::preprocessor_streambuf(preprocessor_streambuf const &t)
 	current_(NULL),
 	defines_(t.defines_),
 	default_defines_(),
+	record_(t.record_),
+	pool_(t.pool_),
 	textdomain_("rose-lib"),
 	location_(""),
 	linenum_(0),
@@ -266,6 +396,15 @@ preprocessor_streambuf::preprocessor_streambuf(preprocessor_streambuf const &t)
 {
 }
 
+preproc_map &preprocessor_streambuf::writable_defines()
+{
+	if (!record_)
+		return *defines_;
+	if (!record_->defines)
+		record_->defines.reset(new preproc_map(*defines_));
+	return *record_->defines;
+}
+
 /**
  * Called by an STL stream whenever it has reached the end of #out_buffer_.
  * Fills #buffer_ by calling the #current_ preprocessor, then copies its
@@ -385,6 +524,126 @@ preprocessor::~preprocessor()
 	--target_.depth_;
 }
 
+/**
+ * Worker threads running #preprocessor_job.
+ * Jobs are waited for and cancelled by the main thread only.
+ */
+class preprocessor_pool
+{
+public:
+	explicit preprocessor_pool(int threads)
+		: mutex_()
+		, cond_()
+		, done_cond_()
+		, running_(true)
+		, queue_()
+		, workers_()
+	{
+		for (int at = 0; at < threads; ++at) {
+			workers_.push_back(std::unique_ptr<preprocessor_worker>(new preprocessor_worker(*this)));
+		}
+	}
+
+	~preprocessor_pool()
+	{
+		{
+			threading::lock lock(mutex_);
+			running_ = false;
+			cond_.notify_all();
+		}
+		// tworker's destructor waits thread to exit.
+		workers_.clear();
+	}
+
+	int threads() const { return workers_.size(); }
+
+	void push(std::shared_ptr<preprocessor_job> const &job)
+	{
+		threading::lock lock(mutex_);
+		job->state = preprocessor_job::QUEUED;
+		queue_.push_back(job);
+		cond_.notify_one();
+	}
+
+	void wait(preprocessor_job const &job)
+	{
+		threading::lock lock(mutex_);
+		while (job.state != preprocessor_job::DONE) {
+			done_cond_.wait(mutex_);
+		}
+	}
+
+	/** Drops the queued jobs, and waits for the running ones. */
+	void cancel(std::deque< std::shared_ptr<preprocessor_job> > const &jobs)
+	{
+		threading::lock lock(mutex_);
+		BOOST_FOREACH (std::shared_ptr<preprocessor_job> const &job, jobs) {
+			if (job->state == preprocessor_job::QUEUED) {
+				queue_.erase(std::find(queue_.begin(), queue_.end(), job));
+				job->state = preprocessor_job::DONE;
+			}
+		}
+		BOOST_FOREACH (std::shared_ptr<preprocessor_job> const &job, jobs) {
+			while (job->state != preprocessor_job::DONE) {
+				done_cond_.wait(mutex_);
+			}
+		}
+	}
+
+private:
+	class preprocessor_worker: public tworker
+	{
+	public:
+		preprocessor_worker(preprocessor_pool &pool)
+			: pool_(pool)
+		{
+			thread_->Start();
+		}
+
+	private:
+		void DoWork() override { pool_.run(); }
+		void OnWorkStart() override {}
+		void OnWorkDone() override {}
+
+	private:
+		preprocessor_pool &pool_;
+	};
+
+	void run()
+	{
+		while (true) {
+			std::shared_ptr<preprocessor_job> job;
+			{
+				threading::lock lock(mutex_);
+				while (running_ && queue_.empty()) {
+					cond_.wait(mutex_);
+				}
+				if (!running_) {
+					break;
+				}
+				job = queue_.front();
+				queue_.pop_front();
+				job->state = preprocessor_job::RUNNING;
+			}
+
+			job->run();
+
+			threading::lock lock(mutex_);
+			job->state = preprocessor_job::DONE;
+			done_cond_.notify_all();
+		}
+	}
+
+private:
+	threading::mutex mutex_;
+	threading::condition cond_;
+	threading::condition done_cond_;
+	volatile bool running_;
+
+	std::deque< std::shared_ptr<preprocessor_job> > queue_;
+	std::vector< std::unique_ptr<preprocessor_worker> > workers_;
+};
+
 /**
  * Specialized preprocessor for handling a file or a set of files.
  * A preprocessor_file object is created when a preprocessor encounters an
@@ -394,8 +653,18 @@ class preprocessor_file: preprocessor
 {
 	std::vector< std::string > files_;
 	std::vector< std::string >::const_iterator pos_, end_;
+	/**
+	 * Jobs expanding files_ ahead of pos_ when the target has a pool,
+	 * in the order of files_.
+	 */
+	std::deque< std::shared_ptr<preprocessor_job> > jobs_;
+	/** Hash of the defines the jobs start with, part of their cache key. */
+	std::string defines_hash_;
+	void push_jobs();
+	void cancel_jobs();
 public:
 	preprocessor_file(preprocessor_streambuf &, std::string const &);
+	~preprocessor_file();
 	virtual bool get_chunk();
 };
 
@@ -509,28 +778,81 @@ bool operator==(char lhs, preprocessor_data::token_desc::TOKEN_TYPE rhs){ return
 bool operator!=(preprocessor_data::token_desc::TOKEN_TYPE rhs, char lhs){ return !(lhs == rhs); }
 bool operator!=(char lhs, preprocessor_data::token_desc::TOKEN_TYPE rhs){ return rhs != lhs; }
 
+/** The .cfg files of a directory, in the order they are included. */
+static void get_cfg_files_in_dir(std::string const &name, std::vector< std::string > &files)
+{
+	std::vector< std::string > all;
+	get_files_in_dir(name, &all, NULL, ENTIRE_FILE_PATH, SKIP_MEDIA_DIR, DO_REORDER);
+	BOOST_FOREACH (std::string const &file, all) {
+		unsigned sz = file.size();
+		// Use reverse iterator to optimize testing
+		if (sz < 5 || !std::equal(file.rbegin(), file.rbegin() + 4, "gfc."))
+			continue;
+		files.push_back(file);
+	}
+}
+
+static std::string get_files_hash(std::vector< std::string > const &files)
+{
+	std::string names;
+	BOOST_FOREACH (std::string const &file, files) {
+		names += file;
+		names += '\n';
+	}
+	return sha1_hash(names).display();
+}
+
+void preprocessor_record::add_file(std::string const &name, const char *data, int size)
+{
+	SDL_dirent st;
+	SDL_GetStat(name.c_str(), &st);
+	if (st.mtime > modified) {
+		modified = st.mtime;
+	}
+	sum_size += size;
+	nfiles ++;
+
+	dependency &dep = dependencies[name];
+	dep.directory = false;
+	dep.hash = sha1_hash(std::string(data, size)).display();
+}
+
+void preprocessor_record::add_directory(std::string const &name, std::vector< std::string > const &files)
+{
+	dependency &dep = dependencies[name];
+	dep.directory = true;
+	dep.hash = get_files_hash(files);
+}
+
 preprocessor_file::preprocessor_file(preprocessor_streambuf &t, std::string const &name) :
 	preprocessor(t),
 	files_(),
 	pos_(),
-	end_()
+	end_(),
+	jobs_(),
+	defines_hash_()
 {
 	if (is_directory(name)) {
-		increment_preprocessor_progress(name, false);
-		get_files_in_dir(name, &files_, NULL, ENTIRE_FILE_PATH, SKIP_MEDIA_DIR, DO_REORDER);
+		if (!t.record_)
+			increment_preprocessor_progress(name, false);
+		get_cfg_files_in_dir(name, files_);
+		if (t.record_)
+			t.record_->add_directory(name, files_);
 	} else {
-		increment_preprocessor_progress(name, true);
+		if (!t.record_)
+			increment_preprocessor_progress(name, true);
 
 		tfile lock(name, GENERIC_READ, OPEN_EXISTING);
 		int fsize = lock.valid()? posix_fsize(lock.fp): 0;
+		char* in = NULL;
 		if (fsize) {
-			char* in = (char*)malloc(fsize);
+			in = (char*)malloc(fsize);
 			posix_fread(lock.fp, in, fsize);
-
-			new preprocessor_data(t, in, fsize, "", get_short_wml_path(name),
-				1, directory_name(name), t.textdomain_, NULL);
 		}
-		if (preprocessor_checksum && lock.valid()) {
+		if (t.record_ && lock.valid()) {
+			t.record_->add_file(name, in, fsize);
+
+		} else if (preprocessor_checksum && lock.valid()) {
 			SDL_dirent st;
 			SDL_GetStat(name.c_str(), &st);
 			if (st.mtime > preprocessor_checksum->modified) {
@@ -539,29 +861,108 @@ preprocessor_file::preprocessor_file(preprocessor_streambuf &t, std::string cons
 			preprocessor_checksum->sum_size += fsize;
 			preprocessor_checksum->nfiles ++;
 		}
+		if (in) {
+			new preprocessor_data(t, in, fsize, "", get_short_wml_path(name),
+				1, directory_name(name), t.textdomain_, NULL);
+		}
 	}
 	pos_ = files_.begin();
 	end_ = files_.end();
 }
 
+preprocessor_file::~preprocessor_file()
+{
+	cancel_jobs();
+}
+
+/**
+ * Queues jobs for the next files, a few more than there are threads.
+ * A job started ahead is wasted when an earlier file changes the defines.
+ */
+void preprocessor_file::push_jobs()
+{
+	const size_t window = target_.pool_->threads() * 2;
+	while (pos_ != end_ && jobs_.size() < window) {
+		std::string cache_key;
+		if (!preprocessor_cache_dir.empty() && stable_file_numbers) {
+			if (defines_hash_.empty()) {
+				std::ostringstream defines;
+				BOOST_FOREACH (preproc_map::value_type const &def, target_.defines()) {
+					defines << def.first << '\0' << def.second.value << '\0';
+					BOOST_FOREACH (std::string const &arg, def.second.arguments)
+						defines << arg << ' ';
+					defines << '\0' << def.second.textdomain << '\0' << def.second.linenum
+						<< '\0' << def.second.location << '\n';
+				}
+				defines_hash_ = sha1_hash(defines.str()).display();
+			}
+			std::ostringstream key;
+			key << *pos_ << '\n' << target_.textdomain_ << '\n' << target_.location_ << '\n'
+				<< target_.linenum_ << ' ' << target_.depth_ << ' ' << target_.quoted_ << '\n' << defines_hash_;
+			cache_key = sha1_hash(key.str()).display();
+		}
+		std::shared_ptr<preprocessor_job> job(new preprocessor_job(*(pos_++), target_, cache_key));
+		target_.pool_->push(job);
+		jobs_.push_back(job);
+	}
+}
+
+/** Cancels jobs started ahead, their files will be expanded again. */
+void preprocessor_file::cancel_jobs()
+{
+	if (jobs_.empty())
+		return;
+	target_.pool_->cancel(jobs_);
+	pos_ -= jobs_.size();
+	jobs_.clear();
+}
+
 /**
  * preprocessor_file::get_chunk()
  *
  * Inserts and processes the next file in the list of included files.
+ * When the target has a pool, files are expanded by jobs and only their
+ * output is inserted.
  * @return	false if there is no next file.
  */
 bool preprocessor_file::get_chunk()
 {
-	while (pos_ != end_) {
-		const std::string &name = *(pos_++);
-		unsigned sz = name.size();
-		// Use reverse iterator to optimize testing
-		if (sz < 5 || !std::equal(name.rbegin(), name.rbegin() + 4, "gfc."))
-			continue;
-		new preprocessor_file(target_, name);
+	if (!target_.pool_ || files_.size() < 2) {
+		// a single file, e.g. _main.cfg, is expanded in place, so the
+		// directories it includes are still expanded in parallel.
+		if (pos_ == end_)
+			return false;
+		new preprocessor_file(target_, *(pos_++));
 		return true;
 	}
-	return false;
+
+	push_jobs();
+	if (jobs_.empty())
+		return false;
+	std::shared_ptr<preprocessor_job> job = jobs_.front();
+	jobs_.pop_front();
+	target_.pool_->wait(*job);
+	if (job->error) {
+		cancel_jobs();
+		std::rethrow_exception(job->error);
+	}
+
+	increment_preprocessor_progress(job->name, true);
+	if (preprocessor_checksum) {
+		if (job->record.modified > preprocessor_checksum->modified) {
+			preprocessor_checksum->modified = job->record.modified;
+		}
+		preprocessor_checksum->sum_size += job->record.sum_size;
+		preprocessor_checksum->nfiles += job->record.nfiles;
+	}
+	target_.buffer_ << job->text;
+	if (job->record.defines) {
+		// Following files were expanded with the old defines.
+		cancel_jobs();
+		target_.defines_->swap(*job->record.defines);
+		defines_hash_.clear();
+	}
+	return true;
 }
 
 preprocessor_data::preprocessor_data(preprocessor_streambuf &t,
@@ -876,20 +1277,20 @@ bool preprocessor_data::get_chunk()
 			}
 			if (!skipping_) {
 				buffer.erase(buffer.end() - 7, buffer.end());
-				(*target_.defines_)[symbol] = preproc_define(buffer, items, target_.textdomain_,
+				target_.writable_defines()[symbol] = preproc_define(buffer, items, target_.textdomain_,
 					                       linenum + 1, target_.location_);
 				LOG_CF << "defining macro " << symbol << " (location " << get_location(target_.location_) << ")\n";
 			}
 		} else if (command == "ifdef") {
 			skip_spaces();
 			std::string const &symbol = read_word();
-			bool found = target_.defines_->count(symbol) != 0;
+			bool found = target_.defines().count(symbol) != 0;
 			// testing for macro 'symbol': (found ? "defined" : "not defined");
 			conditional_skip(!found);
 		} else if (command == "ifndef") {
 			skip_spaces();
 			std::string const &symbol = read_word();
-			bool found = target_.defines_->count(symbol) != 0;
+			bool found = target_.defines().count(symbol) != 0;
 			// "testing for macro 'symbol': (found ? "defined" : "not defined")
 			conditional_skip(found);
 		} else if (command == "ifhave") {
@@ -898,6 +1299,8 @@ bool preprocessor_data::get_chunk()
 			bool found = !get_wml_location(symbol, directory_).empty();
 			DBG_CF << "testing for file or directory " << symbol << ": "
 				<< (found ? "found" : "not found") << '\n';
+			if (target_.record_)
+				target_.record_->cacheable = false;
 			conditional_skip(!found);
 		} else if (command == "ifnhave") {
 			skip_spaces();
@@ -905,6 +1308,8 @@ bool preprocessor_data::get_chunk()
 			bool found = !get_wml_location(symbol, directory_).empty();
 			DBG_CF << "testing for file or directory " << symbol << ": "
 				<< (found ? "found" : "not found") << '\n';
+			if (target_.record_)
+				target_.record_->cacheable = false;
 			conditional_skip(found);
 		} else if (command == "else") {
 			if (token.type == token_desc::SKIP_ELSE) {
@@ -943,7 +1348,7 @@ bool preprocessor_data::get_chunk()
 			skip_spaces();
 			std::string const &symbol = read_word();
 			if (!skipping_) {
-				target_.defines_->erase(symbol);
+				target_.writable_defines().erase(symbol);
 				LOG_CF << "undefine macro " << symbol << " (location " << get_location(target_.location_) << ")\n";
 			}
 		} else if (command == "error") {
@@ -1019,7 +1424,7 @@ bool preprocessor_data::get_chunk()
 				pop_token();
 				put(v.str());
 			}
-			else if ((macro = target_.defines_->find(symbol)) != target_.defines_->end())
+			else if ((macro = target_.defines().find(symbol)) != target_.defines().end())
 			{
 				preproc_define const &val = macro->second;
 				size_t nb_arg = strings_.size() - token.stack_pos - 1;
@@ -1104,18 +1509,251 @@ bool preprocessor_data::get_chunk()
 	return true;
 }
 
+preprocessor_job::preprocessor_job(std::string const &name, preprocessor_streambuf const &t, std::string const &cache_key)
+	: name(name)
+	, defines(t.defines_)
+	, textdomain(t.textdomain_)
+	, location(t.location_)
+	, linenum(t.linenum_)
+	, depth(t.depth_)
+	, quoted(t.quoted_)
+	, cache_key(cache_key)
+	, state(QUEUED)
+	, text()
+	, record()
+	, error()
+{
+}
+
+void preprocessor_job::run()
+{
+	if (!cache_key.empty() && load_cache())
+		return;
+
+	try {
+		preprocessor_streambuf buf(*this);
+		new preprocessor_file(buf, name);
+		// read the buffer directly, a stream would swallow errors.
+		text.assign(std::istreambuf_iterator<char>(&buf), std::istreambuf_iterator<char>());
+	} catch (...) {
+		error = std::current_exception();
+		return;
+	}
+	if (!cache_key.empty() && record.cacheable)
+		save_cache();
+}
+
+//
+// cache file: text, dependencies, checksum and changes of defines.
+// integers are uint32_t, strings are prefixed by their size.
+//
+static const uint32_t preprocessor_cache_fourcc = 0x31435050; // PPC1
+
+static void write_cache_u32(std::string &out, uint32_t value)
+{
+	out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void write_cache_string(std::string &out, std::string const &str)
+{
+	write_cache_u32(out, str.size());
+	out += str;
+}
+
+struct preprocessor_cache_reader
+{
+	preprocessor_cache_reader(std::string const &data) : data_(data), pos_(0), valid_(true) {}
+
+	uint32_t u32()
+	{
+		uint32_t value = 0;
+		if (pos_ + sizeof(value) > data_.size()) {
+			valid_ = false;
+			return 0;
+		}
+		memcpy(&value, data_.c_str() + pos_, sizeof(value));
+		pos_ += sizeof(value);
+		return value;
+	}
+
+	std::string string()
+	{
+		uint32_t size = u32();
+		if (!valid_ || size > data_.size() - pos_) {
+			valid_ = false;
+			return std::string();
+		}
+		pos_ += size;
+		return data_.substr(pos_ - size, size);
+	}
+
+	bool valid() const { return valid_; }
+	bool at_end() const { return pos_ == data_.size(); }
+
+private:
+	std::string const &data_;
+	size_t pos_;
+	bool valid_;
+};
+
+static bool equal_define(preproc_define const &a, preproc_define const &b)
+{
+	return a == b && a.textdomain == b.textdomain && a.linenum == b.linenum && a.location == b.location;
+}
+
+void preprocessor_job::save_cache() const
+{
+	std::string out;
+	write_cache_u32(out, preprocessor_cache_fourcc);
+	write_cache_string(out, text);
+
+	write_cache_u32(out, record.dependencies.size());
+	for (std::map< std::string, preprocessor_record::dependency >::const_iterator it = record.dependencies.begin(); it != record.dependencies.end(); ++it) {
+		write_cache_string(out, it->first);
+		write_cache_u32(out, it->second.directory);
+		write_cache_string(out, it->second.hash);
+	}
+	write_cache_u32(out, record.nfiles);
+	write_cache_u32(out, record.sum_size);
+
+	std::vector< preproc_map::const_iterator > changed;
+	std::vector< std::string > erased;
+	if (record.defines) {
+		for (preproc_map::const_iterator it = record.defines->begin(); it != record.defines->end(); ++it) {
+			preproc_map::const_iterator old = defines->find(it->first);
+			if (old == defines->end() || !equal_define(old->second, it->second))
+				changed.push_back(it);
+		}
+		BOOST_FOREACH (preproc_map::value_type const &def, *defines) {
+			if (!record.defines->count(def.first))
+				erased.push_back(def.first);
+		}
+	}
+	write_cache_u32(out, changed.size());
+	BOOST_FOREACH (preproc_map::const_iterator it, changed) {
+		write_cache_string(out, it->first);
+		write_cache_string(out, it->second.value);
+		write_cache_u32(out, it->second.arguments.size());
+		BOOST_FOREACH (std::string const &arg, it->second.arguments)
+			write_cache_string(out, arg);
+		write_cache_string(out, it->second.textdomain);
+		write_cache_u32(out, it->second.linenum);
+		write_cache_string(out, it->second.location);
+	}
+	write_cache_u32(out, erased.size());
+	BOOST_FOREACH (std::string const &name, erased)
+		write_cache_string(out, name);
+
+	tfile lock(preprocessor_cache_dir + "/" + cache_key, GENERIC_WRITE, CREATE_ALWAYS);
+	if (lock.valid())
+		posix_fwrite(lock.fp, out.c_str(), out.size());
+}
+
+/**
+ * Uses the cached expansion if none of the files it read has changed.
+ * @return false if it has to be expanded again.
+ */
+bool preprocessor_job::load_cache()
+{
+	std::string data;
+	{
+		tfile lock(preprocessor_cache_dir + "/" + cache_key, GENERIC_READ, OPEN_EXISTING);
+		int fsize = lock.valid()? posix_fsize(lock.fp): 0;
+		if (!fsize)
+			return false;
+		data.resize(fsize);
+		posix_fread(lock.fp, &data[0], fsize);
+	}
+
+	preprocessor_cache_reader reader(data);
+	if (reader.u32() != preprocessor_cache_fourcc)
+		return false;
+	std::string cached_text = reader.string();
+
+	preprocessor_record cached;
+	uint32_t ndependencies = reader.u32();
+	for (uint32_t at = 0; at < ndependencies && reader.valid(); ++at) {
+		std::string const dep_name = reader.string();
+		bool directory = reader.u32() != 0;
+		std::string const hash = reader.string();
+		if (!reader.valid())
+			return false;
+
+		if (directory) {
+			if (!is_directory(dep_name))
+				return false;
+			std::vector< std::string > files;
+			get_cfg_files_in_dir(dep_name, files);
+			cached.add_directory(dep_name, files);
+		} else {
+			tfile lock(dep_name, GENERIC_READ, OPEN_EXISTING);
+			if (!lock.valid())
+				return false;
+			int fsize = posix_fsize(lock.fp);
+			std::string content(fsize, '\0');
+			if (fsize)
+				posix_fread(lock.fp, &content[0], fsize);
+			cached.add_file(dep_name, content.c_str(), fsize);
+		}
+		if (cached.dependencies[dep_name].hash != hash)
+			return false;
+	}
+	// files can be read more than once.
+	cached.nfiles = reader.u32();
+	cached.sum_size = reader.u32();
+
+	uint32_t nchanged = reader.u32();
+	for (uint32_t at = 0; at < nchanged && reader.valid(); ++at) {
+		if (!cached.defines)
+			cached.defines.reset(new preproc_map(*defines));
+		std::string const def_name = reader.string();
+		preproc_define def;
+		def.value = reader.string();
+		uint32_t narguments = reader.u32();
+		for (uint32_t arg = 0; arg < narguments && reader.valid(); ++arg)
+			def.arguments.push_back(reader.string());
+		def.textdomain = reader.string();
+		def.linenum = reader.u32();
+		def.location = reader.string();
+		(*cached.defines)[def_name] = def;
+	}
+	uint32_t nerased = reader.u32();
+	for (uint32_t at = 0; at < nerased && reader.valid(); ++at) {
+		if (!cached.defines)
+			cached.defines.reset(new preproc_map(*defines));
+		cached.defines->erase(reader.string());
+	}
+	if (!reader.valid() || !reader.at_end())
+		return false;
+
+	// text contains codes of the files, get_filename must know them.
+	for (std::map< std::string, preprocessor_record::dependency >::const_iterator it = cached.dependencies.begin(); it != cached.dependencies.end(); ++it) {
+		if (!it->second.directory)
+			get_file_code(get_short_wml_path(it->first));
+	}
+	text.swap(cached_text);
+	record.dependencies.swap(cached.dependencies);
+	record.nfiles = cached.nfiles;
+	record.sum_size = cached.sum_size;
+	record.modified = cached.modified;
+	record.defines.swap(cached.defines);
+	return true;
+}
+
 struct preprocessor_deleter: std::basic_istream<char>
 {
 	preprocessor_streambuf *buf_;
 	preproc_map *defines_;
-	preprocessor_deleter(preprocessor_streambuf *buf, preproc_map *defines);
+	std::unique_ptr<preprocessor_pool> pool_;
+	preprocessor_deleter(preprocessor_streambuf *buf, preproc_map *defines, preprocessor_pool *pool);
 	~preprocessor_deleter();
 };
 
 preprocessor_deleter::preprocessor_deleter(preprocessor_streambuf *buf,
-		preproc_map *defines)
-	: std::basic_istream<char>(buf), buf_(buf), defines_(defines)
+		preproc_map *defines, preprocessor_pool *pool)
+	: std::basic_istream<char>(buf), buf_(buf), defines_(defines), pool_(pool)
 {
+	buf_->pool_ = pool;
 }
 
 preprocessor_deleter::~preprocessor_deleter()
@@ -1123,6 +1761,8 @@ preprocessor_deleter::~preprocessor_deleter()
 	clear(std::ios_base::goodbit);
 	exceptions(std::ios_base::goodbit);
 	rdbuf(NULL);
+	// jobs may still run when preprocessing was aborted, they read the defines.
+	pool_.reset();
 	delete buf_;
 	delete defines_;
 }
@@ -1140,6 +1780,23 @@ std::istream *preprocess_file(std::string const &fname, preproc_map *defines)
 		defines = owned_defines;
 	}
 	preprocessor_streambuf *buf = new preprocessor_streambuf(defines);
-	new preprocessor_file(*buf, fname);
-	return new preprocessor_deleter(buf, owned_defines);
+	preprocessor_pool *pool = NULL;
+	const int threads = std::min(SDL_GetCPUCount(), 8);
+	if (!preprocessor_cache_dir.empty() && threads > 1)
+		pool = new preprocessor_pool(threads);
+	preprocessor_deleter *stream = new preprocessor_deleter(buf, owned_defines, pool);
+	try {
+		new preprocessor_file(*buf, fname);
+	} catch (...) {
+		delete stream;
+		throw;
+	}
+	return stream;
+}
+
+void set_preprocessor_cache_dir(std::string const &dir)
+{
+	if (!dir.empty())
+		create_directory_if_missing_recursive(dir);
+	preprocessor_cache_dir = dir;
 }
\ No newline at end of file
@@ -74,4 +74,16 @@ std::ostream& operator<<(std::ostream& stream, const preproc_map::value_type& de
  */
 std::istream *preprocess_file(std::string const &fname, preproc_map *defines = NULL);
 
+/**
+ * Enables parallel preprocessing and the expansion cache.
+ *
+ * Files of an included directory are expanded on worker threads, and each
+ * file's expansion is stored in @a dir, keyed by its content hash and the
+ * active defines. A file is expanded again only when it or one of the files
+ * it includes has changed.
+ *
+ * @param dir                     Directory of the cache, empty to disable.
+ */
+void set_preprocessor_cache_dir(std::string const &dir);
+
 #endif
@@ -0,0 +1,157 @@
+#define GETTEXT_DOMAIN "rose-lib"
+
+#include "tensor_kernels.hpp"
+#include "serialization/string_utils.hpp"
+#include "wml_exception.hpp"
+
+#include <vector>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TENSOR_KERNELS_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TENSOR_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace tensorflow2 {
+
+void u8_to_float(const uint8_t* src, float* dst, int count, float scale, float bias)
+{
+	int at = 0;
+#if defined(TENSOR_KERNELS_SSE2)
+	const __m128 scale4 = _mm_set1_ps(scale);
+	const __m128 bias4 = _mm_set1_ps(bias);
+	const __m128i zero = _mm_setzero_si128();
+	for (; at + 16 <= count; at += 16) {
+		const __m128i u8 = _mm_loadu_si128((const __m128i*)(src + at));
+		const __m128i lo16 = _mm_unpacklo_epi8(u8, zero);
+		const __m128i hi16 = _mm_unpackhi_epi8(u8, zero);
+		const __m128i i32[4] = {_mm_unpacklo_epi16(lo16, zero), _mm_unpackhi_epi16(lo16, zero), _mm_unpacklo_epi16(hi16, zero), _mm_unpackhi_epi16(hi16, zero)};
+		for (int n = 0; n < 4; n ++) {
+			const __m128 f = _mm_cvtepi32_ps(i32[n]);
+			_mm_storeu_ps(dst + at + n * 4, _mm_add_ps(_mm_mul_ps(f, scale4), bias4));
+		}
+	}
+#elif defined(TENSOR_KERNELS_NEON)
+	const float32x4_t scale4 = vdupq_n_f32(scale);
+	const float32x4_t bias4 = vdupq_n_f32(bias);
+	for (; at + 16 <= count; at += 16) {
+		const uint8x16_t u8 = vld1q_u8(src + at);
+		const uint16x8_t lo16 = vmovl_u8(vget_low_u8(u8));
+		const uint16x8_t hi16 = vmovl_u8(vget_high_u8(u8));
+		const uint32x4_t u32[4] = {vmovl_u16(vget_low_u16(lo16)), vmovl_u16(vget_high_u16(lo16)), vmovl_u16(vget_low_u16(hi16)), vmovl_u16(vget_high_u16(hi16))};
+		for (int n = 0; n < 4; n ++) {
+			const float32x4_t f = vcvtq_f32_u32(u32[n]);
+			vst1q_f32(dst + at + n * 4, vmlaq_f32(bias4, f, scale4));
+		}
+	}
+#endif
+	for (; at < count; at ++) {
+		dst[at] = src[at] * scale + bias;
+	}
+}
+
+void binarize_to_float(const uint8_t* src, float* dst, int count, uint8_t background)
+{
+	int at = 0;
+#if defined(TENSOR_KERNELS_SSE2)
+	const __m128i background16 = _mm_set1_epi8((char)background);
+	const __m128i one16 = _mm_set1_epi8(1);
+	uint8_t bits[16];
+	for (; at + 16 <= count; at += 16) {
+		const __m128i u8 = _mm_loadu_si128((const __m128i*)(src + at));
+		// equal: 0xff --> 0, not equal: 0 --> 1
+		_mm_storeu_si128((__m128i*)bits, _mm_andnot_si128(_mm_cmpeq_epi8(u8, background16), one16));
+		u8_to_float(bits, dst + at, 16, 1, 0);
+	}
+#elif defined(TENSOR_KERNELS_NEON)
+	const uint8x16_t background16 = vdupq_n_u8(background);
+	const uint8x16_t one16 = vdupq_n_u8(1);
+	uint8_t bits[16];
+	for (; at + 16 <= count; at += 16) {
+		const uint8x16_t u8 = vld1q_u8(src + at);
+		vst1q_u8(bits, vbicq_u8(one16, vceqq_u8(u8, background16)));
+		u8_to_float(bits, dst + at, 16, 1, 0);
+	}
+#endif
+	for (; at < count; at ++) {
+		dst[at] = src[at] == background? 0: 1;
+	}
+}
+
+static void nearest_index(int src_size, int wanted_size, std::vector<int>& index)
+{
+	index.resize(wanted_size);
+	for (int at = 0; at < wanted_size; at ++) {
+		index[at] = (at * src_size) / wanted_size;
+	}
+}
+
+void rgba_to_tensor(const uint8_t* src, int width, int height, int pitch, bool bgra,
+	float* dst, int wanted_width, int wanted_height, float mean, float std)
+{
+	VALIDATE(src && width > 0 && height > 0 && pitch >= width * 4 && dst && wanted_width > 0 && wanted_height > 0 && std != 0, null_str);
+
+	std::vector<int> xs;
+	nearest_index(width, wanted_width, xs);
+	const int r = bgra? 2: 0;
+	const int b = bgra? 0: 2;
+
+	const float scale = 1 / std;
+	const float bias = -mean / std;
+#if defined(TENSOR_KERNELS_SSE2)
+	const __m128 scale4 = _mm_set1_ps(scale);
+	const __m128 bias4 = _mm_set1_ps(bias);
+	const __m128i zero = _mm_setzero_si128();
+#elif defined(TENSOR_KERNELS_NEON)
+	const float32x4_t scale4 = vdupq_n_f32(scale);
+	const float32x4_t bias4 = vdupq_n_f32(bias);
+	uint8_t pixels[8 * 4];
+#endif
+	for (int y = 0; y < wanted_height; y ++) {
+		const uint8_t* in_row = src + ((y * height) / wanted_height) * pitch;
+		float* out = dst + y * wanted_width * 3;
+		int x = 0;
+#if defined(TENSOR_KERNELS_SSE2)
+		// convert one pixel's 4 channels at once, and store them as R, G, B, A.
+		// A is overwritten by next pixel's R, so the last pixel goes to scalar loop.
+		for (; x + 1 < wanted_width; x ++) {
+			int pixel;
+			memcpy(&pixel, in_row + xs[x] * 4, 4);
+			const __m128i i32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero);
+			__m128 f = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(i32), scale4), bias4);
+			if (bgra) {
+				f = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 0, 1, 2));
+			}
+			_mm_storeu_ps(out + x * 3, f);
+		}
+#elif defined(TENSOR_KERNELS_NEON)
+		// gather 8 pixels, vld4 splits them to channels, vst3q interleaves R, G, B.
+		for (; x + 8 <= wanted_width; x += 8) {
+			for (int n = 0; n < 8; n ++) {
+				memcpy(pixels + n * 4, in_row + xs[x + n] * 4, 4);
+			}
+			const uint8x8x4_t channels = vld4_u8(pixels);
+			const uint8x8_t rgb[3] = {channels.val[r], channels.val[1], channels.val[b]};
+			float32x4x3_t lo, hi;
+			for (int n = 0; n < 3; n ++) {
+				const uint16x8_t u16 = vmovl_u8(rgb[n]);
+				lo.val[n] = vmlaq_f32(bias4, vcvtq_f32_u32(vmovl_u16(vget_low_u16(u16))), scale4);
+				hi.val[n] = vmlaq_f32(bias4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(u16))), scale4);
+			}
+			vst3q_f32(out + x * 3, lo);
+			vst3q_f32(out + (x + 4) * 3, hi);
+		}
+#endif
+		for (; x < wanted_width; x ++) {
+			const uint8_t* in_pixel = in_row + xs[x] * 4;
+			out[x * 3] = in_pixel[r] * scale + bias;
+			out[x * 3 + 1] = in_pixel[1] * scale + bias;
+			out[x * 3 + 2] = in_pixel[b] * scale + bias;
+		}
+	}
+}
+
+}
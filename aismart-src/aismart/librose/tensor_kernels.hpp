@@ -0,0 +1,26 @@
+#ifndef LIBROSE_TENSOR_KERNELS_HPP_INCLUDED
+#define LIBROSE_TENSOR_KERNELS_HPP_INCLUDED
+
+#include <stdint.h>
+
+//
+// pixel --> float tensor(NHWC) kernels shared by all tensorflow front-ends.
+// inner loop is SSE2 on x86/x64, NEON on arm/arm64, scalar on others.
+//
+namespace tensorflow2 {
+
+// dst[i] = src[i] * scale + bias
+void u8_to_float(const uint8_t* src, float* dst, int count, float scale, float bias);
+
+// dst[i] = src[i] == background? 0: 1
+void binarize_to_float(const uint8_t* src, float* dst, int count, uint8_t background = 255);
+
+// src: 4 channels pixels, bgra is true if its order is BGRA, else RGBA.
+// dst: wanted_height x wanted_width x 3(RGB), value is (channel - mean) / std.
+// when size is different, it use nearest sampling.
+void rgba_to_tensor(const uint8_t* src, int width, int height, int pitch, bool bgra,
+	float* dst, int wanted_width, int wanted_height, float mean, float std);
+
+}
+
+#endif
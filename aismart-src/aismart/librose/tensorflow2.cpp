@@ -10,8 +10,14 @@
 
 #include <tensorflow/core/framework/op_kernel.h>
 #include <tensorflow/core/protobuf/meta_graph.pb.h>
+#include <tensorflow/core/framework/graph.pb.h>
+#include <tensorflow/core/framework/tensor.h>
+#include <tensorflow/core/platform/env.h>
+#include <tensorflow/core/util/memmapped_file_system.h>
+#include <tensorflow/core/util/memmapped_file_system_writer.h>
 
 #include <sstream>
+#include <set>
 
 namespace tensorflow2 {
 
@@ -81,4 +87,640 @@ bool read_file_to_proto(const std::string& file_name, ::google::protobuf::Messag
 	return proto.ParseFromCodedStream(&coded_stream);
 }
 
+std::string memmapped_model_name(const std::string& pb_path)
+{
+	size_t pos = pb_path.rfind(".pb");
+	VALIDATE(pos != std::string::npos && pos + 3 == pb_path.size(), null_str);
+	return pb_path.substr(0, pos) + ".mmpb";
+}
+
+// rewrite every Const node whose tensor is at least min_conversion_bytes into an ImmutableConst,
+// and save the tensor as an aligned region of memmapped package. at runtime, these weights
+// are used directly from mapped pages, no heap copy.
+tensorflow::Status convert_to_memmapped(const std::string& pb_path, const std::string& mmpb_path, int min_conversion_bytes)
+{
+	tensorflow::GraphDef graph_def;
+	if (!SDL_IsFile(pb_path.c_str()) || !read_file_to_proto(pb_path, graph_def)) {
+		return tensorflow::errors::NotFound(pb_path);
+	}
+
+	tensorflow::MemmappedFileSystemWriter writer;
+	TF_RETURN_IF_ERROR(writer.InitializeToFile(tensorflow::Env::Default(), mmpb_path));
+
+	int converted = 0;
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		tensorflow::NodeDef* node = graph_def.mutable_node(at);
+		if (node->op() != "Const") {
+			continue;
+		}
+		const tensorflow::AttrValue& value = node->attr().at("value");
+		tensorflow::Tensor tensor;
+		if (!tensor.FromProto(value.tensor())) {
+			return tensorflow::errors::InvalidArgument("Can not parse tensor of node: ", node->name());
+		}
+		// string tensor hasn't flat memory layout.
+		if (tensor.dtype() == tensorflow::DT_STRING || (int)tensor.TotalBytes() < min_conversion_bytes) {
+			continue;
+		}
+
+		std::stringstream region_name;
+		region_name << tensorflow::MemmappedFileSystem::kMemmappedPackagePrefix << "const_" << converted ++;
+		TF_RETURN_IF_ERROR(writer.SaveTensor(tensor, region_name.str()));
+
+		const tensorflow::DataType dtype = tensor.dtype();
+		const tensorflow::TensorShape shape = tensor.shape();
+		node->set_op("ImmutableConst");
+		node->mutable_attr()->clear();
+
+		tensorflow::AttrValue dtype_attr;
+		dtype_attr.set_type(dtype);
+		(*node->mutable_attr())["dtype"] = dtype_attr;
+
+		tensorflow::AttrValue shape_attr;
+		shape.AsProto(shape_attr.mutable_shape());
+		(*node->mutable_attr())["shape"] = shape_attr;
+
+		tensorflow::AttrValue region_attr;
+		region_attr.set_s(region_name.str());
+		(*node->mutable_attr())["memory_region_name"] = region_attr;
+	}
+
+	TF_RETURN_IF_ERROR(writer.SaveProtobuf(graph_def, tensorflow::MemmappedFileSystem::kMemmappedPackageDefaultGraphDef));
+	return writer.FlushAndClose();
+}
+
+static void set_type_attr(tensorflow::NodeDef& node, const std::string& key, tensorflow::DataType type)
+{
+	tensorflow::AttrValue value;
+	value.set_type(type);
+	(*node.mutable_attr())[key] = value;
+}
+
+static void set_string_attr(tensorflow::NodeDef& node, const std::string& key, const std::string& str)
+{
+	tensorflow::AttrValue value;
+	value.set_s(str);
+	(*node.mutable_attr())[key] = value;
+}
+
+static void copy_attr(const tensorflow::NodeDef& src, tensorflow::NodeDef& node, const std::string& key)
+{
+	google::protobuf::Map<std::string, tensorflow::AttrValue>::const_iterator it = src.attr().find(key);
+	if (it != src.attr().end()) {
+		(*node.mutable_attr())[key] = it->second;
+	}
+}
+
+static tensorflow::NodeDef* add_node(tensorflow::GraphDef& graph_def, const std::string& name, const std::string& op, std::set<std::string>& created)
+{
+	tensorflow::NodeDef* node = graph_def.add_node();
+	node->set_name(name);
+	node->set_op(op);
+	created.insert(name);
+	return node;
+}
+
+static void add_const(tensorflow::GraphDef& graph_def, const std::string& name, const tensorflow::Tensor& tensor, std::set<std::string>& created)
+{
+	tensorflow::NodeDef* node = add_node(graph_def, name, "Const", created);
+	set_type_attr(*node, "dtype", tensor.dtype());
+	tensorflow::AttrValue value;
+	tensor.AsProtoTensorContent(value.mutable_tensor());
+	(*node->mutable_attr())["value"] = value;
+}
+
+// "^name", "name:1" ==> "name"
+static std::string input_node_name(const std::string& input)
+{
+	const size_t start = input[0] == '^'? 1: 0;
+	const size_t pos = input.find(':', start);
+	return input.substr(start, pos == std::string::npos? std::string::npos: pos - start);
+}
+
+std::string optimized_model_name(const std::string& pb_path)
+{
+	const std::string name = file_name(pb_path);
+	size_t pos = name.rfind(".pb");
+	VALIDATE(pos != std::string::npos && pos + 3 == name.size(), null_str);
+	// increase version when rewrite changes, so old cache isn't used.
+	return get_user_data_dir() + "/tensorflow/" + name.substr(0, pos) + ".opt1.pb";
+}
+
+static bool has_control_input(const tensorflow::NodeDef& node)
+{
+	for (int at = 0; at < node.input_size(); at ++) {
+		if (node.input(at)[0] == '^') {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void append_control_inputs(const tensorflow::NodeDef& src, tensorflow::NodeDef& node)
+{
+	for (int at = 0; at < src.input_size(); at ++) {
+		if (src.input(at)[0] == '^') {
+			node.add_input(src.input(at));
+		}
+	}
+}
+
+// key: node name, value: count of nodes that use it, include control.
+static std::map<std::string, int> count_consumers(const tensorflow::GraphDef& graph_def)
+{
+	std::map<std::string, int> consumers;
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		const tensorflow::NodeDef& node = graph_def.node(at);
+		for (int at2 = 0; at2 < node.input_size(); at2 ++) {
+			consumers[input_node_name(node.input(at2))] ++;
+		}
+	}
+	return consumers;
+}
+
+static std::map<std::string, int> index_nodes(const tensorflow::GraphDef& graph_def)
+{
+	std::map<std::string, int> index;
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		index.insert(std::make_pair(graph_def.node(at).name(), at));
+	}
+	return index;
+}
+
+// node of input, if input is first output of it. else NULL.
+static const tensorflow::NodeDef* first_output_node(const tensorflow::GraphDef& graph_def, const std::map<std::string, int>& index, const std::string& input)
+{
+	const std::string name = input_node_name(input);
+	if (input != name && input != name + ":0") {
+		return NULL;
+	}
+	std::map<std::string, int>::const_iterator it = index.find(name);
+	return it != index.end()? &graph_def.node(it->second): NULL;
+}
+
+static bool float_const(const tensorflow::NodeDef* node, tensorflow::Tensor& tensor)
+{
+	if (!node || node->op() != "Const") {
+		return false;
+	}
+	return tensor.FromProto(node->attr().at("value").tensor()) && tensor.dtype() == tensorflow::DT_FLOAT;
+}
+
+static bool attr_equal(const tensorflow::NodeDef& node, const std::string& key, const std::string& str, bool absent_equal)
+{
+	google::protobuf::Map<std::string, tensorflow::AttrValue>::const_iterator it = node.attr().find(key);
+	return it != node.attr().end()? it->second.s() == str: absent_equal;
+}
+
+static bool float_nhwc(const tensorflow::NodeDef& node)
+{
+	google::protobuf::Map<std::string, tensorflow::AttrValue>::const_iterator it = node.attr().find("T");
+	if (it == node.attr().end() || it->second.type() != tensorflow::DT_FLOAT) {
+		return false;
+	}
+	return attr_equal(node, "data_format", "NHWC", true);
+}
+
+// Conv2D, DepthwiseConv2dNative or MatMul, output channels of them are decided by weights(input 1).
+// output channel of weights' element i is (i / inner) % channels.
+static bool weights_layout(const tensorflow::NodeDef& node, const tensorflow::TensorShape& shape, int& channels, int& inner)
+{
+	inner = 1;
+	if (node.op() == "Conv2D" && shape.dims() == 4) {
+		channels = shape.dim_size(3);
+
+	} else if (node.op() == "DepthwiseConv2dNative" && shape.dims() == 4) {
+		channels = shape.dim_size(2) * shape.dim_size(3);
+
+	} else if (node.op() == "MatMul" && shape.dims() == 2) {
+		google::protobuf::Map<std::string, tensorflow::AttrValue>::const_iterator it = node.attr().find("transpose_b");
+		if (it != node.attr().end() && it->second.b()) {
+			channels = shape.dim_size(0);
+			inner = shape.dim_size(1);
+		} else {
+			channels = shape.dim_size(1);
+		}
+	} else {
+		return false;
+	}
+	return float_nhwc(node);
+}
+
+// shape of Const or ImmutableConst, so memmapped graph can be fused too.
+static bool weights_shape(const tensorflow::NodeDef* node, tensorflow::TensorShape& shape)
+{
+	if (!node) {
+		return false;
+	}
+	if (node->op() == "Const") {
+		const tensorflow::TensorShapeProto& proto = node->attr().at("value").tensor().tensor_shape();
+		if (!tensorflow::TensorShape::IsValid(proto)) {
+			return false;
+		}
+		shape = tensorflow::TensorShape(proto);
+		return true;
+	}
+	if (node->op() == "ImmutableConst") {
+		shape = tensorflow::TensorShape(node->attr().at("shape").shape());
+		return true;
+	}
+	return false;
+}
+
+// Identity, StopGradient and CheckNumerics only forward their input at inference,
+// consumers use input of them directly. control dependencies on Assert are dropped.
+static int bypass_forward_nodes(tensorflow::GraphDef& graph_def)
+{
+	std::map<std::string, std::string> forwards;
+	std::set<std::string> asserts;
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		const tensorflow::NodeDef& node = graph_def.node(at);
+		const std::string& op = node.op();
+		if ((op == "Identity" || op == "StopGradient" || op == "CheckNumerics") && node.input_size() == 1 && node.input(0)[0] != '^') {
+			forwards.insert(std::make_pair(node.name(), node.input(0)));
+		} else if (op == "Assert") {
+			asserts.insert(node.name());
+		}
+	}
+
+	int rewrites = 0;
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		tensorflow::NodeDef* node = graph_def.mutable_node(at);
+		google::protobuf::RepeatedPtrField<std::string>* inputs = node->mutable_input();
+		for (int at2 = inputs->size() - 1; at2 >= 0; at2 --) {
+			std::string input = inputs->Get(at2);
+			if (input[0] == '^' && asserts.count(input_node_name(input))) {
+				inputs->DeleteSubrange(at2, 1);
+				rewrites ++;
+				continue;
+			}
+			for (;;) {
+				const bool control = input[0] == '^';
+				const std::string name = input_node_name(input);
+				std::map<std::string, std::string>::const_iterator it = forwards.find(name);
+				if (it == forwards.end() || (!control && input != name && input != name + ":0")) {
+					break;
+				}
+				input = control? "^" + input_node_name(it->second): it->second;
+			}
+			if (input != inputs->Get(at2)) {
+				*inputs->Mutable(at2) = input;
+				rewrites ++;
+			}
+		}
+	}
+	return rewrites;
+}
+
+// elementwise float ops whose inputs are all Const become Const.
+// support same shape, or one side has only one element.
+static int fold_constants(tensorflow::GraphDef& graph_def)
+{
+	int rewrites = 0;
+	for (bool changed = true; changed; ) {
+		changed = false;
+		const std::map<std::string, int> index = index_nodes(graph_def);
+		for (int at = 0; at < graph_def.node_size(); at ++) {
+			tensorflow::NodeDef* node = graph_def.mutable_node(at);
+			const std::string& op = node->op();
+			const bool unary = op == "Rsqrt" || op == "Sqrt" || op == "Reciprocal" || op == "Neg";
+			const bool binary = op == "Add" || op == "Sub" || op == "Mul" || op == "RealDiv";
+			if ((!unary && !binary) || node->input_size() != (unary? 1: 2) || has_control_input(*node)) {
+				continue;
+			}
+
+			tensorflow::Tensor a, b;
+			if (!float_const(first_output_node(graph_def, index, node->input(0)), a)) {
+				continue;
+			}
+			if (binary && !float_const(first_output_node(graph_def, index, node->input(1)), b)) {
+				continue;
+			}
+			if (binary && !a.shape().IsSameSize(b.shape()) && !(a.NumElements() == 1 && a.dims() <= b.dims()) && !(b.NumElements() == 1 && b.dims() <= a.dims())) {
+				continue;
+			}
+
+			const tensorflow::TensorShape& shape = binary && (b.dims() > a.dims() || b.NumElements() > a.NumElements())? b.shape(): a.shape();
+			tensorflow::Tensor result(tensorflow::DT_FLOAT, shape);
+			tensorflow::TTypes<float>::Flat flat_a = a.flat<float>();
+			tensorflow::TTypes<float>::Flat flat_r = result.flat<float>();
+			const int elements = result.NumElements();
+			for (int at2 = 0; at2 < elements; at2 ++) {
+				const float x = flat_a(a.NumElements() == 1? 0: at2);
+				float y = 0;
+				if (binary) {
+					y = b.flat<float>()(b.NumElements() == 1? 0: at2);
+				}
+				if (op == "Rsqrt") {
+					flat_r(at2) = 1 / sqrt(x);
+				} else if (op == "Sqrt") {
+					flat_r(at2) = sqrt(x);
+				} else if (op == "Reciprocal") {
+					flat_r(at2) = 1 / x;
+				} else if (op == "Neg") {
+					flat_r(at2) = -x;
+				} else if (op == "Add") {
+					flat_r(at2) = x + y;
+				} else if (op == "Sub") {
+					flat_r(at2) = x - y;
+				} else if (op == "Mul") {
+					flat_r(at2) = x * y;
+				} else {
+					flat_r(at2) = x / y;
+				}
+			}
+
+			node->set_op("Const");
+			node->clear_input();
+			node->mutable_attr()->clear();
+			set_type_attr(*node, "dtype", tensorflow::DT_FLOAT);
+			tensorflow::AttrValue value;
+			result.AsProtoTensorContent(value.mutable_tensor());
+			(*node->mutable_attr())["value"] = value;
+			changed = true;
+			rewrites ++;
+		}
+	}
+	return rewrites;
+}
+
+// conv/matmul -> Mul(per-channel Const) and conv/matmul -> FusedBatchNorm(is_training false) are folded
+// into weights of conv/matmul. Mul becomes conv/matmul, FusedBatchNorm becomes BiasAdd, they keep names.
+static int fold_scales(tensorflow::GraphDef& graph_def)
+{
+	int rewrites = 0;
+	for (bool changed = true; changed; ) {
+		changed = false;
+		const std::map<std::string, int> index = index_nodes(graph_def);
+		std::map<std::string, int> consumers = count_consumers(graph_def);
+		std::set<std::string> multiple_outputs;
+		for (int at = 0; at < graph_def.node_size(); at ++) {
+			const tensorflow::NodeDef& node = graph_def.node(at);
+			for (int at2 = 0; at2 < node.input_size(); at2 ++) {
+				const std::string& input = node.input(at2);
+				const std::string name = input_node_name(input);
+				if (input[0] != '^' && input != name && input != name + ":0") {
+					multiple_outputs.insert(name);
+				}
+			}
+		}
+
+		std::vector<tensorflow::NodeDef> news;
+		std::set<std::string> created;
+		for (int at = 0; at < graph_def.node_size(); at ++) {
+			tensorflow::NodeDef* tail = graph_def.mutable_node(at);
+			const bool batch_norm = tail->op() == "FusedBatchNorm";
+			if (!batch_norm && tail->op() != "Mul") {
+				continue;
+			}
+
+			tensorflow::Tensor scales, biases;
+			int head_at = 0;
+			if (batch_norm) {
+				google::protobuf::Map<std::string, tensorflow::AttrValue>::const_iterator it = tail->attr().find("is_training");
+				if ((it != tail->attr().end() && it->second.b()) || !float_nhwc(*tail) || tail->input_size() < 5 || multiple_outputs.count(tail->name())) {
+					continue;
+				}
+				tensorflow::Tensor params[4];
+				bool ok = true;
+				for (int at2 = 0; at2 < 4 && ok; at2 ++) {
+					ok = float_const(first_output_node(graph_def, index, tail->input(at2 + 1)), params[at2]) && params[at2].dims() == 1 && params[at2].NumElements() == params[0].NumElements();
+				}
+				if (!ok) {
+					continue;
+				}
+				it = tail->attr().find("epsilon");
+				const float epsilon = it != tail->attr().end()? it->second.f(): 0.0001f;
+				// scale, offset, mean, variance
+				scales = tensorflow::Tensor(tensorflow::DT_FLOAT, params[0].shape());
+				biases = tensorflow::Tensor(tensorflow::DT_FLOAT, params[0].shape());
+				for (int at2 = 0; at2 < params[0].NumElements(); at2 ++) {
+					const float scale = params[0].flat<float>()(at2) / sqrt(params[3].flat<float>()(at2) + epsilon);
+					scales.flat<float>()(at2) = scale;
+					biases.flat<float>()(at2) = params[1].flat<float>()(at2) - params[2].flat<float>()(at2) * scale;
+				}
+
+			} else {
+				if (tail->input_size() != 2 || has_control_input(*tail)) {
+					continue;
+				}
+				head_at = float_const(first_output_node(graph_def, index, tail->input(1)), scales)? 0: 1;
+				if (head_at == 1 && !float_const(first_output_node(graph_def, index, tail->input(0)), scales)) {
+					continue;
+				}
+			}
+
+			const tensorflow::NodeDef* head = first_output_node(graph_def, index, tail->input(head_at));
+			tensorflow::Tensor weights;
+			int channels, inner;
+			if (!head || consumers[head->name()] != 1 || head->input_size() < 2 || !float_const(first_output_node(graph_def, index, head->input(1)), weights) || !weights_layout(*head, weights.shape(), channels, inner)) {
+				continue;
+			}
+			if (scales.NumElements() != 1 && (scales.dims() != 1 || scales.NumElements() != channels)) {
+				continue;
+			}
+
+			tensorflow::Tensor scaled(tensorflow::DT_FLOAT, weights.shape());
+			tensorflow::TTypes<float>::Flat flat_w = weights.flat<float>();
+			tensorflow::TTypes<float>::Flat flat_s = scales.flat<float>();
+			tensorflow::TTypes<float>::Flat flat_r = scaled.flat<float>();
+			for (int at2 = 0; at2 < weights.NumElements(); at2 ++) {
+				flat_r(at2) = flat_w(at2) * flat_s(scales.NumElements() == 1? 0: (at2 / inner) % channels);
+			}
+
+			tensorflow::GraphDef graph2;
+			const std::string prefix = tail->name() + "/folded";
+			add_const(graph2, prefix + "_weights", scaled, created);
+			tensorflow::NodeDef folded = *head;
+			folded.set_input(1, prefix + "_weights");
+			if (batch_norm) {
+				add_const(graph2, prefix + "_bias", biases, created);
+				folded.set_name(prefix);
+				graph2.add_node()->Swap(&folded);
+
+				tensorflow::NodeDef bias_add;
+				bias_add.set_name(tail->name());
+				bias_add.set_op("BiasAdd");
+				bias_add.set_device(tail->device());
+				bias_add.add_input(prefix);
+				bias_add.add_input(prefix + "_bias");
+				append_control_inputs(*tail, bias_add);
+				set_type_attr(bias_add, "T", tensorflow::DT_FLOAT);
+				set_string_attr(bias_add, "data_format", "NHWC");
+				tail->Swap(&bias_add);
+			} else {
+				folded.set_name(tail->name());
+				tail->Swap(&folded);
+			}
+			for (int at2 = 0; at2 < graph2.node_size(); at2 ++) {
+				news.push_back(graph2.node(at2));
+			}
+			// head's consumer is gone, it will be removed.
+			consumers[head->name()] = 0;
+			changed = true;
+			rewrites ++;
+		}
+		for (std::vector<tensorflow::NodeDef>::const_iterator it = news.begin(); it != news.end(); ++ it) {
+			*graph_def.add_node() = *it;
+		}
+	}
+	return rewrites;
+}
+
+// conv/matmul -> Add(per-channel Const) ==> BiasAdd, so it can be fused.
+static int add_to_bias_add(tensorflow::GraphDef& graph_def)
+{
+	int rewrites = 0;
+	const std::map<std::string, int> index = index_nodes(graph_def);
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		tensorflow::NodeDef* node = graph_def.mutable_node(at);
+		if (node->op() != "Add" || node->input_size() != 2 || !float_nhwc(*node)) {
+			continue;
+		}
+		int head_at = 0;
+		tensorflow::TensorShape bias_shape;
+		if (!weights_shape(first_output_node(graph_def, index, node->input(1)), bias_shape)) {
+			if (!weights_shape(first_output_node(graph_def, index, node->input(0)), bias_shape)) {
+				continue;
+			}
+			head_at = 1;
+		}
+		const tensorflow::NodeDef* head = first_output_node(graph_def, index, node->input(head_at));
+		tensorflow::TensorShape shape;
+		int channels, inner;
+		if (!head || head->input_size() < 2 || !weights_shape(first_output_node(graph_def, index, head->input(1)), shape) || !weights_layout(*head, shape, channels, inner)) {
+			continue;
+		}
+		if (bias_shape.dims() != 1 || bias_shape.dim_size(0) != channels) {
+			continue;
+		}
+
+		if (head_at == 1) {
+			const std::string bias = node->input(0);
+			node->set_input(0, node->input(1));
+			node->set_input(1, bias);
+		}
+		node->set_op("BiasAdd");
+		set_string_attr(*node, "data_format", "NHWC");
+		rewrites ++;
+	}
+	return rewrites;
+}
+
+// Conv2D/MatMul -> BiasAdd [-> Relu/Relu6] ==> FusedConv2DBias/FusedMatMulBias, that keeps name of last node.
+static int fuse_bias_activation(tensorflow::GraphDef& graph_def)
+{
+	int rewrites = 0;
+	const std::map<std::string, int> index = index_nodes(graph_def);
+	const std::map<std::string, int> consumers = count_consumers(graph_def);
+	// relu that uses bias_add
+	std::map<std::string, int> activations;
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		const tensorflow::NodeDef& node = graph_def.node(at);
+		if ((node.op() == "Relu" || node.op() == "Relu6") && node.input_size() >= 1 && node.input(0)[0] != '^') {
+			activations.insert(std::make_pair(input_node_name(node.input(0)), at));
+		}
+	}
+
+	std::set<std::string> fused;
+	for (int at = 0; at < graph_def.node_size(); at ++) {
+		const tensorflow::NodeDef& bias_add = graph_def.node(at);
+		if (bias_add.op() != "BiasAdd" || bias_add.input_size() < 2 || !float_nhwc(bias_add)) {
+			continue;
+		}
+		const tensorflow::NodeDef* head = first_output_node(graph_def, index, bias_add.input(0));
+		if (!head || fused.count(head->name()) || consumers.find(head->name())->second != 1 || (head->op() != "Conv2D" && head->op() != "MatMul") || !float_nhwc(*head)) {
+			continue;
+		}
+		google::protobuf::Map<std::string, tensorflow::AttrValue>::const_iterator it = head->attr().find("dilations");
+		bool dilated = false;
+		if (it != head->attr().end()) {
+			for (int at2 = 0; at2 < it->second.list().i_size(); at2 ++) {
+				dilated |= it->second.list().i(at2) != 1;
+			}
+		}
+		if (dilated) {
+			continue;
+		}
+
+		int tail_at = at;
+		std::string activation = "None";
+		std::map<std::string, int>::const_iterator find = activations.find(bias_add.name());
+		if (find != activations.end() && consumers.find(bias_add.name())->second == 1) {
+			tail_at = find->second;
+			activation = graph_def.node(tail_at).op();
+		}
+
+		tensorflow::NodeDef node;
+		const tensorflow::NodeDef& tail = graph_def.node(tail_at);
+		node.set_name(tail.name());
+		node.set_device(tail.device());
+		node.add_input(head->input(0));
+		node.add_input(head->input(1));
+		node.add_input(bias_add.input(1));
+		append_control_inputs(*head, node);
+		append_control_inputs(bias_add, node);
+		if (tail_at != at) {
+			append_control_inputs(tail, node);
+		}
+		set_type_attr(node, "T", tensorflow::DT_FLOAT);
+		set_string_attr(node, "activation", activation);
+		if (head->op() == "Conv2D") {
+			node.set_op("FusedConv2DBias");
+			copy_attr(*head, node, "strides");
+			copy_attr(*head, node, "padding");
+		} else {
+			node.set_op("FusedMatMulBias");
+			copy_attr(*head, node, "transpose_a");
+			copy_attr(*head, node, "transpose_b");
+		}
+		fused.insert(head->name());
+		graph_def.mutable_node(tail_at)->Swap(&node);
+		rewrites ++;
+	}
+	return rewrites;
+}
+
+// remove nodes that nobody uses, except outputs of source graph.
+static void remove_orphans(tensorflow::GraphDef& graph_def, const std::set<std::string>& outputs)
+{
+	bool removed = true;
+	while (removed) {
+		const std::map<std::string, int> consumers = count_consumers(graph_def);
+		removed = false;
+		google::protobuf::RepeatedPtrField<tensorflow::NodeDef>* nodes = graph_def.mutable_node();
+		for (int at = nodes->size() - 1; at >= 0; at --) {
+			const std::string& name = nodes->Get(at).name();
+			if (!outputs.count(name) && !consumers.count(name)) {
+				nodes->DeleteSubrange(at, 1);
+				removed = true;
+			}
+		}
+	}
+}
+
+// runtime optimizer(grappler) of session is disabled on mobile platform, do it when loading.
+int optimize_graph(tensorflow::GraphDef& graph_def)
+{
+	std::set<std::string> outputs;
+	{
+		const std::map<std::string, int> consumers = count_consumers(graph_def);
+		for (int at = 0; at < graph_def.node_size(); at ++) {
+			const tensorflow::NodeDef& node = graph_def.node(at);
+			// placeholder maybe fed though nobody uses it.
+			if (!consumers.count(node.name()) || node.op() == "Placeholder") {
+				outputs.insert(node.name());
+			}
+		}
+	}
+
+	int rewrites = bypass_forward_nodes(graph_def);
+	rewrites += fold_constants(graph_def);
+	rewrites += fold_scales(graph_def);
+	rewrites += add_to_bias_add(graph_def);
+	rewrites += fuse_bias_activation(graph_def);
+	remove_orphans(graph_def, outputs);
+	return rewrites;
+}
+
 }
\ No newline at end of file
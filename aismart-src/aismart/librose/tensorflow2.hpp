@@ -12,15 +12,73 @@ struct surface;
 class display;
 
 namespace tensorflow2 {
+
+// first: path of .pb, second: session shared with process-wide registry.
+typedef std::pair<std::string, std::shared_ptr<tensorflow::Session> > tsession;
+
+struct tsession_options
+{
+	explicit tsession_options(int intra_op_threads = 0, int inter_op_threads = 0, const std::string& pool_name = "")
+		: intra_op_threads(intra_op_threads)
+		, inter_op_threads(inter_op_threads)
+		, pool_name(pool_name)
+		, optimize(true)
+		, cache_optimized(false)
+	{}
+
+	int intra_op_threads; // 0: decided by tensorflow
+	int inter_op_threads; // 0: decided by tensorflow
+	std::string pool_name; // sessions with same pool_name share one inter-op thread pool. empty: process's default pool.
+	bool optimize; // run optimize_graph before create session.
+	bool cache_optimized; // save optimized graph to optimized_model_name, and use it next time if it's newer than .pb.
+};
+
+struct tsession_stats
+{
+	tsession_stats()
+		: hits(0)
+		, misses(0)
+		, evictions(0)
+		, load_ms(0)
+		, max_load_ms(0)
+	{}
+
+	int hits;
+	int misses;
+	int evictions;
+	uint32_t load_ms;
+	uint32_t max_load_ms;
+};
+
 std::string generate_link_function_name(const std::string& dir, const std::string& file);
 std::string insert_link_function(const std::string& fullname);
 bool read_file_to_proto(const std::string& file_name, ::google::protobuf::MessageLite& proto);
 
-tensorflow::Status load_model(const std::string& fname, std::unique_ptr<tensorflow::Session>& session);
-tensorflow::Status load_model(const std::string& fname, std::pair<std::string, std::unique_ptr<tensorflow::Session> >& session2) ;
+// memmapped model. xxx.pb's memmapped package is xxx.mmpb in same directory, generated by aismart --convert-model xxx.pb.
+std::string memmapped_model_name(const std::string& pb_path);
+tensorflow::Status convert_to_memmapped(const std::string& pb_path, const std::string& mmpb_path, int min_conversion_bytes = 10 * 1024);
+
+// prune forward-only nodes, fold constants and batch-norm into weights, fuse conv/matmul with bias and relu.
+// names of source graph's outputs don't change, intermediate nodes of folded/fused chain can't be fetched.
+// return count of rewrites.
+int optimize_graph(tensorflow::GraphDef& graph_def);
+// cache of optimized xxx.pb, in <user data dir>/tensorflow.
+std::string optimized_model_name(const std::string& pb_path);
+
+tensorflow::Status load_model(const std::string& fname, std::unique_ptr<tensorflow::Session>& session, const tsession_options& options = tsession_options());
+// if session2 already holds fname's session, use it. else get it from process-wide registry, load .pb only when miss.
+tensorflow::Status load_model(const std::string& fname, tsession& session2);
+// same as load_model, but reload .pb if it was modified after it was loaded.
+// sessions held by callers don't see set_session_options/clear_sessions until this.
+tensorflow::Status reload_model(const std::string& fname, tsession& session2);
+void set_session_options(const std::string& fname, const tsession_options& options);
+void set_session_capacity(int capacity);
+void clear_sessions();
+tsession_stats session_stats();
 
 std::map<std::string, tocr_result> ocr(const config& app_cfg, display& disp, const surface& surf, const std::vector<std::string>& fields, const std::string& pb_path);
-wchar_t inference_char(std::pair<std::string, std::unique_ptr<tensorflow::Session> >& current_session, const std::string& pb_short_path, cv::Mat& src2, uint32_t* used_ticks);
+std::vector<wchar_t> inference_chars(tsession& current_session, const std::string& pb_short_path, const std::vector<cv::Mat>& srcs, std::vector<uint32_t>* used_ticks);
+wchar_t inference_char(tsession& current_session, const std::string& pb_short_path, cv::Mat& src2, uint32_t* used_ticks);
 
 }
 
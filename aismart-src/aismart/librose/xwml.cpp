@@ -3,11 +3,15 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include "config.hpp"
 #include "filesystem.hpp"
 #include "tstring.hpp"
 #include "rose_config.hpp"
+#include "xwml.hpp"
+#include "loadscreen.hpp"
+#include "wml_exception.hpp"
 
 // terrain_builder
 #include "builder.hpp"
@@ -19,6 +23,13 @@
 #include <boost/foreach.hpp>
 #include "posix2.h"
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define WMLBIN_MARK_CONFIG		"[cfg]"
 #define WMLBIN_MARK_CONFIG_LEN	5
 #define WMLBIN_MARK_VALUE		"[val]"
@@ -40,100 +51,6 @@ static uint32_t tstring_textdomain_idx(const char *textdomain, std::vector<std::
 	}
 }
 
-// @deep: nesting deep. top level: 0
-static uint32_t wml_config_to_fp(posix_file_t fp, const config &cfg, uint32_t *max_str_len, std::vector<std::string>& td, uint16_t deep, std::vector<std::set<std::string> >& msgids)
-{
-	uint32_t u32n, bytes = 0;
-	int first;
-		
-	// config::child_list::const_iterator	ichildlist;
-	// string_map::const_iterator			istrmap;
-
-	// recursively resolve children
-	BOOST_FOREACH (const config::any_child &value, cfg.all_children_range()) {
-		// save {[cfg]}{len}{name}
-		posix_fwrite(fp, WMLBIN_MARK_CONFIG, WMLBIN_MARK_CONFIG_LEN);
-		u32n = posix_mku32(value.key.size(), deep);
-		posix_fwrite(fp, &u32n, sizeof(u32n));
-		posix_fwrite(fp, value.key.c_str(), posix_lo16(u32n));
-
-		bytes += WMLBIN_MARK_CONFIG_LEN + sizeof(u32n) + posix_lo16(u32n);
-
-		*max_str_len = posix_max(*max_str_len, value.key.size());
-
-		// save {[val]}{len}{name0}{len}{val0}{len}{name1}{len}{val1}{...}
-		// string_map	&values = value.cfg.gvalues();
-		// for (istrmap = values.begin(); istrmap != values.end(); istrmap ++) {
-		first = 1;
-		BOOST_FOREACH (const config::attribute &istrmap, value.cfg.attribute_range()) {
-			if (first) {
-				posix_fwrite(fp, WMLBIN_MARK_VALUE, WMLBIN_MARK_VALUE_LEN);
-
-				bytes += WMLBIN_MARK_VALUE_LEN;
-
-				first = 0;
-			}
-			u32n = istrmap.first.size();
-			posix_fwrite(fp, &u32n, sizeof(u32n));
-			posix_fwrite(fp, istrmap.first.c_str(), u32n);
-			*max_str_len = posix_max(*max_str_len, u32n);
-
-			bytes += sizeof(u32n) + u32n;
-
-			if (istrmap.second.t_str().translatable()) {
-				// parse translatable string
-				std::vector<t_string_base::trans_str> trans = istrmap.second.t_str().valuex();
-				for (std::vector<t_string_base::trans_str>::const_iterator ti = trans.begin(); ti != trans.end(); ti ++) {
-					int td_index = 0;
-					if (ti == trans.begin()) {
-						if (ti->td.empty()) {
-							u32n = posix_mku32(0, posix_mku16(0, trans.size()));
-						} else {
-							td_index = tstring_textdomain_idx(ti->td.c_str(), td, msgids);
-							u32n = posix_mku32(0, posix_mku16(td_index, trans.size()));
-						}
-					} else {
-						if (ti->td.empty()) {
-							u32n = posix_mku32(0, 0);
-						} else {
-							td_index = tstring_textdomain_idx(ti->td.c_str(), td, msgids);
-							u32n = posix_mku32(0, posix_mku16(td_index, 0));
-						}
-					}
-					// flag
-					posix_fwrite(fp, &u32n, sizeof(u32n));
-					// length of value
-					u32n = ti->str.size();
-					posix_fwrite(fp, &u32n, sizeof(u32n));
-					posix_fwrite(fp, ti->str.c_str(), u32n);
-
-					if (td_index) {
-						std::set<std::string>& item = msgids[td_index - 1];
-						item.insert(ti->str);
-					}
-
-					bytes += sizeof(u32n) + sizeof(u32n) + u32n;
-				}
-			} else {
-				// flag
-				u32n = 0;
-				posix_fwrite(fp, &u32n, sizeof(u32n));
-				// length of value
-				u32n = istrmap.second.str().size();
-				posix_fwrite(fp, &u32n, sizeof(u32n));
-				posix_fwrite(fp, istrmap.second.str().c_str(), u32n);
-
-				bytes += sizeof(u32n) + sizeof(u32n) + u32n;
-			}
-			*max_str_len = posix_max(*max_str_len, u32n);
-
-		}		
-		bytes += wml_config_to_fp(fp, value.cfg, max_str_len, td, deep + 1, msgids);
-	}
-
-	return bytes;
-}
-
 bool is_all_asci(const char* c_str, int len)
 {
 	for (int i = 0; i < len; i ++) {
@@ -224,57 +141,145 @@ static void generate_cfg_cpp(const std::string& fname, const std::vector<std::st
 	return;
 }
 
-void wml_config_to_file(const std::string& fname, const config &cfg, uint32_t nfiles, uint32_t sum_size, uint32_t modified, const std::map<std::string, std::string>& app_domains)
+static void collect_xwml2_strings(const config& cfg, std::set<std::string>& strings)
+{
+	BOOST_FOREACH (const config::attribute& attr, cfg.attribute_range()) {
+		strings.insert(attr.first);
+		if (attr.second.t_str().translatable()) {
+			std::vector<t_string_base::trans_str> trans = attr.second.t_str().valuex();
+			for (std::vector<t_string_base::trans_str>::const_iterator it = trans.begin(); it != trans.end(); ++ it) {
+				strings.insert(it->str);
+				strings.insert(it->td);
+			}
+		} else {
+			strings.insert(attr.second.str());
+		}
+	}
+	BOOST_FOREACH (const config::any_child& value, cfg.all_children_range()) {
+		strings.insert(value.key);
+		collect_xwml2_strings(value.cfg, strings);
+	}
+}
+
+static uint32_t xwml2_string_index(const std::vector<std::string>& strings, const std::string& str)
 {
-	uint32_t							max_str_len, u32n; 
+	std::vector<std::string>::const_iterator it = std::lower_bound(strings.begin(), strings.end(), str);
+	VALIDATE(it != strings.end() && *it == str, null_str);
+	return it - strings.begin();
+}
 
-	std::vector<std::string>			tdomain;
-	
+void wml_config_to_file(const std::string& fname, const config &cfg, uint32_t nfiles, uint32_t sum_size, uint32_t modified, const std::map<std::string, std::string>& app_domains)
+{
 	tfile lock(fname, GENERIC_WRITE, CREATE_ALWAYS);
 	if (!lock.valid()) {
 		posix_print("------<xwml.cpp>::wml_config_to_file, cannot create %s for write\n", fname.c_str());
 		return;
 	}
 
-	max_str_len = posix_max(WMLBIN_MARK_CONFIG_LEN, WMLBIN_MARK_VALUE_LEN);
-	uint32_t header_len = 16 + sizeof(max_str_len) + sizeof(u32n);
-	posix_fseek(lock.fp, header_len);
+	// intern all strings, std::set is sorted.
+	std::set<std::string> interned;
+	interned.insert(null_str);
+	collect_xwml2_strings(cfg, interned);
+	const std::vector<std::string> strings(interned.begin(), interned.end());
+	interned.clear();
+
+	uint32_t max_str_len = 0;
+	std::vector<uint32_t> offsets;
+	offsets.reserve(strings.size() + 1);
+	uint32_t blob_size = 0;
+	for (std::vector<std::string>::const_iterator it = strings.begin(); it != strings.end(); ++ it) {
+		offsets.push_back(blob_size);
+		blob_size += it->size() + 1;
+		max_str_len = posix_max(max_str_len, (uint32_t)it->size());
+	}
+	offsets.push_back(blob_size);
 
+	std::vector<std::string> tdomain;
 	std::vector<std::set<std::string> > msgids;
-	uint32_t data_len = wml_config_to_fp(lock.fp, cfg, &max_str_len, tdomain, 0, msgids);
-
-	// update max_str_len/data_len
-	posix_fseek(lock.fp, 0);
-
-	// 0--15
-	u32n = mmioFOURCC('X', 'W', 'M', 'L');
-	posix_fwrite(lock.fp, &u32n, 4);
-	posix_fwrite(lock.fp, &nfiles, 4);
-	posix_fwrite(lock.fp, &sum_size, 4);
-	posix_fwrite(lock.fp, &modified, 4);
-	// 16--19(max_str_len)
-	posix_fwrite(lock.fp, &max_str_len, sizeof(max_str_len));
-	// 20--23(data_len)
-	posix_fwrite(lock.fp, &data_len, sizeof(u32n));
-
-	// write [textdomain]
-	posix_fseek(lock.fp, header_len + data_len);
+	std::vector<xwml2::tnode> nodes;
+	std::vector<xwml2::tattr> attrs;
+	std::vector<xwml2::tpart> parts;
+
+	// breadth first, so children of a node are continuous.
+	std::vector<const config*> queue(1, &cfg);
+	xwml2::tnode node;
+	memset(&node, 0, sizeof(node));
+	node.name = xwml2_string_index(strings, null_str);
+	nodes.push_back(node);
+	for (size_t at = 0; at < queue.size(); at ++) {
+		const config& current = *queue[at];
+
+		nodes[at].first_attr = attrs.size();
+		// attribute_range is sorted by key, so are indexes of keys.
+		BOOST_FOREACH (const config::attribute& istrmap, current.attribute_range()) {
+			xwml2::tattr attr;
+			attr.key = xwml2_string_index(strings, istrmap.first);
+			if (istrmap.second.t_str().translatable()) {
+				std::vector<t_string_base::trans_str> trans = istrmap.second.t_str().valuex();
+				attr.value = parts.size();
+				attr.parts = trans.size();
+				for (std::vector<t_string_base::trans_str>::const_iterator ti = trans.begin(); ti != trans.end(); ++ ti) {
+					xwml2::tpart part;
+					part.str = xwml2_string_index(strings, ti->str);
+					part.textdomain = tstring_textdomain_idx(ti->td.c_str(), tdomain, msgids);
+					if (part.textdomain) {
+						msgids[part.textdomain - 1].insert(ti->str);
+					}
+					parts.push_back(part);
+				}
+			} else {
+				attr.value = xwml2_string_index(strings, istrmap.second.str());
+				attr.parts = 0;
+			}
+			attrs.push_back(attr);
+		}
+		nodes[at].attrs = attrs.size() - nodes[at].first_attr;
 
-	// write [textdomain]
-	u32n = tdomain.size();
-	posix_fwrite(lock.fp, &u32n, sizeof(u32n));
+		nodes[at].first_child = nodes.size();
+		BOOST_FOREACH (const config::any_child& value, current.all_children_range()) {
+			queue.push_back(&value.cfg);
+			node.name = xwml2_string_index(strings, value.key);
+			nodes.push_back(node);
+		}
+		nodes[at].children = nodes.size() - nodes[at].first_child;
+	}
 
+	std::vector<uint32_t> tdomains;
 	for (std::vector<std::string>::const_iterator it = tdomain.begin(); it != tdomain.end(); ++ it) {
-		const std::string& str = *it;
-		u32n = str.size();
-		posix_fwrite(lock.fp, &u32n, sizeof(u32n));
-		posix_fwrite(lock.fp, str.c_str(), u32n);
+		tdomains.push_back(xwml2_string_index(strings, *it));
+	}
+
+	xwml2::theader header;
+	header.fourcc = mmioFOURCC('X', 'W', 'M', '2');
+	header.nfiles = nfiles;
+	header.sum_size = sum_size;
+	header.modified = modified;
+	header.strings = strings.size();
+	header.nodes = nodes.size();
+	header.attrs = attrs.size();
+	header.parts = parts.size();
+	header.tdomains = tdomains.size();
+	header.blob_size = blob_size;
+
+	posix_fwrite(lock.fp, &header, sizeof(header));
+	posix_fwrite(lock.fp, &offsets[0], offsets.size() * sizeof(uint32_t));
+	if (!tdomains.empty()) {
+		posix_fwrite(lock.fp, &tdomains[0], tdomains.size() * sizeof(uint32_t));
+	}
+	posix_fwrite(lock.fp, &nodes[0], nodes.size() * sizeof(xwml2::tnode));
+	if (!attrs.empty()) {
+		posix_fwrite(lock.fp, &attrs[0], attrs.size() * sizeof(xwml2::tattr));
+	}
+	if (!parts.empty()) {
+		posix_fwrite(lock.fp, &parts[0], parts.size() * sizeof(xwml2::tpart));
+	}
+	for (std::vector<std::string>::const_iterator it = strings.begin(); it != strings.end(); ++ it) {
+		posix_fwrite(lock.fp, it->c_str(), it->size() + 1);
 	}
 
 	generate_cfg_cpp(fname, tdomain, msgids, max_str_len, app_domains);
 }
 
-
 bool wml_config_from_data(uint8_t *data, uint32_t datalen, uint8_t *namebuf, uint8_t *valbuf, std::vector<std::string> &tdomain, config &cfg)
 {
 	int									retval;
@@ -380,6 +385,330 @@ bool wml_config_from_data(uint8_t *data, uint32_t datalen, uint8_t *namebuf, uin
 	return true;
 }
 
+tmapped_file::tmapped_file(const std::string& fname)
+	: data_(NULL)
+	, size_(0)
+	, mapped_(false)
+{
+#ifdef _WIN32
+	int wlen = MultiByteToWideChar(CP_UTF8, 0, fname.c_str(), -1, NULL, 0);
+	std::vector<WCHAR> wc(wlen + 1, 0);
+	MultiByteToWideChar(CP_UTF8, 0, fname.c_str(), -1, &wc[0], wlen);
+
+	HANDLE file = CreateFileW(&wc[0], GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+			HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping) {
+				// view keeps mapping alive after handles are closed.
+				data_ = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+			}
+			if (data_) {
+				size_ = size.QuadPart;
+				mapped_ = true;
+			}
+		}
+		CloseHandle(file);
+	}
+#else
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd != -1) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED) {
+				data_ = (const uint8_t*)ptr;
+				size_ = st.st_size;
+				mapped_ = true;
+			}
+		}
+		close(fd);
+	}
+#endif
+	if (mapped_) {
+		return;
+	}
+
+	// for example android's asset, read it by SDL.
+	tfile lock(fname, GENERIC_READ, OPEN_EXISTING);
+	if (!lock.valid()) {
+		return;
+	}
+	const int64_t fsize = posix_fsize(lock.fp);
+	if (fsize <= 0) {
+		return;
+	}
+	uint8_t* buf = (uint8_t*)malloc(fsize);
+	posix_fseek(lock.fp, 0);
+	if (posix_fread(lock.fp, buf, fsize) != (size_t)fsize) {
+		free(buf);
+		return;
+	}
+	data_ = buf;
+	size_ = fsize;
+}
+
+tmapped_file::~tmapped_file()
+{
+	if (!data_) {
+		return;
+	}
+	if (mapped_) {
+#ifdef _WIN32
+		UnmapViewOfFile(data_);
+#else
+		munmap((void*)data_, size_);
+#endif
+	} else {
+		free((void*)data_);
+	}
+}
+
+// append count items of item_size to size. counts are from file, so check them against file size before multiply.
+static bool append_section(int64_t& size, uint32_t count, size_t item_size, int64_t file_size)
+{
+	if (size > file_size || count > (uint64_t)(file_size - size) / item_size) {
+		return false;
+	}
+	size += (int64_t)count * (int64_t)item_size;
+	return true;
+}
+
+txwml_view::txwml_view(const std::string& fname)
+	: file_(fname)
+	, header_(NULL)
+	, offsets_(NULL)
+	, tdomains_(NULL)
+	, nodes_(NULL)
+	, attrs_(NULL)
+	, parts_(NULL)
+	, blob_(NULL)
+{
+	if (!file_.valid() || file_.size() < (int64_t)sizeof(xwml2::theader)) {
+		return;
+	}
+	const xwml2::theader* header = (const xwml2::theader*)file_.data();
+	if (header->fourcc != mmioFOURCC('X', 'W', 'M', '2') || !header->nodes) {
+		return;
+	}
+	const int64_t file_size = file_.size();
+	int64_t size = sizeof(xwml2::theader);
+	const bool ok = append_section(size, header->strings, sizeof(uint32_t), file_size) && append_section(size, 1, sizeof(uint32_t), file_size)
+		&& append_section(size, header->tdomains, sizeof(uint32_t), file_size) && append_section(size, header->nodes, sizeof(xwml2::tnode), file_size)
+		&& append_section(size, header->attrs, sizeof(xwml2::tattr), file_size) && append_section(size, header->parts, sizeof(xwml2::tpart), file_size)
+		&& append_section(size, header->blob_size, 1, file_size);
+	if (!ok || size != file_size) {
+		posix_print("------<xwml.cpp>::txwml_view, %s is truncated\n", fname.c_str());
+		return;
+	}
+
+	offsets_ = (const uint32_t*)(header + 1);
+	tdomains_ = offsets_ + header->strings + 1;
+	nodes_ = (const xwml2::tnode*)(tdomains_ + header->tdomains);
+	attrs_ = (const xwml2::tattr*)(nodes_ + header->nodes);
+	parts_ = (const xwml2::tpart*)(attrs_ + header->attrs);
+	blob_ = (const char*)(parts_ + header->parts);
+	header_ = header;
+
+	for (uint32_t at = 0; at < header_->tdomains; at ++) {
+		tdomain_names_.push_back(string(tdomains_[at]).to_string());
+		t_string::add_textdomain(tdomain_names_.back(), get_intl_dir());
+	}
+}
+
+int txwml_view::find_string(const std::string& str) const
+{
+	int first = 0, last = header_->strings;
+	while (first < last) {
+		const int mid = (first + last) / 2;
+		const int cmp = string(mid).compare(boost::string_ref(str));
+		if (cmp == 0) {
+			return mid;
+		} else if (cmp < 0) {
+			first = mid + 1;
+		} else {
+			last = mid;
+		}
+	}
+	return -1;
+}
+
+t_string txwml_view::tstring(const xwml2::tattr& attr) const
+{
+	if (!attr.parts) {
+		return t_string(string(attr.value).data());
+	}
+	t_string result;
+	for (uint32_t at = 0; at < attr.parts; at ++) {
+		const xwml2::tpart& part = parts_[attr.value + at];
+		const char* str = string(part.str).data();
+		if (part.textdomain) {
+			result += t_string(str, tdomain_names_[part.textdomain - 1]);
+		} else {
+			result += t_string(str);
+		}
+	}
+	return result;
+}
+
+const xwml2::tnode& txwml_view::tnode::node() const
+{
+	return view_->nodes_[index_];
+}
+
+boost::string_ref txwml_view::tnode::key() const
+{
+	return view_->string(node().name);
+}
+
+int txwml_view::tnode::children() const
+{
+	return node().children;
+}
+
+txwml_view::tnode txwml_view::tnode::child_at(int at) const
+{
+	VALIDATE(at >= 0 && at < (int)node().children, null_str);
+	return tnode(*view_, node().first_child + at);
+}
+
+txwml_view::tnode txwml_view::tnode::child(const std::string& key, int n) const
+{
+	const int name = view_->find_string(key);
+	if (name == -1) {
+		return tnode();
+	}
+	const xwml2::tnode& current = node();
+	for (uint32_t at = current.first_child; at < current.first_child + current.children; at ++) {
+		if (view_->nodes_[at].name == (uint32_t)name && n -- == 0) {
+			return tnode(*view_, at);
+		}
+	}
+	return tnode();
+}
+
+int txwml_view::tnode::child_count(const std::string& key) const
+{
+	const int name = view_->find_string(key);
+	if (name == -1) {
+		return 0;
+	}
+	int count = 0;
+	const xwml2::tnode& current = node();
+	for (uint32_t at = current.first_child; at < current.first_child + current.children; at ++) {
+		if (view_->nodes_[at].name == (uint32_t)name) {
+			count ++;
+		}
+	}
+	return count;
+}
+
+const xwml2::tattr* txwml_view::tnode::find_attr(const std::string& key) const
+{
+	const int index = view_->find_string(key);
+	if (index == -1) {
+		return NULL;
+	}
+	const xwml2::tnode& current = node();
+	const xwml2::tattr* first = view_->attrs_ + current.first_attr;
+	const xwml2::tattr* last = first + current.attrs;
+	while (first < last) {
+		const xwml2::tattr* mid = first + (last - first) / 2;
+		if (mid->key == (uint32_t)index) {
+			return mid;
+		} else if (mid->key < (uint32_t)index) {
+			first = mid + 1;
+		} else {
+			last = mid;
+		}
+	}
+	return NULL;
+}
+
+bool txwml_view::tnode::has_attribute(const std::string& key) const
+{
+	return find_attr(key) != NULL;
+}
+
+boost::string_ref txwml_view::tnode::attribute(const std::string& key) const
+{
+	const xwml2::tattr* attr = find_attr(key);
+	if (!attr) {
+		return boost::string_ref();
+	}
+	return view_->string(attr->parts? view_->parts_[attr->value].str: attr->value);
+}
+
+t_string txwml_view::tnode::attribute_tstr(const std::string& key) const
+{
+	const xwml2::tattr* attr = find_attr(key);
+	return attr? view_->tstring(*attr): t_string();
+}
+
+// materialize view into config. every interned string is converted to std::string at most once,
+// and plain value is parsed to attribute_value at most once.
+class txwml2_materializer
+{
+public:
+	explicit txwml2_materializer(const txwml_view& view, uint32_t strings)
+		: view_(view)
+		, names_(strings)
+		, name_valid_(strings, false)
+		, values_(strings)
+		, value_valid_(strings, false)
+	{}
+
+	const std::string& name(uint32_t index)
+	{
+		if (!name_valid_[index]) {
+			names_[index] = view_.string(index).to_string();
+			name_valid_[index] = true;
+		}
+		return names_[index];
+	}
+
+	const config::attribute_value& value(uint32_t index)
+	{
+		if (!value_valid_[index]) {
+			values_[index] = name(index);
+			value_valid_[index] = true;
+		}
+		return values_[index];
+	}
+
+private:
+	const txwml_view& view_;
+	std::vector<std::string> names_;
+	std::vector<bool> name_valid_;
+	std::vector<config::attribute_value> values_;
+	std::vector<bool> value_valid_;
+};
+
+static void xwml2_to_config(const txwml_view& view, const xwml2::tnode* nodes, const xwml2::tattr* attrs, uint32_t index, txwml2_materializer& materializer, config& cfg)
+{
+	const xwml2::tnode& node = nodes[index];
+	for (uint32_t at = node.first_attr; at < node.first_attr + node.attrs; at ++) {
+		const xwml2::tattr& attr = attrs[at];
+		if (attr.parts) {
+			cfg[materializer.name(attr.key)] = view.tstring(attr);
+		} else {
+			cfg[materializer.name(attr.key)] = materializer.value(attr.value);
+		}
+	}
+	for (uint32_t at = node.first_child; at < node.first_child + node.children; at ++) {
+		config& child = cfg.add_child(materializer.name(nodes[at].name));
+		xwml2_to_config(view, nodes, attrs, at, materializer, child);
+	}
+}
+
+void txwml_view::tnode::to_config(config& cfg) const
+{
+	txwml2_materializer materializer(*view_, view_->header_->strings);
+	xwml2_to_config(*view_, view_->nodes_, view_->attrs_, index_, materializer, cfg);
+}
+
 #define MIN_XMIN_BIN_SIZE		28	// 16 + 4 + 4 +....+4... last +4 is size of textdomain.
 
 void wml_config_from_file(const std::string &fname, config &cfg, uint32_t* nfiles, uint32_t* sum_size, uint32_t* modified)
@@ -395,6 +724,24 @@ void wml_config_from_file(const std::string &fname, config &cfg, uint32_t* nfile
 
 	cfg.clear();	// first clear. below action is add.
 
+	{
+		const txwml_view view(fname);
+		if (view.valid()) {
+			if (nfiles) {
+				*nfiles = view.nfiles();
+			}
+			if (sum_size) {
+				*sum_size = view.sum_size();
+			}
+			if (modified) {
+				*modified = view.modified();
+			}
+			view.to_config(cfg);
+			return;
+		}
+	}
+
+	// v1
 	tfile lock(fname, GENERIC_READ, OPEN_EXISTING);
 	if (!lock.valid()) {
 		posix_print("------<xwml.cpp>::wml_config_from_file, cannot create %s for read\n", fname.c_str());
@@ -474,7 +821,7 @@ bool wml_checksum_from_file(const std::string &fname, uint32_t* nfiles, uint32_t
 	}
 	posix_fseek(lock.fp, 0);
 	posix_fread(lock.fp, &tmp, 4);
-	if (tmp != mmioFOURCC('X', 'W', 'M', 'L')) {
+	if (tmp != mmioFOURCC('X', 'W', 'M', 'L') && tmp != mmioFOURCC('X', 'W', 'M', '2')) {
 		return false;
 	}
 	posix_fread(lock.fp, &tmp, 4);
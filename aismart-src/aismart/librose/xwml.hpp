@@ -0,0 +1,160 @@
+#ifndef LIBROSE_XWML_HPP_INCLUDED
+#define LIBROSE_XWML_HPP_INCLUDED
+
+#include "tstring.hpp"
+#include "posix2.h"
+
+#include <boost/utility/string_ref.hpp>
+#include <string>
+#include <vector>
+
+class config;
+
+//
+// xwml v2 binary format, file is used in place, so every section is array of uint32_t.
+//  header
+//  offsets[strings + 1]: offset of string in blob. strings are sorted and null-terminated,
+//                        so key is found by binary search, and string is used without copy.
+//  tdomains[tdomains]: string index of textdomain.
+//  nodes[nodes]: breadth first, children of a node are continuous. node 0 is root.
+//  attrs[attrs]: attributes of a node are continuous and sorted by key.
+//  parts[parts]: parts of translatable values.
+//  blob
+//
+namespace xwml2 {
+struct theader
+{
+	uint32_t fourcc;
+	uint32_t nfiles;
+	uint32_t sum_size;
+	uint32_t modified;
+	uint32_t strings;
+	uint32_t nodes;
+	uint32_t attrs;
+	uint32_t parts;
+	uint32_t tdomains;
+	uint32_t blob_size;
+};
+
+struct tnode
+{
+	uint32_t name;
+	uint32_t first_child;
+	uint32_t children;
+	uint32_t first_attr;
+	uint32_t attrs;
+};
+
+struct tattr
+{
+	uint32_t key;
+	uint32_t value; // parts == 0: string index of value. else index of first part.
+	uint32_t parts;
+};
+
+struct tpart
+{
+	uint32_t str;
+	uint32_t textdomain; // 0: none. else index of tdomains + 1.
+};
+}
+
+// read-only mapping of whole file. if file can not be mapped(for example in android's apk),
+// it is read into memory.
+class tmapped_file
+{
+public:
+	explicit tmapped_file(const std::string& fname);
+	~tmapped_file();
+
+	bool valid() const { return data_ != NULL; }
+	const uint8_t* data() const { return data_; }
+	int64_t size() const { return size_; }
+
+private:
+	tmapped_file(const tmapped_file&);
+	void operator=(const tmapped_file&);
+
+private:
+	const uint8_t* data_;
+	int64_t size_;
+	bool mapped_;
+};
+
+//
+// read-only view of xwml v2 file. children and attributes are resolved on demand, no config is built.
+//
+class txwml_view
+{
+public:
+	class tnode
+	{
+	public:
+		tnode()
+			: view_(NULL)
+			, index_(0)
+		{}
+
+		tnode(const txwml_view& view, uint32_t index)
+			: view_(&view)
+			, index_(index)
+		{}
+
+		bool valid() const { return view_ != NULL; }
+		boost::string_ref key() const;
+
+		int children() const;
+		tnode child_at(int at) const;
+		// n-th child that's name is key. invalid node if not exist.
+		tnode child(const std::string& key, int n = 0) const;
+		int child_count(const std::string& key) const;
+
+		bool has_attribute(const std::string& key) const;
+		// for translatable value, it is msgid of first part, use attribute_tstr for it.
+		boost::string_ref attribute(const std::string& key) const;
+		t_string attribute_tstr(const std::string& key) const;
+
+		// add attributes and children of this node to cfg.
+		void to_config(config& cfg) const;
+
+	private:
+		const xwml2::tnode& node() const;
+		const xwml2::tattr* find_attr(const std::string& key) const;
+
+	private:
+		const txwml_view* view_;
+		uint32_t index_;
+	};
+
+	explicit txwml_view(const std::string& fname);
+
+	bool valid() const { return header_ != NULL; }
+	tnode root() const { return tnode(*this, 0); }
+
+	uint32_t nfiles() const { return header_->nfiles; }
+	uint32_t sum_size() const { return header_->sum_size; }
+	uint32_t modified() const { return header_->modified; }
+
+	boost::string_ref string(uint32_t index) const { return boost::string_ref(blob_ + offsets_[index], offsets_[index + 1] - offsets_[index] - 1); }
+	// -1 if str isn't in string table.
+	int find_string(const std::string& str) const;
+	t_string tstring(const xwml2::tattr& attr) const;
+
+	void to_config(config& cfg) const { root().to_config(cfg); }
+
+private:
+	friend class tnode;
+
+	tmapped_file file_;
+	const xwml2::theader* header_;
+	const uint32_t* offsets_;
+	const uint32_t* tdomains_;
+	const xwml2::tnode* nodes_;
+	const xwml2::tattr* attrs_;
+	const xwml2::tpart* parts_;
+	const char* blob_;
+
+	std::vector<std::string> tdomain_names_;
+};
+
+#endif